@@ -0,0 +1,148 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2018, Enno Boland
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @author       Enno Boland (mail@eboland.de)
+ * @file         directory_lookup.c
+ *
+ * Measures name lookups in a large directory. Expects an image created by
+ * utils/create_bigdir_squashfs.sh.
+ */
+
+#define _GNU_SOURCE
+
+#include "../src/context/inode_context.h"
+#include "../src/hsqs.h"
+#include "../src/iterator/directory_iterator.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define LOOKUPS 2000
+
+static int
+count_entries(struct HsqsInodeContext *dir, size_t *count) {
+	int rv = 0;
+	struct HsqsDirectoryIterator iter = {0};
+
+	*count = 0;
+	rv = hsqs_directory_iterator_init(&iter, dir);
+	if (rv < 0) {
+		goto out;
+	}
+	while ((rv = hsqs_directory_iterator_next(&iter)) > 0) {
+		(*count)++;
+	}
+
+out:
+	hsqs_directory_iterator_cleanup(&iter);
+	return rv;
+}
+
+static int
+run(struct HsqsInodeContext *dir, size_t count, const char *suffix) {
+	int rv = 0;
+	char name[32];
+	int name_len;
+	struct timespec start, end;
+	double elapsed;
+	uint64_t x = 0x9E3779B97F4A7C15ULL;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < LOOKUPS; i++) {
+		struct HsqsDirectoryIterator iter = {0};
+
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		name_len = snprintf(
+				name, sizeof(name), "%06zu%s", (size_t)(x % count) + 1,
+				suffix);
+
+		rv = hsqs_directory_iterator_init(&iter, dir);
+		if (rv == 0) {
+			rv = hsqs_directory_iterator_lookup(&iter, name, name_len);
+		}
+		hsqs_directory_iterator_cleanup(&iter);
+		if (rv < 0 && rv != -HSQS_ERROR_NO_SUCH_FILE) {
+			return rv;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	elapsed = (double)(end.tv_sec - start.tv_sec) +
+			(double)(end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("entries: %8zu  %-8s  us/lookup: %10.2f\n", count,
+		   suffix[0] == '\0' ? "found" : "missing",
+		   elapsed * 1e6 / LOOKUPS);
+	return 0;
+}
+
+int
+main(int argc, char **argv) {
+	int rv = 0;
+	size_t count;
+	struct Hsqs hsqs = {0};
+	struct HsqsInodeContext dir = {0};
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s IMAGE\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	rv = hsqs_open(&hsqs, argv[1]);
+	if (rv < 0) {
+		goto out;
+	}
+	rv = hsqs_inode_load_root(&dir, &hsqs);
+	if (rv < 0) {
+		goto out;
+	}
+	rv = count_entries(&dir, &count);
+	if (rv < 0 || count == 0) {
+		goto out;
+	}
+
+	rv = run(&dir, count, "");
+	if (rv < 0) {
+		goto out;
+	}
+	rv = run(&dir, count, "x");
+
+out:
+	hsqs_inode_cleanup(&dir);
+	hsqs_cleanup(&hsqs);
+	if (rv < 0) {
+		hsqs_perror(rv, argv[1]);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,140 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2018, Enno Boland
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @author       Enno Boland (mail@eboland.de)
+ * @file         sharded_lru_hashmap.c
+ *
+ * Measures cache throughput when several threads hammer one hashmap.
+ */
+
+#define _GNU_SOURCE
+
+#include "../src/primitive/sharded_lru_hashmap.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define THREADS 8
+#define ITERATIONS 200000
+#define WORKING_SET 4096
+
+struct Worker {
+	pthread_t thread;
+	struct HsqsShardedLruHashmap *hashmap;
+	uint64_t seed;
+	int rv;
+};
+
+static int
+dummy_dtor(void *pointer) {
+	(void)pointer;
+	return 0;
+}
+
+static void *
+worker(void *arg) {
+	struct Worker *w = arg;
+	struct HsqsRefCount *rc;
+	uint64_t x = w->seed;
+
+	for (int i = 0; i < ITERATIONS; i++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		uint64_t key = (x % WORKING_SET) * 8192;
+
+		if (hsqs_sharded_lru_hashmap_get(w->hashmap, key) != NULL) {
+			continue;
+		}
+		w->rv = hsqs_ref_count_new(&rc, sizeof(int), dummy_dtor);
+		if (w->rv < 0) {
+			break;
+		}
+		w->rv = hsqs_sharded_lru_hashmap_put(w->hashmap, key, rc);
+		if (w->rv < 0) {
+			break;
+		}
+	}
+	return NULL;
+}
+
+static int
+run(size_t shard_count) {
+	int rv = 0;
+	struct HsqsShardedLruHashmap hashmap = {0};
+	struct Worker workers[THREADS] = {0};
+	struct timespec start, end;
+	double elapsed;
+
+	rv = hsqs_sharded_lru_hashmap_init(
+			&hashmap, shard_count, WORKING_SET / 2, 0);
+	if (rv < 0) {
+		return rv;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < THREADS; i++) {
+		workers[i].hashmap = &hashmap;
+		workers[i].seed = 0x9E3779B97F4A7C15ULL * (i + 1);
+		pthread_create(&workers[i].thread, NULL, worker, &workers[i]);
+	}
+	for (int i = 0; i < THREADS; i++) {
+		pthread_join(workers[i].thread, NULL);
+		if (workers[i].rv < 0) {
+			rv = workers[i].rv;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	elapsed = (double)(end.tv_sec - start.tv_sec) +
+			(double)(end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("shards: %3zu  threads: %d  ops/s: %12.0f  hitrate: %.3f\n",
+		   shard_count, THREADS, (double)THREADS * ITERATIONS / elapsed,
+		   (double)hsqs_sharded_lru_hashmap_hits(&hashmap) /
+				   (double)(THREADS * ITERATIONS));
+
+	hsqs_sharded_lru_hashmap_cleanup(&hashmap);
+	return rv;
+}
+
+int
+main(void) {
+	static const size_t shard_counts[] = {1, 2, 4, 8, 16, 64};
+
+	for (size_t i = 0; i < sizeof(shard_counts) / sizeof(*shard_counts); i++) {
+		if (run(shard_counts[i]) < 0) {
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
@@ -43,6 +43,10 @@
 #include <string.h>
 #include <unistd.h>
 
+// Files are streamed in chunks of this size, so sequential prefetching can
+// decompress the next blocks while the current chunk is written.
+#define HSQS_CAT_CHUNK_SIZE (1024 * 1024)
+
 static int
 usage(char *arg0) {
 	printf("usage: %s FILESYSTEM PATH [PATH ...]\n", arg0);
@@ -54,6 +58,7 @@ static int
 cat_path(struct Hsqs *hsqs, char *path) {
 	struct HsqsInodeContext inode = {0};
 	struct HsqsFileContext file = {0};
+	uint64_t file_size, pos, chunk_size;
 
 	int rv = 0;
 	rv = hsqs_inode_load_by_path(&inode, hsqs, path);
@@ -70,15 +75,25 @@ cat_path(struct Hsqs *hsqs, char *path) {
 		goto out;
 	}
 
-	rv = hsqs_content_read(&file, hsqs_inode_file_size(&inode));
-	if (rv < 0) {
-		hsqs_perror(rv, path);
-		rv = EXIT_FAILURE;
-		goto out;
-	}
+	file_size = hsqs_inode_file_size(&inode);
+	for (pos = 0; pos < file_size; pos += chunk_size) {
+		chunk_size = MIN(file_size - pos, HSQS_CAT_CHUNK_SIZE);
+		rv = hsqs_content_seek(&file, pos);
+		if (rv < 0) {
+			hsqs_perror(rv, path);
+			rv = EXIT_FAILURE;
+			goto out;
+		}
+		rv = hsqs_content_read(&file, chunk_size);
+		if (rv < 0) {
+			hsqs_perror(rv, path);
+			rv = EXIT_FAILURE;
+			goto out;
+		}
 
-	fwrite(hsqs_content_data(&file), sizeof(uint8_t), hsqs_content_size(&file),
-		   stdout);
+		fwrite(hsqs_content_data(&file), sizeof(uint8_t), chunk_size, stdout);
+	}
+	rv = 0;
 out:
 	hsqs_content_cleanup(&file);
 	hsqs_inode_cleanup(&inode);
@@ -91,6 +106,8 @@ main(int argc, char *argv[]) {
 	int opt = 0;
 	const char *image_path;
 	struct Hsqs hsqs = {0};
+	struct HsqsOptions options = {0};
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
 
 	while ((opt = getopt(argc, argv, "vh")) != -1) {
 		switch (opt) {
@@ -109,7 +126,9 @@ main(int argc, char *argv[]) {
 	image_path = argv[optind];
 	optind++;
 
-	rv = hsqs_open(&hsqs, image_path);
+	// prefetching only pays off with spare cores next to the reader.
+	options.worker_count = cpus > 1 ? cpus - 1 : 0;
+	rv = hsqs_open_any_ex(&hsqs, image_path, &options);
 	if (rv < 0) {
 		hsqs_perror(rv, image_path);
 		rv = EXIT_FAILURE;
@@ -283,7 +283,7 @@ main(int argc, char *argv[]) {
 	image_path = argv[optind];
 	optind++;
 
-	rv = hsqs_open(&hsqs, image_path);
+	rv = hsqs_open_any_ex(&hsqs, image_path, NULL);
 	if (rv < 0) {
 		hsqs_perror(rv, image_path);
 		rv = EXIT_FAILURE;
@@ -31,129 +31,267 @@
  * @file         hsqs-mount.c
  */
 
-#define FUSE_USE_VERSION 35
+#define FUSE_USE_VERSION 312
 
 #include <errno.h>
-#include <fuse.h>
+#include <float.h>
+#include <fuse_lowlevel.h>
+#include <pthread.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "../src/context/content_context.h"
 #include "../src/context/inode_context.h"
+#include "../src/context/name_index_context.h"
+#include "../src/context/superblock_context.h"
+#include "../src/error.h"
 #include "../src/hsqs.h"
 #include "../src/iterator/directory_iterator.h"
 #include "../src/iterator/xattr_iterator.h"
 
+// The image is read only, so everything the kernel caches stays valid.
+#define HSQSFUSE_TIMEOUT DBL_MAX
+#define HSQSFUSE_UNKNOWN_INO 0xffffffff
+// Upper bound of the sequential read ahead window in data blocks.
+#define HSQSFUSE_READ_AHEAD_MAX 16
+
 static struct { struct Hsqs hsqs; } data = {0};
 
 static struct HsqsfuseOptions {
 	int show_help;
+	unsigned int workers;
+	unsigned int connections;
+	unsigned long chunk_size;
+	char *cache_dir;
 	const char *image_path;
 } options = {0};
 
+struct HsqsfuseFile {
+	pthread_mutex_t lock;
+	struct HsqsInodeContext inode;
+	struct HsqsFileContext content;
+	uint64_t next_offset;
+	uint32_t read_ahead;
+};
+
+struct HsqsfuseDirectory {
+	struct HsqsInodeContext inode;
+	struct HsqsDirectoryIterator iterator;
+	off_t offset;
+	bool pending;
+};
+
 #define HSQS_OPT_KEY(t, p) \
 	{ t, offsetof(struct HsqsfuseOptions, p), 1 }
 // clang-format off
 static const struct fuse_opt option_spec[] = {
 	HSQS_OPT_KEY("-h", show_help),
 	HSQS_OPT_KEY("--help", show_help),
+	HSQS_OPT_KEY("workers=%u", workers),
+	HSQS_OPT_KEY("connections=%u", connections),
+	HSQS_OPT_KEY("chunk_size=%lu", chunk_size),
+	HSQS_OPT_KEY("cache_dir=%s", cache_dir),
 	FUSE_OPT_END
 };
 // clang-format on
 
 static void
 help(const char *arg0) {
-	(void)arg0;
-	// TODO
+	printf("usage: %s [options] <image> <mountpoint>\n\n", arg0);
+	printf("    -o workers=N           number of threads serving requests\n"
+		   "                           (default: number of CPUs)\n");
+#ifdef CONFIG_CURL
+	printf("    -o connections=N       number of HTTP connections\n"
+		   "                           of remote images\n"
+		   "    -o chunk_size=N        download size of remote images\n"
+		   "    -o cache_dir=DIR       keep downloaded data of remote\n"
+		   "                           images in DIR\n");
+#endif
+	putchar('\n');
 }
 
-static void *
-hsqsfuse_init(struct fuse_conn_info *conn, struct fuse_config *cfg) {
-	(void)conn;
-	(void)cfg;
-	int rv = 0;
-	struct fuse_context *context = fuse_get_context();
+static int
+hsqsfuse_errno(int rv) {
+	switch (-rv) {
+	case HSQS_ERROR_NO_SUCH_FILE:
+		return ENOENT;
+	case HSQS_ERROR_NOT_A_DIRECTORY:
+		return ENOTDIR;
+	case HSQS_ERROR_MALLOC_FAILED:
+		return ENOMEM;
+	default:
+		return EIO;
+	}
+}
 
-	rv = hsqs_open(&data.hsqs, options.image_path);
-	if (rv < 0) {
-		hsqs_perror(rv, options.image_path);
-		fuse_unmount(context->fuse);
-		exit(EXIT_FAILURE);
+// FUSE node ids are inode refs shifted past FUSE_ROOT_ID, which is reserved
+// for the root directory. This needs no export table.
+static uint64_t
+hsqsfuse_node_to_ref(fuse_ino_t node) {
+	if (node == FUSE_ROOT_ID) {
+		return hsqs_superblock_inode_root_ref(hsqs_superblock(&data.hsqs));
 	}
+	return node - 2;
+}
 
-	return NULL;
+static fuse_ino_t
+hsqsfuse_ref_to_node(uint64_t ref) {
+	if (ref == hsqs_superblock_inode_root_ref(hsqs_superblock(&data.hsqs))) {
+		return FUSE_ROOT_ID;
+	}
+	return ref + 2;
 }
 
 static int
-hsqsfuse_getattr(
-		const char *path, struct stat *stbuf, struct fuse_file_info *fi) {
-	(void)fi;
-	int rv = 0;
-	memset(stbuf, 0, sizeof(struct stat));
-
-	struct HsqsInodeContext inode = {0};
-	struct HsqsSuperblockContext *superblock = hsqs_superblock(&data.hsqs);
-
-	rv = hsqs_inode_load_by_path(&inode, &data.hsqs, path);
-	if (rv < 0) {
-		rv = -ENOENT;
-		goto out;
-	}
+hsqsfuse_inode_load(struct HsqsInodeContext *inode, fuse_ino_t node) {
+	return hsqs_inode_load_by_ref(
+			inode, &data.hsqs, hsqsfuse_node_to_ref(node));
+}
 
-	stbuf->st_ino = hsqs_inode_number(&inode);
-	stbuf->st_mode = hsqs_inode_permission(&inode);
-	stbuf->st_nlink = hsqs_inode_hard_link_count(&inode);
-	stbuf->st_uid = hsqs_inode_uid(&inode);
-	stbuf->st_gid = hsqs_inode_gid(&inode);
-	stbuf->st_rdev = hsqs_inode_device_id(&inode);
-	stbuf->st_size = hsqs_inode_file_size(&inode);
-	stbuf->st_blksize = hsqs_superblock_block_size(superblock);
-	stbuf->st_mtime = stbuf->st_ctime = stbuf->st_atime =
-			hsqs_inode_modified_time(&inode);
-	switch (hsqs_inode_type(&inode)) {
+static mode_t
+hsqsfuse_type_mode(enum HsqsInodeContextType type) {
+	switch (type) {
 	case HSQS_INODE_TYPE_DIRECTORY:
-		stbuf->st_mode |= S_IFDIR;
-		break;
+		return S_IFDIR;
 	case HSQS_INODE_TYPE_FILE:
-		stbuf->st_mode |= S_IFREG;
-		break;
+		return S_IFREG;
 	case HSQS_INODE_TYPE_SYMLINK:
-		stbuf->st_mode |= S_IFLNK;
-		break;
+		return S_IFLNK;
 	case HSQS_INODE_TYPE_BLOCK:
-		stbuf->st_mode |= S_IFBLK;
-		break;
+		return S_IFBLK;
 	case HSQS_INODE_TYPE_CHAR:
-		stbuf->st_mode |= S_IFCHR;
-		break;
+		return S_IFCHR;
 	case HSQS_INODE_TYPE_FIFO:
-		stbuf->st_mode |= S_IFIFO;
-		break;
+		return S_IFIFO;
 	case HSQS_INODE_TYPE_SOCKET:
-		stbuf->st_mode |= S_IFSOCK;
-		break;
+		return S_IFSOCK;
 	case HSQS_INODE_TYPE_UNKNOWN:
-		rv = -EIO;
+		break;
+	}
+	return 0;
+}
+
+static int
+hsqsfuse_fill_stat(struct HsqsInodeContext *inode, struct stat *stbuf) {
+	struct HsqsSuperblockContext *superblock = hsqs_superblock(&data.hsqs);
+	mode_t type = hsqsfuse_type_mode(hsqs_inode_type(inode));
+
+	if (type == 0) {
+		return -EIO;
+	}
+
+	memset(stbuf, 0, sizeof(struct stat));
+	stbuf->st_ino = hsqs_inode_number(inode);
+	stbuf->st_mode = hsqs_inode_permission(inode) | type;
+	stbuf->st_nlink = hsqs_inode_hard_link_count(inode);
+	stbuf->st_uid = hsqs_inode_uid(inode);
+	stbuf->st_gid = hsqs_inode_gid(inode);
+	stbuf->st_rdev = hsqs_inode_device_id(inode);
+	stbuf->st_size = hsqs_inode_file_size(inode);
+	stbuf->st_blksize = hsqs_superblock_block_size(superblock);
+	stbuf->st_mtime = stbuf->st_ctime = stbuf->st_atime =
+			hsqs_inode_modified_time(inode);
+	return 0;
+}
+
+static int
+hsqsfuse_fill_entry(
+		struct fuse_entry_param *entry, struct HsqsInodeContext *inode,
+		uint64_t inode_ref) {
+	memset(entry, 0, sizeof(struct fuse_entry_param));
+	entry->ino = hsqsfuse_ref_to_node(inode_ref);
+	entry->attr_timeout = HSQSFUSE_TIMEOUT;
+	entry->entry_timeout = HSQSFUSE_TIMEOUT;
+	return hsqsfuse_fill_stat(inode, &entry->attr);
+}
+
+static void
+hsqsfuse_lookup(fuse_req_t req, fuse_ino_t parent, const char *name) {
+	int rv = 0;
+	uint64_t inode_ref;
+	struct fuse_entry_param entry = {0};
+	struct HsqsNameIndexContext index = {0};
+	struct HsqsInodeContext inode = {0};
+
+	rv = hsqs_name_index_init(
+			&index, &data.hsqs, hsqsfuse_node_to_ref(parent));
+	if (rv < 0) {
+		fuse_reply_err(req, hsqsfuse_errno(rv));
 		goto out;
 	}
+	rv = hsqs_name_index_lookup(&index, name, strlen(name), &inode_ref, NULL);
+	if (rv == -HSQS_ERROR_NO_SUCH_FILE) {
+		// negative entry, cached by the kernel for entry_timeout
+		entry.entry_timeout = HSQSFUSE_TIMEOUT;
+		fuse_reply_entry(req, &entry);
+		goto out;
+	} else if (rv < 0) {
+		fuse_reply_err(req, hsqsfuse_errno(rv));
+		goto out;
+	}
+
+	rv = hsqs_inode_load_by_ref(&inode, &data.hsqs, inode_ref);
+	if (rv < 0) {
+		fuse_reply_err(req, hsqsfuse_errno(rv));
+		goto out;
+	}
+	rv = hsqsfuse_fill_entry(&entry, &inode, inode_ref);
+	if (rv < 0) {
+		fuse_reply_err(req, -rv);
+		goto out;
+	}
+	fuse_reply_entry(req, &entry);
+
 out:
 	hsqs_inode_cleanup(&inode);
-	return rv;
+	hsqs_name_index_cleanup(&index);
 }
 
-static int
+static void
+hsqsfuse_forget(fuse_req_t req, fuse_ino_t ino, uint64_t nlookup) {
+	(void)ino;
+	(void)nlookup;
+	// node ids are derived from inode refs and hold no state.
+	fuse_reply_none(req);
+}
+
+static void
+hsqsfuse_getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+	(void)fi;
+	int rv = 0;
+	struct stat stbuf;
+	struct HsqsInodeContext inode = {0};
+
+	rv = hsqsfuse_inode_load(&inode, ino);
+	if (rv < 0) {
+		fuse_reply_err(req, hsqsfuse_errno(rv));
+		goto out;
+	}
+	rv = hsqsfuse_fill_stat(&inode, &stbuf);
+	if (rv < 0) {
+		fuse_reply_err(req, -rv);
+		goto out;
+	}
+	fuse_reply_attr(req, &stbuf, HSQSFUSE_TIMEOUT);
+
+out:
+	hsqs_inode_cleanup(&inode);
+}
+
+static void
 hsqsfuse_getxattr(
-		const char *path, const char *name, char *value, size_t size) {
+		fuse_req_t req, fuse_ino_t ino, const char *name, size_t size) {
 	int rv = 0;
-	const char *value_ptr = NULL;
-	size_t value_size;
+	const char *value = NULL;
+	size_t value_size = 0;
 	struct HsqsInodeContext inode = {0};
 	struct HsqsXattrIterator iter = {0};
 
-	rv = hsqs_inode_load_by_path(&inode, &data.hsqs, path);
+	rv = hsqsfuse_inode_load(&inode, ino);
 	if (rv < 0) {
-		rv = -ENOENT;
+		fuse_reply_err(req, hsqsfuse_errno(rv));
 		goto out;
 	}
 
@@ -161,249 +299,470 @@ hsqsfuse_getxattr(
 	if (rv < 0) {
 		// TODO: this means that the archive is corrupt, not that it has no
 		// xattrs. Handle the error accordingly.
-		rv = -ENODATA;
+		fuse_reply_err(req, ENODATA);
 		goto out;
 	}
 
-	while (value_ptr == NULL && (rv = hsqs_xattr_iterator_next(&iter)) > 0) {
+	while (value == NULL && (rv = hsqs_xattr_iterator_next(&iter)) > 0) {
 		if (hsqs_xattr_iterator_fullname_cmp(&iter, name) == 0) {
-			value_ptr = hsqs_xattr_iterator_value(&iter);
+			value = hsqs_xattr_iterator_value(&iter);
 			value_size = hsqs_xattr_iterator_value_size(&iter);
 		}
 	}
 	if (rv < 0) {
-		rv = -EINVAL;
-		goto out;
-	} else if (value_ptr == NULL) {
-		rv = -ENODATA;
-		goto out;
-	} else if (value_size <= size) {
-		value_ptr = hsqs_xattr_iterator_value(&iter);
-		memcpy(value, value_ptr, value_size);
-	} else if (size != 0) {
-		rv = -ERANGE;
-		goto out;
+		fuse_reply_err(req, EINVAL);
+	} else if (value == NULL) {
+		fuse_reply_err(req, ENODATA);
+	} else if (size == 0) {
+		fuse_reply_xattr(req, value_size);
+	} else if (value_size > size) {
+		fuse_reply_err(req, ERANGE);
+	} else {
+		fuse_reply_buf(req, value, value_size);
 	}
 
-	rv = value_size;
 out:
 	hsqs_xattr_iterator_cleanup(&iter);
 	hsqs_inode_cleanup(&inode);
-	return rv;
 }
-static int
-hsqsfuse_listxattr(const char *path, char *list, size_t size) {
+
+static void
+hsqsfuse_listxattr(fuse_req_t req, fuse_ino_t ino, size_t size) {
 	int rv = 0;
-	size_t element_length, length;
+	size_t prefix_size, name_size, length = 0;
 	const char *prefix, *name;
-	char *p;
+	char *list = NULL;
 	struct HsqsInodeContext inode = {0};
 	struct HsqsXattrIterator iter = {0};
-	rv = hsqs_inode_load_by_path(&inode, &data.hsqs, path);
+
+	rv = hsqsfuse_inode_load(&inode, ino);
 	if (rv < 0) {
-		rv = -ENOENT;
+		fuse_reply_err(req, hsqsfuse_errno(rv));
 		goto out;
 	}
 
 	rv = hsqs_inode_xattr_iterator(&inode, &iter);
 	if (rv < 0) {
-		rv = -EINVAL; // TODO: find correct error code for this.
+		fuse_reply_err(req, EINVAL); // TODO: find correct error code for this.
 		goto out;
 	}
 
-	p = list;
-	length = 0;
-	while ((rv = hsqs_xattr_iterator_next(&iter)) > 0) {
-		prefix = hsqs_xattr_iterator_prefix(&iter);
-		if (prefix == NULL) {
-			rv = -EINVAL; // TODO: find correct error code for this.
+	if (size != 0) {
+		list = calloc(size, sizeof(char));
+		if (list == NULL) {
+			fuse_reply_err(req, ENOMEM);
 			goto out;
 		}
-		element_length = hsqs_xattr_iterator_prefix_size(&iter);
-		length += element_length;
-		if (length < size) {
-			strcpy(p, prefix);
-			p = &list[length];
-		}
+	}
 
+	while ((rv = hsqs_xattr_iterator_next(&iter)) > 0) {
+		prefix = hsqs_xattr_iterator_prefix(&iter);
 		name = hsqs_xattr_iterator_name(&iter);
-		if (name == NULL) {
+		if (prefix == NULL || name == NULL) {
 			rv = -EINVAL; // TODO: find correct error code for this.
-			goto out;
+			break;
 		}
-		element_length = hsqs_xattr_iterator_name_size(&iter);
-		length += element_length;
-		if (length + 1 < size) {
-			strcpy(p, name);
-			p[element_length] = '\0';
-			length++;
-			p = &list[length];
+		prefix_size = hsqs_xattr_iterator_prefix_size(&iter);
+		name_size = hsqs_xattr_iterator_name_size(&iter);
+		if (list != NULL && length + prefix_size + name_size + 1 <= size) {
+			memcpy(&list[length], prefix, prefix_size);
+			memcpy(&list[length + prefix_size], name, name_size);
+			list[length + prefix_size + name_size] = '\0';
 		}
+		length += prefix_size + name_size + 1;
 	}
 	if (rv < 0) {
-		rv = -EINVAL;
-		goto out;
+		fuse_reply_err(req, EINVAL);
+	} else if (size == 0) {
+		fuse_reply_xattr(req, length);
+	} else if (length > size) {
+		fuse_reply_err(req, ERANGE);
+	} else {
+		fuse_reply_buf(req, list, length);
 	}
 
-	rv = length;
-
 out:
+	free(list);
 	hsqs_xattr_iterator_cleanup(&iter);
 	hsqs_inode_cleanup(&inode);
-	return rv;
 }
 
-static int
-hsqsfuse_readdir(
-		const char *path, void *buf, fuse_fill_dir_t filler, off_t offset,
-		struct fuse_file_info *fi, enum fuse_readdir_flags flags) {
-	(void)fi; // TODO
-	(void)offset; // TODO
-	(void)flags; // TODO
+static void
+hsqsfuse_opendir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
 	int rv = 0;
-	struct HsqsInodeContext inode = {0};
-	struct HsqsDirectoryIterator iter = {0};
-	rv = hsqs_inode_load_by_path(&inode, &data.hsqs, path);
+	struct HsqsfuseDirectory *directory = NULL;
+
+	directory = calloc(1, sizeof(struct HsqsfuseDirectory));
+	if (directory == NULL) {
+		fuse_reply_err(req, ENOMEM);
+		goto out;
+	}
+	rv = hsqsfuse_inode_load(&directory->inode, ino);
 	if (rv < 0) {
-		rv = -ENOENT;
+		fuse_reply_err(req, hsqsfuse_errno(rv));
 		goto out;
 	}
-	rv = hsqs_directory_iterator_init(&iter, &inode);
+	rv = hsqs_directory_iterator_init(&directory->iterator, &directory->inode);
 	if (rv < 0) {
-		rv = -ENOMEM;
+		fuse_reply_err(req, hsqsfuse_errno(rv));
 		goto out;
 	}
+	// "." and ".." take the offsets 0 and 1.
+	directory->offset = 2;
 
-	filler(buf, ".", NULL, 0, 0);
-	filler(buf, "..", NULL, 0, 0);
+	fi->fh = (uintptr_t)directory;
+	fi->keep_cache = 1;
+	if (fuse_reply_open(req, fi) == 0) {
+		directory = NULL;
+	}
 
-	while (hsqs_directory_iterator_next(&iter) > 0) {
-		char *name;
-		rv = hsqs_directory_iterator_name_dup(&iter, &name);
+out:
+	if (directory != NULL) {
+		hsqs_directory_iterator_cleanup(&directory->iterator);
+		hsqs_inode_cleanup(&directory->inode);
+		free(directory);
+	}
+}
+
+static size_t
+hsqsfuse_add_dot(
+		fuse_req_t req, struct HsqsfuseDirectory *directory, char *buf,
+		size_t size, const char *name, off_t next_offset, bool plus) {
+	struct fuse_entry_param entry = {0};
+
+	// The kernel does not look up "." and "..", so only the attributes used
+	// for d_ino and d_type are filled.
+	entry.attr.st_mode = S_IFDIR;
+	entry.attr.st_ino = next_offset == 1
+			? hsqs_inode_number(&directory->inode)
+			: HSQSFUSE_UNKNOWN_INO;
+	if (plus) {
+		return fuse_add_direntry_plus(
+				req, buf, size, name, &entry, next_offset);
+	} else {
+		return fuse_add_direntry(
+				req, buf, size, name, &entry.attr, next_offset);
+	}
+}
+
+static int
+hsqsfuse_add_entry(
+		fuse_req_t req, struct HsqsfuseDirectory *directory, char *buf,
+		size_t size, off_t next_offset, bool plus, size_t *entry_size) {
+	int rv = 0;
+	char *name = NULL;
+	uint64_t inode_ref;
+	struct fuse_entry_param entry = {0};
+	struct HsqsInodeContext inode = {0};
+	struct HsqsDirectoryIterator *iterator = &directory->iterator;
+
+	rv = hsqs_directory_iterator_name_dup(iterator, &name);
+	if (rv < 0) {
+		goto out;
+	}
+
+	if (plus) {
+		inode_ref = hsqs_directory_iterator_inode_ref(iterator);
+		rv = hsqs_inode_load_by_ref(&inode, &data.hsqs, inode_ref);
 		if (rv < 0) {
-			rv = -ENOMEM;
 			goto out;
 		}
-		rv = filler(buf, name, NULL, 0, 0);
+		rv = hsqsfuse_fill_entry(&entry, &inode, inode_ref);
 		if (rv < 0) {
-			rv = -ENOMEM;
 			goto out;
 		}
-		free(name);
+		*entry_size = fuse_add_direntry_plus(
+				req, buf, size, name, &entry, next_offset);
+	} else {
+		entry.attr.st_ino = HSQSFUSE_UNKNOWN_INO;
+		entry.attr.st_mode = hsqsfuse_type_mode(
+				hsqs_directory_iterator_inode_type(iterator));
+		*entry_size = fuse_add_direntry(
+				req, buf, size, name, &entry.attr, next_offset);
 	}
 
 out:
-	hsqs_directory_iterator_cleanup(&iter);
 	hsqs_inode_cleanup(&inode);
+	free(name);
 	return rv;
 }
 
-static int
-hsqsfuse_open(const char *path, struct fuse_file_info *fi) {
+static void
+hsqsfuse_readdir_common(
+		fuse_req_t req, size_t size, off_t offset, struct fuse_file_info *fi,
+		bool plus) {
 	int rv = 0;
-	struct HsqsInodeContext inode = {0};
-
-	rv = hsqs_inode_load_by_path(&inode, &data.hsqs, path);
-	if (rv < 0) {
-		rv = -ENOENT;
+	size_t used = 0, entry_size = 0;
+	char *buf = NULL;
+	struct HsqsfuseDirectory *directory =
+			(struct HsqsfuseDirectory *)(uintptr_t)fi->fh;
+	struct HsqsDirectoryIterator *iterator = &directory->iterator;
+
+	buf = calloc(size, sizeof(char));
+	if (buf == NULL) {
+		fuse_reply_err(req, ENOMEM);
 		goto out;
 	}
-	if ((fi->flags & O_ACCMODE) != O_RDONLY) {
-		rv = -EACCES;
-		goto out;
+
+	if (offset == 0) {
+		entry_size =
+				hsqsfuse_add_dot(req, directory, buf, size, ".", 1, plus);
+		if (entry_size > size) {
+			goto reply;
+		}
+		used += entry_size;
+		offset = 1;
+	}
+	if (offset == 1) {
+		entry_size = hsqsfuse_add_dot(
+				req, directory, &buf[used], size - used, "..", 2, plus);
+		if (entry_size > size - used) {
+			goto reply;
+		}
+		used += entry_size;
+		offset = 2;
+	}
+
+	// Sequential reads continue where the previous call stopped. Seeking
+	// backwards restarts the iterator.
+	if (directory->offset > offset) {
+		hsqs_directory_iterator_cleanup(iterator);
+		rv = hsqs_directory_iterator_init(iterator, &directory->inode);
+		if (rv < 0) {
+			goto out;
+		}
+		directory->offset = 2;
+		directory->pending = false;
+	}
+
+	for (;;) {
+		if (directory->pending == false) {
+			rv = hsqs_directory_iterator_next(iterator);
+			if (rv < 0) {
+				goto out;
+			} else if (rv == 0) {
+				break;
+			}
+			directory->pending = true;
+		}
+		if (directory->offset < offset) {
+			directory->offset++;
+			directory->pending = false;
+			continue;
+		}
+
+		rv = hsqsfuse_add_entry(
+				req, directory, &buf[used], size - used, offset + 1, plus,
+				&entry_size);
+		if (rv < 0) {
+			goto out;
+		}
+		if (entry_size > size - used) {
+			break;
+		}
+		used += entry_size;
+		offset++;
+		directory->offset++;
+		directory->pending = false;
 	}
 
+reply:
+	rv = 0;
+	fuse_reply_buf(req, buf, used);
 out:
-	hsqs_inode_cleanup(&inode);
-	return rv;
+	if (rv < 0) {
+		fuse_reply_err(req, hsqsfuse_errno(rv));
+	}
+	free(buf);
 }
 
-static int
-hsqsfuse_read(
-		const char *path, char *buf, size_t size, off_t offset,
+static void
+hsqsfuse_readdir(
+		fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset,
 		struct fuse_file_info *fi) {
-	(void)fi;
+	(void)ino;
+	hsqsfuse_readdir_common(req, size, offset, fi, false);
+}
+
+static void
+hsqsfuse_readdirplus(
+		fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset,
+		struct fuse_file_info *fi) {
+	(void)ino;
+	hsqsfuse_readdir_common(req, size, offset, fi, true);
+}
+
+static void
+hsqsfuse_releasedir(
+		fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+	(void)ino;
+	struct HsqsfuseDirectory *directory =
+			(struct HsqsfuseDirectory *)(uintptr_t)fi->fh;
+
+	hsqs_directory_iterator_cleanup(&directory->iterator);
+	hsqs_inode_cleanup(&directory->inode);
+	free(directory);
+	fuse_reply_err(req, 0);
+}
+
+static void
+hsqsfuse_file_free(struct HsqsfuseFile *file) {
+	hsqs_content_cleanup(&file->content);
+	hsqs_inode_cleanup(&file->inode);
+	pthread_mutex_destroy(&file->lock);
+	free(file);
+}
+
+static void
+hsqsfuse_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
 	int rv = 0;
-	struct HsqsInodeContext inode = {0};
-	struct HsqsFileContext file = {0};
+	struct HsqsfuseFile *file = NULL;
+
+	if ((fi->flags & O_ACCMODE) != O_RDONLY) {
+		fuse_reply_err(req, EACCES);
+		goto out;
+	}
 
-	rv = hsqs_inode_load_by_path(&inode, &data.hsqs, path);
+	file = calloc(1, sizeof(struct HsqsfuseFile));
+	if (file == NULL) {
+		fuse_reply_err(req, ENOMEM);
+		goto out;
+	}
+	if (pthread_mutex_init(&file->lock, NULL) != 0) {
+		free(file);
+		file = NULL;
+		fuse_reply_err(req, ENOMEM);
+		goto out;
+	}
+	rv = hsqsfuse_inode_load(&file->inode, ino);
 	if (rv < 0) {
-		// TODO: Better return type
-		rv = -EINVAL;
+		fuse_reply_err(req, hsqsfuse_errno(rv));
 		goto out;
 	}
-	rv = hsqs_content_init(&file, &inode);
+	rv = hsqs_content_init(&file->content, &file->inode);
 	if (rv < 0) {
-		// TODO: Better return type
-		rv = -EINVAL;
+		fuse_reply_err(req, hsqsfuse_errno(rv));
 		goto out;
 	}
 
-	size = MIN(size, hsqs_inode_file_size(&inode));
-	rv = hsqs_content_seek(&file, offset);
+	fi->fh = (uintptr_t)file;
+	fi->keep_cache = 1;
+	if (fuse_reply_open(req, fi) == 0) {
+		file = NULL;
+	}
+
+out:
+	if (file != NULL) {
+		hsqsfuse_file_free(file);
+	}
+}
+
+// Grows the read ahead window while the kernel reads sequentially and drops
+// it on the first random access.
+static void
+hsqsfuse_file_read_ahead(
+		struct HsqsfuseFile *file, off_t offset, size_t size) {
+	if ((uint64_t)offset != file->next_offset) {
+		file->read_ahead = 0;
+	} else if (file->read_ahead == 0) {
+		file->read_ahead = 1;
+	} else {
+		file->read_ahead =
+				MIN(file->read_ahead * 2, HSQSFUSE_READ_AHEAD_MAX);
+	}
+	file->next_offset = offset + size;
+	hsqs_content_set_read_ahead(&file->content, file->read_ahead);
+}
+
+static void
+hsqsfuse_read(
+		fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset,
+		struct fuse_file_info *fi) {
+	(void)ino;
+	int rv = 0;
+	uint64_t file_size;
+	struct HsqsfuseFile *file = (struct HsqsfuseFile *)(uintptr_t)fi->fh;
+
+	file_size = hsqs_inode_file_size(&file->inode);
+	if ((uint64_t)offset >= file_size) {
+		fuse_reply_buf(req, NULL, 0);
+		return;
+	}
+	size = MIN(size, file_size - offset);
+
+	// The kernel may issue concurrent reads on one handle.
+	pthread_mutex_lock(&file->lock);
+	hsqsfuse_file_read_ahead(file, offset, size);
+	rv = hsqs_content_seek(&file->content, offset);
 	if (rv < 0) {
-		// TODO: Better return type
-		rv = -EINVAL;
 		goto out;
 	}
-	rv = hsqs_content_read(&file, size);
+	rv = hsqs_content_read(&file->content, size);
 	if (rv < 0) {
-		// TODO: Better return type
-		rv = -EINVAL;
 		goto out;
 	}
 
-	if (size != 0) {
-		memcpy(buf, hsqs_content_data(&file), size);
-	}
+	fuse_reply_buf(
+			req, (const char *)hsqs_content_data(&file->content), size);
 
-	rv = size;
 out:
-	hsqs_content_cleanup(&file);
-	hsqs_inode_cleanup(&inode);
-	return rv;
+	pthread_mutex_unlock(&file->lock);
+	if (rv < 0) {
+		fuse_reply_err(req, hsqsfuse_errno(rv));
+	}
 }
 
-static int
-hsqsfuse_readlink(const char *path, char *buf, size_t size) {
+static void
+hsqsfuse_release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+	(void)ino;
+
+	hsqsfuse_file_free((struct HsqsfuseFile *)(uintptr_t)fi->fh);
+	fuse_reply_err(req, 0);
+}
+
+static void
+hsqsfuse_readlink(fuse_req_t req, fuse_ino_t ino) {
 	int rv = 0;
+	char *symlink = NULL;
 	struct HsqsInodeContext inode = {0};
 
-	rv = hsqs_inode_load_by_path(&inode, &data.hsqs, path);
+	rv = hsqsfuse_inode_load(&inode, ino);
+	if (rv < 0) {
+		goto out;
+	}
+	if (hsqs_inode_type(&inode) != HSQS_INODE_TYPE_SYMLINK) {
+		fuse_reply_err(req, EINVAL);
+		goto out;
+	}
+	rv = hsqs_inode_symlink_dup(&inode, &symlink);
 	if (rv < 0) {
-		rv = -ENOENT;
 		goto out;
 	}
 
-	const char *symlink = hsqs_inode_symlink(&inode);
-	size_t symlink_size = hsqs_inode_symlink_size(&inode);
-	size_t cpy_size = MIN(symlink_size, size - 1);
-
-	memcpy(buf, symlink, cpy_size);
-	buf[cpy_size] = 0;
+	fuse_reply_readlink(req, symlink);
 
 out:
+	if (rv < 0) {
+		fuse_reply_err(req, hsqsfuse_errno(rv));
+	}
+	free(symlink);
 	hsqs_inode_cleanup(&inode);
-	return rv;
 }
 
-static void
-hsqsfuse_destroy(void *private_data) {
-	(void)private_data;
-	hsqs_cleanup(&data.hsqs);
-}
-
-static const struct fuse_operations hsqsfuse_operations = {
-		.init = hsqsfuse_init,
+static const struct fuse_lowlevel_ops hsqsfuse_operations = {
+		.lookup = hsqsfuse_lookup,
+		.forget = hsqsfuse_forget,
 		.getattr = hsqsfuse_getattr,
 		.getxattr = hsqsfuse_getxattr,
 		.listxattr = hsqsfuse_listxattr,
+		.opendir = hsqsfuse_opendir,
 		.readdir = hsqsfuse_readdir,
+		.readdirplus = hsqsfuse_readdirplus,
+		.releasedir = hsqsfuse_releasedir,
 		.open = hsqsfuse_open,
 		.read = hsqsfuse_read,
+		.release = hsqsfuse_release,
 		.readlink = hsqsfuse_readlink,
-		.destroy = hsqsfuse_destroy,
 };
 
 static int
@@ -418,24 +777,115 @@ hsqsfuse_process_options(
 	return 1;
 }
 
+static int
+hsqsfuse_loop(
+		struct fuse_session *session,
+		const struct fuse_cmdline_opts *fuse_options) {
+	int rv = 0;
+	struct fuse_loop_config *config;
+
+	if (fuse_options->singlethread) {
+		return fuse_session_loop(session);
+	}
+
+	config = fuse_loop_cfg_create();
+	if (config == NULL) {
+		return -ENOMEM;
+	}
+	fuse_loop_cfg_set_clone_fd(config, fuse_options->clone_fd);
+	fuse_loop_cfg_set_idle_threads(config, fuse_options->max_idle_threads);
+	fuse_loop_cfg_set_max_threads(config, options.workers);
+
+	rv = fuse_session_loop_mt(session, config);
+
+	fuse_loop_cfg_destroy(config);
+	return rv;
+}
+
 int
 main(int argc, char *argv[]) {
 	struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
-	int rv = 0;
+	struct fuse_cmdline_opts fuse_options = {0};
+	struct fuse_session *session = NULL;
+	struct HsqsOptions hsqs_options = {0};
+	bool opened = false, mounted = false, signals = false;
+	int rv = EXIT_FAILURE;
+
 	if (fuse_opt_parse(
 				&args, &options, option_spec, hsqsfuse_process_options) == -1) {
-		rv = EXIT_FAILURE;
+		goto out;
+	}
+	if (fuse_parse_cmdline(&args, &fuse_options) != 0) {
 		goto out;
 	}
 
 	if (options.show_help) {
 		help(argv[0]);
-		fuse_opt_add_arg(&args, "--help");
-		args.argv[0][0] = '\0';
+		fuse_cmdline_help();
+		fuse_lowlevel_help();
+		rv = EXIT_SUCCESS;
+		goto out;
+	}
+	if (options.image_path == NULL || fuse_options.mountpoint == NULL) {
+		help(argv[0]);
+		goto out;
+	}
+	if (options.workers == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		options.workers = cpus > 0 ? cpus : 1;
+	}
+
+	// The same number of threads prefetches data blocks of files that are
+	// read sequentially.
+	hsqs_options.worker_count = options.workers;
+	hsqs_options.curl_handles = options.connections;
+	hsqs_options.curl_chunk_size = options.chunk_size;
+	hsqs_options.curl_cache_dir = options.cache_dir;
+	rv = hsqs_open_any_ex(&data.hsqs, options.image_path, &hsqs_options);
+	if (rv < 0) {
+		hsqs_perror(rv, options.image_path);
+		rv = EXIT_FAILURE;
+		goto out;
+	}
+	opened = true;
+	rv = EXIT_FAILURE;
+
+	session = fuse_session_new(
+			&args, &hsqsfuse_operations, sizeof(hsqsfuse_operations), &data);
+	if (session == NULL) {
+		goto out;
+	}
+	if (fuse_set_signal_handlers(session) != 0) {
+		goto out;
+	}
+	signals = true;
+	if (fuse_session_mount(session, fuse_options.mountpoint) != 0) {
+		goto out;
+	}
+	mounted = true;
+	if (fuse_daemonize(fuse_options.foreground) != 0) {
+		goto out;
+	}
+
+	if (hsqsfuse_loop(session, &fuse_options) == 0) {
+		rv = EXIT_SUCCESS;
 	}
 
-	rv = fuse_main(args.argc, args.argv, &hsqsfuse_operations, &data);
 out:
+	if (mounted) {
+		fuse_session_unmount(session);
+	}
+	if (signals) {
+		fuse_remove_signal_handlers(session);
+	}
+	if (session != NULL) {
+		fuse_session_destroy(session);
+	}
+	if (opened) {
+		hsqs_cleanup(&data.hsqs);
+	}
+	free(fuse_options.mountpoint);
+	free(options.cache_dir);
 	fuse_opt_free_args(&args);
 	return rv;
 }
@@ -0,0 +1,151 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright (c) 2022, Enno Boland <g@s01.de>                                 *
+ *                                                                            *
+ * Redistribution and use in source and binary forms, with or without         *
+ * modification, are permitted provided that the following conditions are     *
+ * met:                                                                       *
+ *                                                                            *
+ * * Redistributions of source code must retain the above copyright notice,   *
+ *   this list of conditions and the following disclaimer.                    *
+ * * Redistributions in binary form must reproduce the above copyright        *
+ *   notice, this list of conditions and the following disclaimer in the      *
+ *   documentation and/or other materials provided with the distribution.     *
+ *                                                                            *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS    *
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,  *
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR     *
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR          *
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,      *
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,        *
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR         *
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF     *
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING       *
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS         *
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.               *
+ *                                                                            *
+ ******************************************************************************/
+
+
+/**
+ * @author       Enno Boland (mail@eboland.de)
+ * @file         compression.c
+ */
+
+#include "compression.h"
+#include "../error.h"
+#include "../utils.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+// Maximum number of compressors a single thread can hold a decoder
+// state for.
+#define HSQS_COMPRESSION_CONTEXT_SLOTS 8
+
+struct HsqsCompressionContext {
+	const struct HsqsCompressionImplementation *impl;
+	void *context;
+};
+
+static pthread_key_t context_key;
+static pthread_once_t context_key_once = PTHREAD_ONCE_INIT;
+static int context_key_rv = 0;
+
+static void
+contexts_dtor(void *data) {
+	struct HsqsCompressionContext *contexts = data;
+
+	for (hsqs_index_t i = 0; i < HSQS_COMPRESSION_CONTEXT_SLOTS; i++) {
+		if (contexts[i].impl != NULL && contexts[i].impl->cleanup != NULL) {
+			contexts[i].impl->cleanup(contexts[i].context);
+		}
+	}
+	free(contexts);
+}
+
+static void
+create_context_key(void) {
+	if (pthread_key_create(&context_key, contexts_dtor) != 0) {
+		context_key_rv = -HSQS_ERROR_COMPRESSION_INIT;
+	}
+}
+
+static int
+thread_context(
+		const struct HsqsCompressionImplementation *impl, void **context) {
+	int rv = 0;
+	struct HsqsCompressionContext *contexts;
+	hsqs_index_t i;
+
+	*context = NULL;
+	if (impl->init == NULL) {
+		return 0;
+	}
+
+	pthread_once(&context_key_once, create_context_key);
+	if (context_key_rv < 0) {
+		return context_key_rv;
+	}
+
+	contexts = pthread_getspecific(context_key);
+	if (contexts == NULL) {
+		contexts = calloc(
+				HSQS_COMPRESSION_CONTEXT_SLOTS,
+				sizeof(struct HsqsCompressionContext));
+		if (contexts == NULL) {
+			return -HSQS_ERROR_MALLOC_FAILED;
+		}
+		if (pthread_setspecific(context_key, contexts) != 0) {
+			free(contexts);
+			return -HSQS_ERROR_COMPRESSION_INIT;
+		}
+	}
+
+	for (i = 0; i < HSQS_COMPRESSION_CONTEXT_SLOTS; i++) {
+		if (contexts[i].impl == impl) {
+			*context = contexts[i].context;
+			return 0;
+		} else if (contexts[i].impl == NULL) {
+			break;
+		}
+	}
+	if (i == HSQS_COMPRESSION_CONTEXT_SLOTS) {
+		return -HSQS_ERROR_COMPRESSION_INIT;
+	}
+
+	rv = impl->init(&contexts[i].context);
+	if (rv < 0) {
+		return rv;
+	}
+	contexts[i].impl = impl;
+	*context = contexts[i].context;
+
+	return rv;
+}
+
+int
+hsqs_compression_extract(
+		const struct HsqsCompressionImplementation *impl,
+		const union HsqsCompressionOptions *options, size_t options_size,
+		uint8_t *target, size_t *target_size, const uint8_t *compressed,
+		const size_t compressed_size) {
+	int rv = 0;
+	void *context;
+
+	rv = thread_context(impl, &context);
+	if (rv < 0) {
+		return rv;
+	}
+
+	if (impl->reset != NULL) {
+		rv = impl->reset(context, options, options_size);
+		if (rv < 0) {
+			return rv;
+		}
+	}
+
+	return impl->extract(
+			context, options, options_size, target, target_size, compressed,
+			compressed_size);
+}
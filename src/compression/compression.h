@@ -41,10 +41,27 @@
 union HsqsCompressionOptions;
 
 struct HsqsCompressionImplementation {
+	// Optional. Creates the decoder state that is reused for every block
+	// extracted by the same thread.
+	int (*init)(void **context);
+	// Optional. Prepares the decoder state for the next block. The
+	// options of an archive rarely change, so implementations only need
+	// to reconfigure the decoder when they differ from the last call.
+	int (*reset)(
+			void *context, const union HsqsCompressionOptions *options,
+			size_t options_size);
+	// Optional. Frees the decoder state when its thread exits.
+	int (*cleanup)(void *context);
 	int (*extract)(
-			const union HsqsCompressionOptions *options, size_t options_size,
-			uint8_t *target, size_t *target_size, const uint8_t *compressed,
-			const size_t compressed_size);
+			void *context, const union HsqsCompressionOptions *options,
+			size_t options_size, uint8_t *target, size_t *target_size,
+			const uint8_t *compressed, const size_t compressed_size);
 };
 
+int hsqs_compression_extract(
+		const struct HsqsCompressionImplementation *impl,
+		const union HsqsCompressionOptions *options, size_t options_size,
+		uint8_t *target, size_t *target_size, const uint8_t *compressed,
+		const size_t compressed_size);
+
 #endif /* end of include guard COMPRESSION_H */
@@ -41,13 +41,20 @@
 #include "../error.h"
 #include "compression.h"
 
+#define HSQS_LZ4_LEGACY_VERSION 1
+
 static int
 hsqs_lz4_extract(
-		const union HsqsCompressionOptions *options, size_t options_size,
-		uint8_t *target, size_t *target_size, const uint8_t *compressed,
-		const size_t compressed_size) {
+		void *context, const union HsqsCompressionOptions *options,
+		size_t options_size, uint8_t *target, size_t *target_size,
+		const uint8_t *compressed, const size_t compressed_size) {
+	(void)context;
+	// Blocks written with LZ4_HC use the same format, so only the format
+	// version has to be checked.
 	if (options != NULL &&
-		options_size != HSQS_SIZEOF_COMPRESSION_OPTIONS_LZ4) {
+		(options_size != HSQS_SIZEOF_COMPRESSION_OPTIONS_LZ4 ||
+		 hsqs_compression_options_lz4_version(options) !=
+				 HSQS_LZ4_LEGACY_VERSION)) {
 		return -HSQS_ERROR_COMPRESSION_DECOMPRESS;
 	}
 
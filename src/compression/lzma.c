@@ -42,46 +42,70 @@
 #include "../error.h"
 #include "compression.h"
 
+static int
+hsqs_lzma_init(void **context) {
+	lzma_stream *stream = malloc(sizeof(lzma_stream));
+	if (stream == NULL) {
+		return -HSQS_ERROR_MALLOC_FAILED;
+	}
+	*stream = (lzma_stream)LZMA_STREAM_INIT;
+	*context = stream;
+	return 0;
+}
+
+static int
+hsqs_lzma_reset(
+		void *context, const union HsqsCompressionOptions *options,
+		size_t options_size) {
+	(void)options;
+	(void)options_size;
+
+	// Re-initializing the decoder on the same stream reuses the memory
+	// allocated for the previous block.
+	if (lzma_alone_decoder(context, UINT64_MAX) != LZMA_OK) {
+		return -HSQS_ERROR_COMPRESSION_INIT;
+	}
+	return 0;
+}
+
+static int
+hsqs_lzma_cleanup(void *context) {
+	lzma_end(context);
+	free(context);
+	return 0;
+}
+
 static int
 hsqs_lzma_extract(
-		const union HsqsCompressionOptions *options, size_t options_size,
-		uint8_t *target, size_t *target_size, const uint8_t *compressed,
-		const size_t compressed_size) {
+		void *context, const union HsqsCompressionOptions *options,
+		size_t options_size, uint8_t *target, size_t *target_size,
+		const uint8_t *compressed, const size_t compressed_size) {
+	lzma_stream *stream = context;
+	lzma_ret ret;
 	// LZMA has no compression options
 	if (options != NULL || options_size != 0) {
 		// TODO: More specific error code
 		return -HSQS_ERROR_COMPRESSION_DECOMPRESS;
 	}
-	lzma_ret rv = LZMA_OK;
-
-	lzma_stream strm = LZMA_STREAM_INIT;
-
-	rv = lzma_alone_decoder(&strm, UINT64_MAX);
-	if (rv != LZMA_OK) {
-		lzma_end(&strm);
-		return -HSQS_ERROR_COMPRESSION_DECOMPRESS;
-	}
-
-	lzma_action action = LZMA_RUN;
 
-	strm.next_in = compressed;
-	strm.avail_in = compressed_size;
+	stream->next_in = compressed;
+	stream->avail_in = compressed_size;
+	stream->next_out = target;
+	stream->avail_out = *target_size;
 
-	strm.next_out = target;
-	strm.avail_out = *target_size;
+	ret = lzma_code(stream, LZMA_FINISH);
 
-	action = LZMA_FINISH;
+	*target_size = *target_size - stream->avail_out;
 
-	if (lzma_code(&strm, action) != LZMA_OK) {
-		rv = -HSQS_ERROR_COMPRESSION_DECOMPRESS;
+	if (ret != LZMA_OK && ret != LZMA_STREAM_END) {
+		return -HSQS_ERROR_COMPRESSION_DECOMPRESS;
 	}
-
-	*target_size = strm.avail_out;
-	lzma_end(&strm);
-
-	return rv;
+	return 0;
 }
 
 const struct HsqsCompressionImplementation hsqs_compression_lzma = {
+		.init = hsqs_lzma_init,
+		.reset = hsqs_lzma_reset,
+		.cleanup = hsqs_lzma_cleanup,
 		.extract = hsqs_lzma_extract,
 };
@@ -45,9 +45,10 @@
 
 static int
 hsqs_lzo2_extract(
-		const union HsqsCompressionOptions *options, size_t options_size,
-		uint8_t *target, size_t *target_size, const uint8_t *compressed,
-		const size_t compressed_size) {
+		void *context, const union HsqsCompressionOptions *options,
+		size_t options_size, uint8_t *target, size_t *target_size,
+		const uint8_t *compressed, const size_t compressed_size) {
+	(void)context;
 	if (options != NULL &&
 		options_size != HSQS_SIZEOF_COMPRESSION_OPTIONS_LZO) {
 		return -HSQS_ERROR_COMPRESSION_DECOMPRESS;
@@ -42,9 +42,10 @@
 
 static int
 hsqs_null_extract(
-		const union HsqsCompressionOptions *options, size_t options_size,
-		uint8_t *target, size_t *target_size, const uint8_t *compressed,
-		const size_t compressed_size) {
+		void *context, const union HsqsCompressionOptions *options,
+		size_t options_size, uint8_t *target, size_t *target_size,
+		const uint8_t *compressed, const size_t compressed_size) {
+	(void)context;
 	// the null decompressor has no compression options
 	if (options != NULL || options_size != 0) {
 		// TODO: More specific error code
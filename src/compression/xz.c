@@ -42,35 +42,94 @@
 #include "../error.h"
 #include "compression.h"
 
+#define HSQS_XZ_MIN_DICTIONARY_SIZE 8192
+
+struct HsqsXzContext {
+	lzma_stream stream;
+	const union HsqsCompressionOptions *options;
+};
+
 static int
-hsqs_xz_extract(
-		const union HsqsCompressionOptions *options, size_t options_size,
-		uint8_t *target, size_t *target_size, const uint8_t *compressed,
-		const size_t compressed_size) {
-	int rv = 0;
-	size_t compressed_pos = 0;
-	size_t target_pos = 0;
-	uint64_t memlimit = UINT64_MAX;
-	if (options != NULL && options_size != HSQS_SIZEOF_COMPRESSION_OPTIONS_XZ) {
-		return -HSQS_ERROR_COMPRESSION_DECOMPRESS;
+hsqs_xz_init(void **context) {
+	struct HsqsXzContext *xz = malloc(sizeof(struct HsqsXzContext));
+	if (xz == NULL) {
+		return -HSQS_ERROR_MALLOC_FAILED;
+	}
+	xz->stream = (lzma_stream)LZMA_STREAM_INIT;
+	xz->options = NULL;
+	*context = xz;
+	return 0;
+}
+
+static int
+hsqs_xz_reset(
+		void *context, const union HsqsCompressionOptions *options,
+		size_t options_size) {
+	struct HsqsXzContext *xz = context;
+
+	// The filter chain is stored in every xz stream, so the options are
+	// only validated, and only when they differ from the previous block.
+	// The filter bits are not checked, newer mksquashfs versions add
+	// filters the stream decoder handles on its own.
+	if (options != NULL && options != xz->options) {
+		if (options_size != HSQS_SIZEOF_COMPRESSION_OPTIONS_XZ) {
+			return -HSQS_ERROR_COMPRESSION_INIT;
+		}
+		if (hsqs_compression_options_xz_dictionary_size(options) <
+			HSQS_XZ_MIN_DICTIONARY_SIZE) {
+			return -HSQS_ERROR_COMPRESSION_INIT;
+		}
 	}
+	xz->options = options;
+
+	// Re-initializing the decoder on the same stream reuses the memory
+	// allocated for the previous block.
+	if (lzma_stream_decoder(&xz->stream, UINT64_MAX, 0) != LZMA_OK) {
+		return -HSQS_ERROR_COMPRESSION_INIT;
+	}
+	return 0;
+}
+
+static int
+hsqs_xz_cleanup(void *context) {
+	struct HsqsXzContext *xz = context;
+	lzma_end(&xz->stream);
+	free(xz);
+	return 0;
+}
+
+static int
+hsqs_xz_extract(
+		void *context, const union HsqsCompressionOptions *options,
+		size_t options_size, uint8_t *target, size_t *target_size,
+		const uint8_t *compressed, const size_t compressed_size) {
+	lzma_stream *stream = &((struct HsqsXzContext *)context)->stream;
+	lzma_ret ret;
+	(void)options;
+	(void)options_size;
+
+	stream->next_in = compressed;
+	stream->avail_in = compressed_size;
+	stream->next_out = target;
+	stream->avail_out = *target_size;
 
-	rv = lzma_stream_buffer_decode(
-			&memlimit, 0, NULL, compressed, &compressed_pos, compressed_size,
-			target, &target_pos, *target_size);
+	ret = lzma_code(stream, LZMA_FINISH);
 
-	*target_size = target_pos;
+	*target_size = *target_size - stream->avail_out;
 
-	if (rv != LZMA_OK) {
+	if (ret != LZMA_STREAM_END) {
 		return -HSQS_ERROR_COMPRESSION_DECOMPRESS;
 	}
 
-	if (compressed_pos != compressed_size) {
+	if (stream->avail_in != 0) {
 		return -HSQS_ERROR_COMPRESSION_DECOMPRESS;
 	}
-	return rv;
+	return 0;
 }
 
 const struct HsqsCompressionImplementation hsqs_compression_xz = {
+		.init = hsqs_xz_init,
+		.reset = hsqs_xz_reset,
+		.cleanup = hsqs_xz_cleanup,
 		.extract = hsqs_xz_extract,
 };
@@ -31,6 +31,7 @@
  * @file         gzip.c
  */
 
+#include <limits.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -42,32 +43,100 @@
 #include "../error.h"
 #include "compression.h"
 
+#define HSQS_ZLIB_DEFAULT_WINDOW_BITS 15
+
+struct HsqsZlibContext {
+	z_stream stream;
+	int window_bits;
+};
+
 static int
-hsqs_zlib_extract(
-		const union HsqsCompressionOptions *options, size_t options_size,
-		uint8_t *target, size_t *target_size, const uint8_t *compressed,
-		const size_t compressed_size) {
-	// Needed for 32-bit: *target_size is a size_t, but zlib wants a
-	// pointer to an unsigned long.
-	uLongf long_target_size = *target_size;
-	if (options != NULL &&
-		options_size != HSQS_SIZEOF_COMPRESSION_OPTIONS_GZIP) {
-		return -HSQS_ERROR_COMPRESSION_DECOMPRESS;
+hsqs_zlib_init(void **context) {
+	struct HsqsZlibContext *zlib = calloc(1, sizeof(struct HsqsZlibContext));
+	if (zlib == NULL) {
+		return -HSQS_ERROR_MALLOC_FAILED;
+	}
+
+	zlib->window_bits = HSQS_ZLIB_DEFAULT_WINDOW_BITS;
+	if (inflateInit2(&zlib->stream, zlib->window_bits) != Z_OK) {
+		free(zlib);
+		return -HSQS_ERROR_COMPRESSION_INIT;
 	}
+	*context = zlib;
+	return 0;
+}
 
-	int rv = uncompress(target, &long_target_size, compressed, compressed_size);
+static int
+hsqs_zlib_reset(
+		void *context, const union HsqsCompressionOptions *options,
+		size_t options_size) {
+	struct HsqsZlibContext *zlib = context;
+	int window_bits = HSQS_ZLIB_DEFAULT_WINDOW_BITS;
+	int rv;
 
-	// This casts to a smaller type. But it's safe, because long_target_size
-	// originates from a the content of *target_size and uncompress() only
-	// decreases it.
-	*target_size = long_target_size;
+	if (options != NULL) {
+		if (options_size != HSQS_SIZEOF_COMPRESSION_OPTIONS_GZIP) {
+			return -HSQS_ERROR_COMPRESSION_INIT;
+		}
+		window_bits = hsqs_compression_options_gzip_window_size(options);
+		if (window_bits < 8 || window_bits > 15) {
+			return -HSQS_ERROR_COMPRESSION_INIT;
+		}
+	}
 
+	// inflateReset2() reallocates the window only if its size changes.
+	if (window_bits == zlib->window_bits) {
+		rv = inflateReset(&zlib->stream);
+	} else {
+		rv = inflateReset2(&zlib->stream, window_bits);
+	}
 	if (rv != Z_OK) {
+		return -HSQS_ERROR_COMPRESSION_INIT;
+	}
+	zlib->window_bits = window_bits;
+	return 0;
+}
+
+static int
+hsqs_zlib_cleanup(void *context) {
+	struct HsqsZlibContext *zlib = context;
+	inflateEnd(&zlib->stream);
+	free(zlib);
+	return 0;
+}
+
+static int
+hsqs_zlib_extract(
+		void *context, const union HsqsCompressionOptions *options,
+		size_t options_size, uint8_t *target, size_t *target_size,
+		const uint8_t *compressed, const size_t compressed_size) {
+	z_stream *stream = &((struct HsqsZlibContext *)context)->stream;
+	(void)options;
+	(void)options_size;
+	if (compressed_size > UINT_MAX || *target_size > UINT_MAX) {
+		return -HSQS_ERROR_INTEGER_OVERFLOW;
+	}
+
+	// The stream is reused, so the window allocated by the first inflate()
+	// call is kept for all following blocks.
+	stream->next_in = (Bytef *)compressed;
+	stream->avail_in = compressed_size;
+	stream->next_out = target;
+	stream->avail_out = *target_size;
+
+	int rv = inflate(stream, Z_FINISH);
+
+	*target_size = stream->total_out;
+
+	if (rv != Z_STREAM_END) {
 		return -HSQS_ERROR_COMPRESSION_DECOMPRESS;
 	}
-	return rv;
+	return 0;
 }
 
 const struct HsqsCompressionImplementation hsqs_compression_zlib = {
+		.init = hsqs_zlib_init,
+		.reset = hsqs_zlib_reset,
+		.cleanup = hsqs_zlib_cleanup,
 		.extract = hsqs_zlib_extract,
 };
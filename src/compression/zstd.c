@@ -42,24 +42,44 @@
 #include "../error.h"
 #include "compression.h"
 
+static int
+hsqs_zstd_init(void **context) {
+	ZSTD_DCtx *dctx = ZSTD_createDCtx();
+	if (dctx == NULL) {
+		return -HSQS_ERROR_COMPRESSION_INIT;
+	}
+	*context = dctx;
+	return 0;
+}
+
+static int
+hsqs_zstd_cleanup(void *context) {
+	ZSTD_freeDCtx(context);
+	return 0;
+}
+
 static int
 hsqs_zstd_extract(
-		const union HsqsCompressionOptions *options, size_t options_size,
-		uint8_t *target, size_t *target_size, const uint8_t *compressed,
-		const size_t compressed_size) {
+		void *context, const union HsqsCompressionOptions *options,
+		size_t options_size, uint8_t *target, size_t *target_size,
+		const uint8_t *compressed, const size_t compressed_size) {
 	if (options != NULL &&
 		options_size != HSQS_SIZEOF_COMPRESSION_OPTIONS_ZSTD) {
 		return -HSQS_ERROR_COMPRESSION_DECOMPRESS;
 	}
 
-	int rv = ZSTD_decompress(target, *target_size, compressed, compressed_size);
+	size_t rv = ZSTD_decompressDCtx(
+			context, target, *target_size, compressed, compressed_size);
 
 	if (ZSTD_isError(rv)) {
 		return -HSQS_ERROR_COMPRESSION_DECOMPRESS;
 	}
-	return rv;
+	*target_size = rv;
+	return 0;
 }
 
 const struct HsqsCompressionImplementation hsqs_compression_zstd = {
+		.init = hsqs_zstd_init,
+		.cleanup = hsqs_zstd_cleanup,
 		.extract = hsqs_zstd_extract,
 };
@@ -36,20 +36,13 @@
 #include "../error.h"
 #include "../hsqs.h"
 #include "../mapper/mapper.h"
+#include "datablock_context.h"
 #include "inode_context.h"
 #include "superblock_context.h"
 #include <stdint.h>
 #include <stdio.h>
-
-static uint64_t
-datablock_offset(struct HsqsFileContext *context, uint32_t block_index) {
-	uint64_t offset = 0;
-
-	for (uint32_t i = 0; i < block_index; i++) {
-		offset += hsqs_inode_file_block_size(context->inode, i);
-	}
-	return offset;
-}
+#include <stdlib.h>
+#include <string.h>
 
 int
 hsqs_content_init(
@@ -65,6 +58,13 @@ hsqs_content_init(
 	context->inode = inode;
 	context->block_size = hsqs_superblock_block_size(superblock);
 	context->hsqs = hsqs;
+	context->read_ahead = 0;
+	context->prefetch_next_pos = 0;
+	context->prefetch_window = 0;
+	context->prefetch_end_block = 0;
+	context->fragment_ref = NULL;
+	context->fragment_data = NULL;
+	context->fragment_size = 0;
 
 	if (hsqs_inode_file_has_fragment(inode)) {
 		rv = hsqs_fragment_table(context->hsqs, &context->fragment_table);
@@ -75,10 +75,7 @@ hsqs_content_init(
 		context->fragment_table = NULL;
 	}
 
-	enum HsqsSuperblockCompressionId compression_id =
-			hsqs_superblock_compression_id(superblock);
-	rv = hsqs_buffer_init(
-			&context->buffer, compression_id, context->block_size);
+	rv = hsqs_block_buffer_init(hsqs, &context->buffer, context->block_size);
 	if (rv < 0) {
 		return rv;
 	}
@@ -96,6 +93,282 @@ hsqs_content_seek(struct HsqsFileContext *context, uint64_t seek_pos) {
 	return 0;
 }
 
+void
+hsqs_content_set_read_ahead(
+		struct HsqsFileContext *context, uint32_t block_count) {
+	context->read_ahead = block_count;
+}
+
+static int
+map_window(
+		struct HsqsFileContext *context, struct HsqsMapping *mapping,
+		uint64_t block_offset, uint32_t map_end_block) {
+	int rv = 0;
+	uint64_t start_block = hsqs_inode_file_blocks_start(context->inode);
+	uint64_t block_end_offset;
+
+	rv = hsqs_inode_file_block_offset(
+			context->inode, map_end_block, &block_end_offset);
+	if (rv < 0) {
+		return rv;
+	}
+
+	return hsqs_request_map(
+			context->hsqs, mapping, start_block + block_offset,
+			block_end_offset - block_offset);
+}
+
+struct PrefetchJob {
+	struct Hsqs *hsqs;
+	uint64_t address;
+	uint32_t size;
+	bool is_compressed;
+};
+
+static void
+prefetch_block(void *data) {
+	int rv = 0;
+	struct PrefetchJob *job = data;
+	struct HsqsMapping mapping = {0};
+	struct HsqsDatablockContext datablock = {0};
+
+	rv = hsqs_datablock_init(&datablock, job->hsqs, job->address);
+	if (rv < 0 || hsqs_datablock_is_cached(&datablock)) {
+		goto out;
+	}
+	rv = hsqs_request_map(job->hsqs, &mapping, job->address, job->size);
+	if (rv < 0) {
+		goto out;
+	}
+	// Failures are ignored, the reader decompresses the block itself.
+	rv = hsqs_datablock_read(
+			&datablock, hsqs_mapping_data(&mapping), job->size,
+			job->is_compressed);
+
+out:
+	hsqs_mapping_unmap(&mapping);
+	hsqs_datablock_cleanup(&datablock);
+	free(job);
+}
+
+static int
+prefetch_submit(struct HsqsFileContext *context, uint32_t block_index) {
+	int rv = 0;
+	uint64_t block_offset;
+	struct PrefetchJob *job = NULL;
+
+	rv = hsqs_inode_file_block_offset(
+			context->inode, block_index, &block_offset);
+	if (rv < 0) {
+		goto out;
+	}
+	job = calloc(1, sizeof(struct PrefetchJob));
+	if (job == NULL) {
+		rv = -HSQS_ERROR_MALLOC_FAILED;
+		goto out;
+	}
+	job->hsqs = context->hsqs;
+	job->address = hsqs_inode_file_blocks_start(context->inode) + block_offset;
+	job->size = hsqs_inode_file_block_size(context->inode, block_index);
+	job->is_compressed =
+			hsqs_inode_file_block_is_compressed(context->inode, block_index);
+	if (job->size == 0) {
+		// sparse blocks are never cached.
+		goto out;
+	}
+
+	rv = hsqs_worker_pool_try_submit(
+			hsqs_worker_pool(context->hsqs), prefetch_block, job);
+	if (rv < 0) {
+		goto out;
+	}
+	job = NULL;
+
+out:
+	free(job);
+	return rv;
+}
+
+// Adapts the prefetch window to the access pattern: a sequential read that
+// still had to decompress blocks itself doubles the window, a random read
+// halves it. The blocks following the read are then queued up to the
+// window.
+static void
+prefetch(
+		struct HsqsFileContext *context, uint32_t end_block, uint64_t end_pos,
+		bool missed) {
+	uint32_t block_count = hsqs_inode_file_block_count(context->inode);
+	uint32_t window_end;
+
+	if (hsqs_worker_pool_thread_count(hsqs_worker_pool(context->hsqs)) == 0) {
+		return;
+	}
+
+	if (context->seek_pos != context->prefetch_next_pos) {
+		context->prefetch_window /= 2;
+		context->prefetch_end_block = end_block;
+	} else if (missed) {
+		context->prefetch_window = MIN(
+				MAX(context->prefetch_window * 2, 1),
+				HSQS_CONTENT_PREFETCH_MAX);
+	}
+	context->prefetch_next_pos = end_pos;
+
+	window_end = MIN((uint64_t)end_block + context->prefetch_window,
+					 block_count);
+	context->prefetch_end_block = MAX(context->prefetch_end_block, end_block);
+	for (; context->prefetch_end_block < window_end;
+		 context->prefetch_end_block++) {
+		if (prefetch_submit(context, context->prefetch_end_block) < 0) {
+			break;
+		}
+	}
+}
+
+struct ExtractJob {
+	const struct HsqsBuffer *buffer;
+	uint8_t *target;
+	size_t size;
+	const uint8_t *source;
+	uint32_t source_size;
+	bool is_compressed;
+	int rv;
+};
+
+static void
+extract_block(void *data) {
+	struct ExtractJob *job = data;
+	size_t expected_size = job->size;
+
+	job->rv = hsqs_buffer_extract_block(
+			job->buffer, job->target, &job->size, job->source,
+			job->source_size, job->is_compressed);
+	if (job->rv >= 0 && job->size != expected_size) {
+		job->rv = -HSQS_ERROR_SIZE_MISSMATCH;
+	}
+}
+
+static bool
+use_parallel_read(struct HsqsFileContext *context, uint32_t block_count) {
+	const struct HsqsOptions *options = hsqs_options(context->hsqs);
+	struct HsqsWorkerPool *pool = hsqs_worker_pool(context->hsqs);
+
+	return hsqs_worker_pool_thread_count(pool) != 0 &&
+			block_count >= options->parallel_read_min_blocks;
+}
+
+// Decompresses the blocks [block_index, end_block) straight into their
+// final position in the buffer. All blocks but the last one of a file are
+// full sized, so each position is known before decompression. The calling
+// thread extracts the last missing block itself while the workers handle
+// the others. Blocks extracted this way are not added to the datablock
+// cache.
+static int
+read_blocks_parallel(
+		struct HsqsFileContext *context, uint32_t block_index,
+		uint32_t end_block, uint64_t block_offset, uint32_t map_end_block,
+		bool *missed) {
+	int rv = 0;
+	struct HsqsMapping mapping = {0};
+	struct HsqsWorkerGroup group;
+	struct HsqsDatablockContext datablock = {0};
+	struct ExtractJob *jobs = NULL;
+	struct ExtractJob *job, *pending = NULL;
+	uint64_t start_block = hsqs_inode_file_blocks_start(context->inode);
+	uint64_t file_size = hsqs_inode_file_size(context->inode);
+	uint64_t block_start_pos = (uint64_t)block_index * context->block_size;
+	uint64_t mapping_offset = 0;
+	uint32_t block_count = end_block - block_index;
+	uint32_t outer_block_size;
+	bool is_mapped = false;
+	uint8_t *target;
+
+	hsqs_worker_group_init(&group, hsqs_worker_pool(context->hsqs));
+
+	jobs = calloc(block_count, sizeof(struct ExtractJob));
+	if (jobs == NULL) {
+		rv = -HSQS_ERROR_MALLOC_FAILED;
+		goto out;
+	}
+	rv = hsqs_buffer_extend(
+			&context->buffer,
+			MIN((uint64_t)block_count * context->block_size,
+				file_size - block_start_pos),
+			&target);
+	if (rv < 0) {
+		goto out;
+	}
+
+	for (uint32_t i = 0; i < block_count; i++, block_index++) {
+		job = &jobs[i];
+		job->buffer = &context->buffer;
+		job->target = &target[(uint64_t)i * context->block_size];
+		job->size = MIN(context->block_size,
+						file_size - block_start_pos -
+								(uint64_t)i * context->block_size);
+		outer_block_size =
+				hsqs_inode_file_block_size(context->inode, block_index);
+		if (outer_block_size == 0) {
+			memset(job->target, 0, job->size);
+			continue;
+		}
+
+		rv = hsqs_datablock_init(
+				&datablock, context->hsqs, start_block + block_offset);
+		if (rv < 0) {
+			goto out;
+		}
+		if (hsqs_datablock_is_cached(&datablock)) {
+			if (hsqs_datablock_size(&datablock) != job->size) {
+				rv = -HSQS_ERROR_SIZE_MISSMATCH;
+				goto out;
+			}
+			memcpy(job->target, hsqs_datablock_data(&datablock), job->size);
+		} else {
+			*missed = true;
+			if (!is_mapped) {
+				rv = map_window(
+						context, &mapping, block_offset, map_end_block);
+				if (rv < 0) {
+					goto out;
+				}
+				mapping_offset = block_offset;
+				is_mapped = true;
+			}
+			job->source =
+					&hsqs_mapping_data(&mapping)[block_offset - mapping_offset];
+			job->source_size = outer_block_size;
+			job->is_compressed = hsqs_inode_file_block_is_compressed(
+					context->inode, block_index);
+
+			// keep one job back for the calling thread. Jobs the pool
+			// has no room for are run right away.
+			if (pending != NULL &&
+				hsqs_worker_group_try_submit(&group, extract_block, pending) <
+						0) {
+				extract_block(pending);
+			}
+			pending = job;
+		}
+		hsqs_datablock_cleanup(&datablock);
+		block_offset += outer_block_size;
+	}
+	if (pending != NULL) {
+		extract_block(pending);
+	}
+
+out:
+	// The jobs point into the mapping, so they have to finish first.
+	hsqs_worker_group_wait(&group);
+	for (uint32_t i = 0; rv >= 0 && jobs != NULL && i < block_count; i++) {
+		rv = jobs[i].rv;
+	}
+	hsqs_datablock_cleanup(&datablock);
+	hsqs_mapping_unmap(&mapping);
+	free(jobs);
+	return rv;
+}
+
 int
 hsqs_content_read(struct HsqsFileContext *context, uint64_t size) {
 	int rv = 0;
@@ -106,46 +379,158 @@ hsqs_content_read(struct HsqsFileContext *context, uint64_t size) {
 	bool is_compressed;
 	uint32_t block_index = context->seek_pos / context->block_size;
 	uint32_t block_count = hsqs_inode_file_block_count(context->inode);
-	uint64_t block_offset = datablock_offset(context, block_index);
-	uint64_t block_whole_size =
-			datablock_offset(context, block_count) - block_offset;
+	uint32_t end_block;
+	uint32_t map_end_block;
+	uint64_t end_pos;
+	uint64_t block_offset;
+	uint64_t mapping_offset = 0;
+	bool is_mapped = false;
 	uint32_t outer_block_size;
-	uint64_t outer_offset = 0;
+	uint64_t reserve_size;
+	uint64_t blocks_end;
+	uint64_t file_size = hsqs_inode_file_size(context->inode);
+	uint64_t sparse_size;
+	uint8_t *sparse_target;
+	bool missed = false;
+	struct HsqsDatablockContext datablock = {0};
 
-	rv = hsqs_request_map(
-			context->hsqs, &mapping, start_block + block_offset,
-			block_whole_size);
+	// The buffer keeps its allocation, so repeated reads through the same
+	// context do not allocate again.
+	hsqs_buffer_reset(buffer);
+	hsqs_ref_count_release(context->fragment_ref);
+	context->fragment_ref = NULL;
+	context->fragment_data = NULL;
+	context->fragment_size = 0;
 
+	// Only the blocks overlapping [seek_pos, seek_pos + size) are
+	// decompressed. The read ahead window just widens the mapped range.
+	// Blocks found in the datablock cache are not mapped at all.
+	if (ADD_OVERFLOW(context->seek_pos, size, &end_pos)) {
+		rv = -HSQS_ERROR_INTEGER_OVERFLOW;
+		goto out;
+	}
+	end_block = MIN(
+			end_pos / context->block_size +
+					(end_pos % context->block_size != 0),
+			block_count);
+	map_end_block = MIN((uint64_t)end_block + context->read_ahead, block_count);
+
+	rv = hsqs_inode_file_block_offset(
+			context->inode, block_index, &block_offset);
 	if (rv < 0) {
 		goto out;
 	}
+
+	// Size the buffer for all blocks at once. The fragment is only copied
+	// into it if it follows decompressed blocks.
+	if (block_index < end_block) {
+		reserve_size = (uint64_t)(end_block - block_index) *
+				context->block_size;
+		blocks_end = (uint64_t)block_count * context->block_size;
+		if (end_pos > blocks_end &&
+			hsqs_inode_file_size(context->inode) > blocks_end &&
+			hsqs_inode_file_has_fragment(context->inode)) {
+			reserve_size += hsqs_inode_file_size(context->inode) - blocks_end;
+		}
+		if (reserve_size > SIZE_MAX) {
+			rv = -HSQS_ERROR_INTEGER_OVERFLOW;
+			goto out;
+		}
+		rv = hsqs_buffer_reserve(buffer, reserve_size);
+		if (rv < 0) {
+			goto out;
+		}
+	}
+
 	if (hsqs_inode_file_size(context->inode) > size) {
 		rv = HSQS_ERROR_SIZE_MISSMATCH;
 	}
 
-	for (; block_index < block_count && hsqs_content_size(context) < size;
+	if (block_index < end_block &&
+		use_parallel_read(context, end_block - block_index)) {
+		rv = read_blocks_parallel(
+				context, block_index, end_block, block_offset, map_end_block,
+				&missed);
+		if (rv < 0) {
+			goto out;
+		}
+		block_index = end_block;
+	}
+
+	for (; block_index < end_block && hsqs_content_size(context) < size;
 		 block_index++) {
 		is_compressed = hsqs_inode_file_block_is_compressed(
 				context->inode, block_index);
 		outer_block_size =
 				hsqs_inode_file_block_size(context->inode, block_index);
+		if (outer_block_size == 0) {
+			// sparse blocks share their address with the next block, so
+			// they must not go through the datablock cache.
+			sparse_size = MIN(context->block_size,
+							  file_size - (uint64_t)block_index *
+									  context->block_size);
+			rv = hsqs_buffer_extend(buffer, sparse_size, &sparse_target);
+			if (rv < 0) {
+				goto out;
+			}
+			memset(sparse_target, 0, sparse_size);
+			continue;
+		}
 
-		rv = hsqs_buffer_append_block(
-				buffer, &hsqs_mapping_data(&mapping)[outer_offset],
-				outer_block_size, is_compressed);
+		rv = hsqs_datablock_init(
+				&datablock, context->hsqs, start_block + block_offset);
 		if (rv < 0) {
 			goto out;
 		}
-		outer_offset += outer_block_size;
+		if (!hsqs_datablock_is_cached(&datablock)) {
+			missed = true;
+			// map the remaining window on the first cache miss.
+			if (!is_mapped) {
+				rv = map_window(
+						context, &mapping, block_offset, map_end_block);
+				if (rv < 0) {
+					goto out;
+				}
+				mapping_offset = block_offset;
+				is_mapped = true;
+			}
+			rv = hsqs_datablock_read(
+					&datablock,
+					&hsqs_mapping_data(&mapping)[block_offset - mapping_offset],
+					outer_block_size, is_compressed);
+			if (rv < 0) {
+				goto out;
+			}
+		}
+
+		rv = hsqs_buffer_append(
+				buffer, hsqs_datablock_data(&datablock),
+				hsqs_datablock_size(&datablock));
+		if (rv < 0) {
+			goto out;
+		}
+		hsqs_datablock_cleanup(&datablock);
+		block_offset += outer_block_size;
 	}
 
+	prefetch(context, end_block, end_pos, missed);
+
 	if (hsqs_content_size(context) < size) {
 		if (!hsqs_inode_file_has_fragment(context->inode)) {
 			rv = -HSQS_ERROR_TODO;
 			goto out;
 		}
 
-		rv = hsqs_fragment_table_to_buffer(table, context->inode, buffer);
+		if (hsqs_buffer_size(buffer) == 0 && context->fragment_ref == NULL) {
+			// The read is served from the fragment alone, so hand out a
+			// view into the cached fragment block instead of copying it.
+			rv = hsqs_fragment_table_slice(
+					table, context->inode, &context->fragment_ref,
+					&context->fragment_data, &context->fragment_size);
+		} else {
+			rv = hsqs_fragment_table_to_buffer(
+					table, context->inode, buffer);
+		}
 		if (rv < 0) {
 			goto out;
 		}
@@ -157,6 +542,7 @@ hsqs_content_read(struct HsqsFileContext *context, uint64_t size) {
 	}
 
 out:
+	hsqs_datablock_cleanup(&datablock);
 	hsqs_mapping_unmap(&mapping);
 	return rv;
 }
@@ -169,6 +555,8 @@ hsqs_content_data(struct HsqsFileContext *context) {
 
 	if (hsqs_content_size(context) == 0) {
 		return NULL;
+	} else if (context->fragment_ref != NULL) {
+		return &context->fragment_data[offset];
 	} else {
 		return &hsqs_buffer_data(&context->buffer)[offset];
 	}
@@ -181,6 +569,9 @@ hsqs_content_size(struct HsqsFileContext *context) {
 	size_t offset = context->seek_pos % block_size;
 	size_t buffer_size = hsqs_buffer_size(&context->buffer);
 
+	if (context->fragment_ref != NULL) {
+		buffer_size = context->fragment_size;
+	}
 	if (buffer_size < offset)
 		return 0;
 	else
@@ -189,6 +580,7 @@ hsqs_content_size(struct HsqsFileContext *context) {
 
 int
 hsqs_content_cleanup(struct HsqsFileContext *context) {
+	hsqs_ref_count_release(context->fragment_ref);
 	hsqs_buffer_cleanup(&context->buffer);
 
 	return 0;
@@ -38,7 +38,11 @@
 
 #define FILE_CONTEXT_H
 
+// Upper bound of the adaptive prefetch window in data blocks.
+#define HSQS_CONTENT_PREFETCH_MAX 32
+
 struct HsqsInodeContext;
+struct HsqsRefCount;
 struct Hsqs;
 
 struct HsqsFileContext {
@@ -46,8 +50,17 @@ struct HsqsFileContext {
 	struct HsqsFragmentTable *fragment_table;
 	struct HsqsInodeContext *inode;
 	struct HsqsBuffer buffer;
+	struct HsqsRefCount *fragment_ref;
+	const uint8_t *fragment_data;
+	uint32_t fragment_size;
 	uint64_t seek_pos;
 	uint32_t block_size;
+	uint32_t read_ahead;
+	// Sequential reads prefetch the following blocks into the datablock
+	// cache on the worker pool of struct Hsqs.
+	uint64_t prefetch_next_pos;
+	uint32_t prefetch_window;
+	uint32_t prefetch_end_block;
 };
 
 HSQS_NO_UNUSED int hsqs_content_init(
@@ -56,6 +69,9 @@ HSQS_NO_UNUSED int hsqs_content_init(
 HSQS_NO_UNUSED int
 hsqs_content_seek(struct HsqsFileContext *context, uint64_t seek_pos);
 
+void hsqs_content_set_read_ahead(
+		struct HsqsFileContext *context, uint32_t block_count);
+
 int hsqs_content_read(struct HsqsFileContext *context, uint64_t size);
 
 const uint8_t *hsqs_content_data(struct HsqsFileContext *context);
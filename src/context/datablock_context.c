@@ -0,0 +1,130 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright (c) 2022, Enno Boland <g@s01.de>                                 *
+ *                                                                            *
+ * Redistribution and use in source and binary forms, with or without         *
+ * modification, are permitted provided that the following conditions are     *
+ * met:                                                                       *
+ *                                                                            *
+ * * Redistributions of source code must retain the above copyright notice,   *
+ *   this list of conditions and the following disclaimer.                    *
+ * * Redistributions in binary form must reproduce the above copyright        *
+ *   notice, this list of conditions and the following disclaimer in the      *
+ *   documentation and/or other materials provided with the distribution.     *
+ *                                                                            *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS    *
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,  *
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR     *
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR          *
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,      *
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,        *
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR         *
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF     *
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING       *
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS         *
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.               *
+ *                                                                            *
+ ******************************************************************************/
+
+
+/**
+ * @author       Enno Boland (mail@eboland.de)
+ * @file         datablock_context.c
+ */
+
+#include "datablock_context.h"
+#include "../error.h"
+#include "../hsqs.h"
+#include <stdint.h>
+
+static int
+buffer_dtor(void *data) {
+	struct HsqsBuffer *buffer = data;
+	hsqs_buffer_cleanup(buffer);
+	return 0;
+}
+
+int
+hsqs_datablock_init(
+		struct HsqsDatablockContext *context, struct Hsqs *hsqs,
+		uint64_t address) {
+	struct HsqsShardedLruHashmap *cache = hsqs_datablock_cache(hsqs);
+
+	context->hsqs = hsqs;
+	context->address = address;
+	context->buffer = NULL;
+	context->buffer_ref = hsqs_sharded_lru_hashmap_acquire(cache, address);
+	if (context->buffer_ref != NULL) {
+		context->buffer = hsqs_ref_count_data(context->buffer_ref);
+	}
+
+	return 0;
+}
+
+bool
+hsqs_datablock_is_cached(const struct HsqsDatablockContext *context) {
+	return context->buffer != NULL;
+}
+
+int
+hsqs_datablock_read(
+		struct HsqsDatablockContext *context, const uint8_t *source,
+		uint32_t source_size, bool is_compressed) {
+	int rv = 0;
+	struct HsqsSuperblockContext *superblock = hsqs_superblock(context->hsqs);
+	struct HsqsShardedLruHashmap *cache = hsqs_datablock_cache(context->hsqs);
+	struct HsqsRefCount *buffer_ref = NULL;
+	struct HsqsBuffer *buffer;
+
+	if (context->buffer != NULL) {
+		return 0;
+	}
+
+	rv = hsqs_ref_count_new(
+			&buffer_ref, sizeof(struct HsqsBuffer), buffer_dtor);
+	if (rv < 0) {
+		goto out;
+	}
+	buffer = hsqs_ref_count_retain(buffer_ref);
+	rv = hsqs_block_buffer_init(
+			context->hsqs, buffer, hsqs_superblock_block_size(superblock));
+	if (rv < 0) {
+		goto out;
+	}
+	rv = hsqs_buffer_append_block(buffer, source, source_size, is_compressed);
+	if (rv < 0) {
+		goto out;
+	}
+
+	// Only fully decompressed blocks are published to the cache.
+	rv = hsqs_sharded_lru_hashmap_put_sized(
+			cache, context->address, buffer_ref, hsqs_buffer_capacity(buffer));
+	if (rv < 0) {
+		goto out;
+	}
+	context->buffer_ref = buffer_ref;
+	context->buffer = buffer;
+	buffer_ref = NULL;
+
+out:
+	hsqs_ref_count_release(buffer_ref);
+	return rv;
+}
+
+const uint8_t *
+hsqs_datablock_data(const struct HsqsDatablockContext *context) {
+	return hsqs_buffer_data(context->buffer);
+}
+
+size_t
+hsqs_datablock_size(const struct HsqsDatablockContext *context) {
+	return hsqs_buffer_size(context->buffer);
+}
+
+int
+hsqs_datablock_cleanup(struct HsqsDatablockContext *context) {
+	hsqs_ref_count_release(context->buffer_ref);
+	context->buffer_ref = NULL;
+	context->buffer = NULL;
+	return 0;
+}
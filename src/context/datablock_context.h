@@ -0,0 +1,73 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright (c) 2022, Enno Boland <g@s01.de>                                 *
+ *                                                                            *
+ * Redistribution and use in source and binary forms, with or without         *
+ * modification, are permitted provided that the following conditions are     *
+ * met:                                                                       *
+ *                                                                            *
+ * * Redistributions of source code must retain the above copyright notice,   *
+ *   this list of conditions and the following disclaimer.                    *
+ * * Redistributions in binary form must reproduce the above copyright        *
+ *   notice, this list of conditions and the following disclaimer in the      *
+ *   documentation and/or other materials provided with the distribution.     *
+ *                                                                            *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS    *
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,  *
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR     *
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR          *
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,      *
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,        *
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR         *
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF     *
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING       *
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS         *
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.               *
+ *                                                                            *
+ ******************************************************************************/
+
+
+/**
+ * @author       Enno Boland (mail@eboland.de)
+ * @file         datablock_context.h
+ */
+
+#include "../primitive/lru_hashmap.h"
+#include "../utils.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef DATABLOCK_CONTEXT_H
+
+#define DATABLOCK_CONTEXT_H
+
+#define HSQS_DATABLOCK_CACHE_SIZE (8 * 1024 * 1024)
+
+struct Hsqs;
+struct HsqsBuffer;
+
+struct HsqsDatablockContext {
+	struct Hsqs *hsqs;
+	uint64_t address;
+	struct HsqsRefCount *buffer_ref;
+	const struct HsqsBuffer *buffer;
+};
+
+HSQS_NO_UNUSED int hsqs_datablock_init(
+		struct HsqsDatablockContext *context, struct Hsqs *hsqs,
+		uint64_t address);
+
+bool hsqs_datablock_is_cached(const struct HsqsDatablockContext *context);
+
+HSQS_NO_UNUSED int hsqs_datablock_read(
+		struct HsqsDatablockContext *context, const uint8_t *source,
+		uint32_t source_size, bool is_compressed);
+
+const uint8_t *
+hsqs_datablock_data(const struct HsqsDatablockContext *context);
+
+size_t hsqs_datablock_size(const struct HsqsDatablockContext *context);
+
+int hsqs_datablock_cleanup(struct HsqsDatablockContext *context);
+
+#endif /* end of include guard DATABLOCK_CONTEXT_H */
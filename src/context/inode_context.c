@@ -39,9 +39,11 @@
 #include "../error.h"
 #include "../hsqs.h"
 #include "../iterator/directory_iterator.h"
+#include "name_index_context.h"
 #include "../utils.h"
 #include "superblock_context.h"
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 static const char *
@@ -78,6 +80,7 @@ static int
 path_find_inode_ref(
 		uint64_t *target, uint64_t dir_ref, struct Hsqs *hsqs, const char *name,
 		const size_t name_len) {
+	struct HsqsNameIndexContext index = {0};
 	struct HsqsInodeContext inode = {0};
 	struct HsqsDirectoryIterator iter = {0};
 	int rv = 0;
@@ -85,6 +88,21 @@ path_find_inode_ref(
 	if (rv < 0) {
 		goto out;
 	}
+	if (hsqs_inode_type(&inode) != HSQS_INODE_TYPE_DIRECTORY) {
+		rv = -HSQS_ERROR_NOT_A_DIRECTORY;
+		goto out;
+	}
+
+	// Directories searched often enough get a hash index.
+	rv = hsqs_name_index_init_counted(&index, &inode, dir_ref);
+	if (rv < 0) {
+		goto out;
+	}
+	if (index.index != NULL) {
+		rv = hsqs_name_index_lookup(&index, name, name_len, target, NULL);
+		goto out;
+	}
+
 	rv = hsqs_directory_iterator_init(&iter, &inode);
 	if (rv < 0) {
 		goto out;
@@ -98,70 +116,14 @@ path_find_inode_ref(
 
 out:
 	hsqs_directory_iterator_cleanup(&iter);
+	hsqs_name_index_cleanup(&index);
 	hsqs_inode_cleanup(&inode);
 	return rv;
 }
 
 static const struct HsqsInode *
 get_inode(const struct HsqsInodeContext *inode) {
-	return (const struct HsqsInode *)hsqs_metablock_stream_data(
-			&inode->metablock);
-}
-
-static int
-inode_data_more(struct HsqsInodeContext *inode, size_t size) {
-	int rv = hsqs_metablock_stream_more(&inode->metablock, size);
-
-	if (rv < 0) {
-		return rv;
-	}
-	return rv;
-}
-
-static int
-inode_load(struct HsqsInodeContext *context) {
-	int rv = 0;
-	size_t size = HSQS_SIZEOF_INODE_HEADER;
-
-	const struct HsqsInode *inode = get_inode(context);
-	switch (hsqs_data_inode_type(inode)) {
-	case HSQS_INODE_TYPE_BASIC_DIRECTORY:
-		size += HSQS_SIZEOF_INODE_DIRECTORY;
-		break;
-	case HSQS_INODE_TYPE_BASIC_FILE:
-		size += HSQS_SIZEOF_INODE_FILE_EXT;
-		break;
-	case HSQS_INODE_TYPE_BASIC_SYMLINK:
-		size += HSQS_SIZEOF_INODE_SYMLINK;
-		break;
-	case HSQS_INODE_TYPE_BASIC_BLOCK:
-	case HSQS_INODE_TYPE_BASIC_CHAR:
-		size += HSQS_SIZEOF_INODE_DEVICE;
-		break;
-	case HSQS_INODE_TYPE_BASIC_FIFO:
-	case HSQS_INODE_TYPE_BASIC_SOCKET:
-		size += HSQS_SIZEOF_INODE_IPC;
-		break;
-	case HSQS_INODE_TYPE_EXTENDED_DIRECTORY:
-		size += HSQS_SIZEOF_INODE_DIRECTORY_EXT;
-		break;
-	case HSQS_INODE_TYPE_EXTENDED_FILE:
-		size += HSQS_SIZEOF_INODE_FILE_EXT;
-		break;
-	case HSQS_INODE_TYPE_EXTENDED_SYMLINK:
-		size += HSQS_SIZEOF_INODE_SYMLINK_EXT;
-		break;
-	case HSQS_INODE_TYPE_EXTENDED_BLOCK:
-	case HSQS_INODE_TYPE_EXTENDED_CHAR:
-		size += HSQS_SIZEOF_INODE_DEVICE_EXT;
-		break;
-	case HSQS_INODE_TYPE_EXTENDED_FIFO:
-	case HSQS_INODE_TYPE_EXTENDED_SOCKET:
-		size += HSQS_SIZEOF_INODE_IPC_EXT;
-		break;
-	}
-	rv = inode_data_more(context, size);
-	return rv;
+	return (const struct HsqsInode *)hsqs_buffer_data(&inode->record->data);
 }
 
 static const struct HsqsDatablockSize *
@@ -182,45 +144,6 @@ get_size_info(const struct HsqsInodeContext *context, int index) {
 	abort();
 }
 
-int
-hsqs_inode_load_by_ref(
-		struct HsqsInodeContext *inode, struct Hsqs *hsqs, uint64_t inode_ref) {
-	uint32_t inode_block;
-	uint16_t inode_offset;
-
-	hsqs_inode_ref_to_block(inode_ref, &inode_block, &inode_offset);
-
-	int rv = 0;
-	struct HsqsSuperblockContext *superblock = hsqs_superblock(hsqs);
-
-	rv = hsqs_metablock_stream_init(
-			&inode->metablock, hsqs,
-			hsqs_superblock_inode_table_start(superblock), ~0);
-	if (rv < 0) {
-		return rv;
-	}
-	rv = hsqs_metablock_stream_seek(
-			&inode->metablock, inode_block, inode_offset);
-	if (rv < 0) {
-		return rv;
-	}
-
-	// loading enough data to identify the inode
-	rv = inode_data_more(inode, HSQS_SIZEOF_INODE_HEADER);
-	if (rv < 0) {
-		return rv;
-	}
-
-	rv = inode_load(inode);
-	if (rv < 0) {
-		return rv;
-	}
-
-	inode->hsqs = hsqs;
-
-	return rv;
-}
-
 int
 hsqs_inode_load_root(struct HsqsInodeContext *inode, struct Hsqs *hsqs) {
 	struct HsqsSuperblockContext *superblock = hsqs_superblock(hsqs);
@@ -249,44 +172,162 @@ hsqs_inode_load_by_inode_number(
 	return hsqs_inode_load_by_ref(inode, hsqs, inode_ref);
 }
 
+static bool
+path_segment_is_current(const char *segment, size_t segment_len) {
+	return segment_len == 0 || (segment_len == 1 && segment[0] == '.');
+}
+
+static bool
+path_segment_is_parent(const char *segment, size_t segment_len) {
+	return segment_len == 2 && strncmp(segment, "..", 2) == 0;
+}
+
+static size_t
+path_append_segment(
+		char *prefix, size_t prefix_size, const char *segment,
+		size_t segment_len) {
+	if (prefix_size > 0) {
+		prefix[prefix_size++] = '/';
+	}
+	memcpy(&prefix[prefix_size], segment, segment_len);
+	return prefix_size + segment_len;
+}
+
+static int
+path_lookup_child(
+		uint64_t *target, uint64_t dir_ref, struct Hsqs *hsqs, const char *name,
+		const size_t name_len) {
+	int rv = 0;
+	int put_rv = 0;
+	struct HsqsDentryCache *cache = hsqs_dentry_cache(hsqs);
+
+	if (hsqs_dentry_cache_get(cache, dir_ref, name, name_len, target, &rv)) {
+		return rv;
+	}
+
+	rv = path_find_inode_ref(target, dir_ref, hsqs, name, name_len);
+	if (rv == 0) {
+		put_rv = hsqs_dentry_cache_put(
+				cache, dir_ref, name, name_len, *target, 0);
+	} else if (
+			rv == -HSQS_ERROR_NO_SUCH_FILE ||
+			rv == -HSQS_ERROR_NOT_A_DIRECTORY) {
+		put_rv = hsqs_dentry_cache_put(cache, dir_ref, name, name_len, 0, rv);
+	}
+	if (put_rv < 0) {
+		return put_rv;
+	}
+	return rv;
+}
+
+// Normalizes path and looks up the longest of its prefixes that has been
+// resolved before. Returns its depth and advances path behind it. Paths
+// containing ".." are resolved segment by segment, as they may need the
+// inodes of the skipped prefixes.
+static int
+path_find_cached_prefix(
+		struct HsqsDentryCache *cache, const char **path, char *prefix,
+		size_t *prefix_ends, uint64_t *inode_refs) {
+	int i;
+	int depth = 0;
+	int result;
+	size_t segment_len;
+	const char *segment;
+
+	for (segment = *path; segment; segment = path_find_next_segment(segment)) {
+		segment_len = path_get_segment_len(segment);
+		if (path_segment_is_current(segment, segment_len)) {
+			continue;
+		} else if (path_segment_is_parent(segment, segment_len)) {
+			return 0;
+		}
+		prefix_ends[depth + 1] = path_append_segment(
+				prefix, prefix_ends[depth], segment, segment_len);
+		depth++;
+	}
+
+	for (; depth > 0; depth--) {
+		if (hsqs_dentry_cache_get(
+					cache, HSQS_DENTRY_PATH, prefix, prefix_ends[depth],
+					&inode_refs[depth], &result) &&
+			result == 0) {
+			break;
+		}
+	}
+
+	segment = *path;
+	for (i = 0; i < depth; segment = path_find_next_segment(segment)) {
+		segment_len = path_get_segment_len(segment);
+		if (!path_segment_is_current(segment, segment_len)) {
+			i++;
+		}
+	}
+	*path = segment;
+
+	return depth;
+}
+
 int
 hsqs_inode_load_by_path(
 		struct HsqsInodeContext *inode, struct Hsqs *hsqs, const char *path) {
 	int i;
 	int rv = 0;
-	int segment_count = path_segments_count(path) + 1;
+	// a NULL path refers to the root directory.
+	const char *segment = path != NULL ? path : "";
+	int segment_count = path_segments_count(segment) + 1;
 	struct HsqsSuperblockContext *superblock = hsqs_superblock(hsqs);
-	const char *segment = path;
+	struct HsqsDentryCache *cache = hsqs_dentry_cache(hsqs);
+	size_t prefix_size;
 	uint64_t *inode_refs = calloc(segment_count, sizeof(uint64_t));
-	if (inode_refs == NULL) {
-		rv = HSQS_ERROR_MALLOC_FAILED;
+	size_t *prefix_ends = calloc(segment_count, sizeof(size_t));
+	// the normalized prefix is never longer than the path itself
+	char *prefix = malloc(strlen(segment) + 1);
+	if (inode_refs == NULL || prefix_ends == NULL || prefix == NULL) {
+		rv = -HSQS_ERROR_MALLOC_FAILED;
 		goto out;
 	}
 	inode_refs[0] = hsqs_superblock_inode_root_ref(superblock);
 
-	for (i = 0; segment; segment = path_find_next_segment(segment)) {
+	i = path_find_cached_prefix(
+			cache, &segment, prefix, prefix_ends, inode_refs);
+	prefix_size = prefix_ends[i];
+
+	for (; segment; segment = path_find_next_segment(segment)) {
 		size_t segment_len = path_get_segment_len(segment);
 
-		if (segment_len == 0 || (segment_len == 1 && segment[0] == '.')) {
+		if (path_segment_is_current(segment, segment_len)) {
 			continue;
-		} else if (segment_len == 2 && strncmp(segment, "..", 2) == 0) {
+		} else if (path_segment_is_parent(segment, segment_len)) {
 			i = MAX(0, i - 1);
+			prefix_size = prefix_ends[i];
 			continue;
 		} else {
 			uint64_t parent_inode_ref = inode_refs[i];
 			i++;
-			rv = path_find_inode_ref(
+			rv = path_lookup_child(
 					&inode_refs[i], parent_inode_ref, hsqs, segment,
 					segment_len);
 			if (rv < 0) {
 				goto out;
 			}
+
+			prefix_size = path_append_segment(
+					prefix, prefix_size, segment, segment_len);
+			prefix_ends[i] = prefix_size;
+			rv = hsqs_dentry_cache_put(
+					cache, HSQS_DENTRY_PATH, prefix, prefix_size,
+					inode_refs[i], 0);
+			if (rv < 0) {
+				goto out;
+			}
 		}
 	}
 
 	rv = hsqs_inode_load_by_ref(inode, hsqs, inode_refs[i]);
 
 out:
+	free(prefix);
+	free(prefix_ends);
 	free(inode_refs);
 	return rv;
 }
@@ -315,8 +356,8 @@ hsqs_inode_is_extended(const struct HsqsInodeContext *context) {
 	return false;
 }
 
-uint32_t
-hsqs_inode_hard_link_count(const struct HsqsInodeContext *context) {
+static uint32_t
+inode_data_hard_link_count(const struct HsqsInodeContext *context) {
 	const struct HsqsInode *inode = get_inode(context);
 	switch (hsqs_data_inode_type(inode)) {
 	case HSQS_INODE_TYPE_BASIC_DIRECTORY:
@@ -356,8 +397,8 @@ hsqs_inode_hard_link_count(const struct HsqsInodeContext *context) {
 	return -HSQS_ERROR_UNKOWN_INODE_TYPE;
 }
 
-uint64_t
-hsqs_inode_file_size(const struct HsqsInodeContext *context) {
+static uint64_t
+inode_data_file_size(const struct HsqsInodeContext *context) {
 	const struct HsqsInodeFile *basic_file;
 	const struct HsqsInodeFileExt *extended_file;
 	const struct HsqsInodeDirectory *basic_dir;
@@ -381,18 +422,18 @@ hsqs_inode_file_size(const struct HsqsInodeContext *context) {
 	return 0;
 }
 
-uint16_t
-hsqs_inode_permission(const struct HsqsInodeContext *inode) {
+static uint16_t
+inode_data_permission(const struct HsqsInodeContext *inode) {
 	return hsqs_data_inode_permissions(get_inode(inode));
 }
 
-uint32_t
-hsqs_inode_number(const struct HsqsInodeContext *inode) {
+static uint32_t
+inode_data_number(const struct HsqsInodeContext *inode) {
 	return hsqs_data_inode_number(get_inode(inode));
 }
 
-uint32_t
-hsqs_inode_modified_time(const struct HsqsInodeContext *inode) {
+static uint32_t
+inode_data_modified_time(const struct HsqsInodeContext *inode) {
 	return hsqs_data_inode_modified_time(get_inode(inode));
 }
 
@@ -429,17 +470,96 @@ hsqs_inode_file_block_count(const struct HsqsInodeContext *context) {
 uint32_t
 hsqs_inode_file_block_size(
 		const struct HsqsInodeContext *inode, uint32_t index) {
-	const struct HsqsDatablockSize *size_info = get_size_info(inode, index);
-
-	return hsqs_data_datablock_size(size_info);
+	return hsqs_data_datablock_size(&inode->record->block_sizes[index]);
 }
 
 bool
 hsqs_inode_file_block_is_compressed(
 		const struct HsqsInodeContext *inode, int index) {
-	const struct HsqsDatablockSize *size_info = get_size_info(inode, index);
+	return hsqs_data_datablock_is_compressed(
+			&inode->record->block_sizes[index]);
+}
+
+static int
+block_index_init(
+		struct HsqsInodeContext *context, struct HsqsInodeBlockIndex *index) {
+	uint32_t block_count = hsqs_inode_file_block_count(context);
+	uint32_t stride = HSQS_INODE_BLOCK_INDEX_STRIDE;
+	uint32_t count = block_count / stride + 1;
+	uint64_t *offsets;
+	uint64_t offset = 0;
+
+	offsets = calloc(count, sizeof(uint64_t));
+	if (offsets == NULL) {
+		return -HSQS_ERROR_MALLOC_FAILED;
+	}
+
+	for (uint32_t i = 0; i < block_count; i++) {
+		if (i % stride == 0) {
+			offsets[i / stride] = offset;
+		}
+		offset += hsqs_inode_file_block_size(context, i);
+	}
+	if (block_count % stride == 0) {
+		offsets[block_count / stride] = offset;
+	}
+
+	index->count = count;
+	index->stride = stride;
+	// publish the offsets last, readers check them without the lock.
+	__atomic_store_n(&index->offsets, offsets, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+// The index is shared by all contexts of the inode record, so it is built
+// only once per cached inode.
+static int
+block_index_get(
+		struct HsqsInodeContext *context,
+		const struct HsqsInodeBlockIndex **index) {
+	int rv = 0;
+	struct HsqsInodeRecord *record = hsqs_ref_count_data(context->record_ref);
+	struct HsqsInodeBlockIndex *block_index = &record->block_index;
+
+	*index = block_index;
+	if (__atomic_load_n(&block_index->offsets, __ATOMIC_ACQUIRE) != NULL) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&record->block_index_lock);
+	if (block_index->offsets == NULL) {
+		rv = block_index_init(context, block_index);
+	}
+	pthread_mutex_unlock(&record->block_index_lock);
+	return rv;
+}
+
+int
+hsqs_inode_file_block_offset(
+		struct HsqsInodeContext *context, uint32_t index, uint64_t *offset) {
+	int rv = 0;
+	const struct HsqsInodeBlockIndex *block_index;
+
+	if (hsqs_inode_type(context) != HSQS_INODE_TYPE_FILE) {
+		return -HSQS_ERROR_NOT_A_FILE;
+	}
+	if (index > hsqs_inode_file_block_count(context)) {
+		return -HSQS_ERROR_SEEK_OUT_OF_RANGE;
+	}
+
+	rv = block_index_get(context, &block_index);
+	if (rv < 0) {
+		return rv;
+	}
 
-	return hsqs_data_datablock_is_compressed(size_info);
+	uint32_t checkpoint = index / block_index->stride;
+	*offset = block_index->offsets[checkpoint];
+	for (uint32_t i = checkpoint * block_index->stride; i < index; i++) {
+		*offset += hsqs_inode_file_block_size(context, i);
+	}
+
+	return rv;
 }
 
 uint32_t
@@ -516,8 +636,8 @@ hsqs_inode_file_has_fragment(const struct HsqsInodeContext *inode) {
 			HSQS_INODE_NO_FRAGMENT;
 }
 
-enum HsqsInodeContextType
-hsqs_inode_type(const struct HsqsInodeContext *context) {
+static enum HsqsInodeContextType
+inode_data_type(const struct HsqsInodeContext *context) {
 	const struct HsqsInode *inode = get_inode(context);
 
 	switch (hsqs_data_inode_type(inode)) {
@@ -631,18 +751,18 @@ inode_get_id(const struct HsqsInodeContext *context, off_t idx) {
 	return id;
 }
 
-uint32_t
-hsqs_inode_uid(const struct HsqsInodeContext *context) {
+static uint32_t
+inode_data_uid(const struct HsqsInodeContext *context) {
 	return inode_get_id(context, hsqs_data_inode_uid_idx(get_inode(context)));
 }
 
-uint32_t
-hsqs_inode_gid(const struct HsqsInodeContext *context) {
+static uint32_t
+inode_data_gid(const struct HsqsInodeContext *context) {
 	return inode_get_id(context, hsqs_data_inode_gid_idx(get_inode(context)));
 }
 
-uint32_t
-hsqs_inode_xattr_index(const struct HsqsInodeContext *context) {
+static uint32_t
+inode_data_xattr_index(const struct HsqsInodeContext *context) {
 	const struct HsqsInode *inode = get_inode(context);
 	switch (hsqs_data_inode_type(inode)) {
 	case HSQS_INODE_TYPE_EXTENDED_DIRECTORY:
@@ -666,6 +786,335 @@ hsqs_inode_xattr_index(const struct HsqsInodeContext *context) {
 	return HSQS_INODE_NO_XATTR;
 }
 
+static int
+inode_file_block_sizes_size(
+		const struct HsqsInode *inode, uint32_t block_size, size_t *size) {
+	const struct HsqsInodeFile *basic_file;
+	const struct HsqsInodeFileExt *extended_file;
+	uint64_t file_size;
+	uint32_t fragment_index;
+	uint64_t block_count;
+	size_t block_sizes_size;
+
+	switch (hsqs_data_inode_type(inode)) {
+	case HSQS_INODE_TYPE_BASIC_FILE:
+		basic_file = hsqs_data_inode_file(inode);
+		file_size = hsqs_data_inode_file_size(basic_file);
+		fragment_index = hsqs_data_inode_file_fragment_block_index(basic_file);
+		break;
+	case HSQS_INODE_TYPE_EXTENDED_FILE:
+		extended_file = hsqs_data_inode_file_ext(inode);
+		file_size = hsqs_data_inode_file_ext_size(extended_file);
+		fragment_index =
+				hsqs_data_inode_file_ext_fragment_block_index(extended_file);
+		break;
+	default:
+		return 0;
+	}
+
+	block_count = file_size / block_size;
+	if (fragment_index == HSQS_INODE_NO_FRAGMENT && file_size % block_size) {
+		block_count++;
+	}
+	if (MULT_OVERFLOW(
+				block_count, HSQS_SIZEOF_DATABLOCK_SIZE, &block_sizes_size)) {
+		return -HSQS_ERROR_INTEGER_OVERFLOW;
+	}
+	if (ADD_OVERFLOW(*size, block_sizes_size, size)) {
+		return -HSQS_ERROR_INTEGER_OVERFLOW;
+	}
+	return 0;
+}
+
+static int
+inode_directory_index_size(
+		const struct HsqsInode *inode, size_t available, size_t *size) {
+	const uint8_t *data = (const uint8_t *)inode;
+	const struct HsqsInodeDirectoryIndex *index;
+	uint16_t count = hsqs_data_inode_directory_ext_index_count(
+			hsqs_data_inode_directory_ext(inode));
+
+	for (uint16_t i = 0; i < count; i++) {
+		if (*size + HSQS_SIZEOF_INODE_DIRECTORY_INDEX > available) {
+			// the name size of this entry is not loaded yet
+			*size += HSQS_SIZEOF_INODE_DIRECTORY_INDEX;
+			return 0;
+		}
+		index = (const struct HsqsInodeDirectoryIndex *)&data[*size];
+		*size += HSQS_SIZEOF_INODE_DIRECTORY_INDEX;
+		if (ADD_OVERFLOW(
+					*size,
+					(size_t)hsqs_data_inode_directory_index_name_size(index) +
+							1,
+					size)) {
+			return -HSQS_ERROR_INTEGER_OVERFLOW;
+		}
+	}
+	return 0;
+}
+
+// Calculates the size of the inode record from its first `available` bytes.
+// The result is larger than `available` as long as parts of the record that
+// are needed to know its size are missing.
+static int
+inode_record_size(
+		const struct HsqsInode *inode, size_t available, uint32_t block_size,
+		size_t *size) {
+	int type = hsqs_data_inode_type(inode);
+
+	*size = HSQS_SIZEOF_INODE_HEADER;
+	switch (type) {
+	case HSQS_INODE_TYPE_BASIC_DIRECTORY:
+		*size += HSQS_SIZEOF_INODE_DIRECTORY;
+		break;
+	case HSQS_INODE_TYPE_BASIC_FILE:
+		*size += HSQS_SIZEOF_INODE_FILE;
+		break;
+	case HSQS_INODE_TYPE_BASIC_SYMLINK:
+		*size += HSQS_SIZEOF_INODE_SYMLINK;
+		break;
+	case HSQS_INODE_TYPE_BASIC_BLOCK:
+	case HSQS_INODE_TYPE_BASIC_CHAR:
+		*size += HSQS_SIZEOF_INODE_DEVICE;
+		break;
+	case HSQS_INODE_TYPE_BASIC_FIFO:
+	case HSQS_INODE_TYPE_BASIC_SOCKET:
+		*size += HSQS_SIZEOF_INODE_IPC;
+		break;
+	case HSQS_INODE_TYPE_EXTENDED_DIRECTORY:
+		*size += HSQS_SIZEOF_INODE_DIRECTORY_EXT;
+		break;
+	case HSQS_INODE_TYPE_EXTENDED_FILE:
+		*size += HSQS_SIZEOF_INODE_FILE_EXT;
+		break;
+	case HSQS_INODE_TYPE_EXTENDED_SYMLINK:
+		*size += HSQS_SIZEOF_INODE_SYMLINK_EXT +
+				HSQS_SIZEOF_INODE_SYMLINK_EXT_TAIL;
+		break;
+	case HSQS_INODE_TYPE_EXTENDED_BLOCK:
+	case HSQS_INODE_TYPE_EXTENDED_CHAR:
+		*size += HSQS_SIZEOF_INODE_DEVICE_EXT;
+		break;
+	case HSQS_INODE_TYPE_EXTENDED_FIFO:
+	case HSQS_INODE_TYPE_EXTENDED_SOCKET:
+		*size += HSQS_SIZEOF_INODE_IPC_EXT;
+		break;
+	default:
+		return -HSQS_ERROR_UNKOWN_INODE_TYPE;
+	}
+	if (*size > available) {
+		return 0;
+	}
+
+	switch (type) {
+	case HSQS_INODE_TYPE_BASIC_FILE:
+	case HSQS_INODE_TYPE_EXTENDED_FILE:
+		return inode_file_block_sizes_size(inode, block_size, size);
+	case HSQS_INODE_TYPE_BASIC_SYMLINK:
+		*size += hsqs_data_inode_symlink_target_size(
+				hsqs_data_inode_symlink(inode));
+		break;
+	case HSQS_INODE_TYPE_EXTENDED_SYMLINK:
+		*size += hsqs_data_inode_symlink_ext_target_size(
+				hsqs_data_inode_symlink_ext(inode));
+		break;
+	case HSQS_INODE_TYPE_EXTENDED_DIRECTORY:
+		return inode_directory_index_size(inode, available, size);
+	}
+	return 0;
+}
+
+static int
+inode_record_load(
+		struct HsqsInodeRecord *record, struct Hsqs *hsqs, uint64_t inode_ref) {
+	int rv = 0;
+	uint32_t inode_block;
+	uint16_t inode_offset;
+	size_t available = 0;
+	size_t size = HSQS_SIZEOF_INODE_HEADER;
+	struct HsqsSuperblockContext *superblock = hsqs_superblock(hsqs);
+	uint32_t block_size = hsqs_superblock_block_size(superblock);
+	struct HsqsMetablockStreamContext metablock = {0};
+	const uint8_t *data = NULL;
+	struct HsqsInodeContext context = {.record = record, .hsqs = hsqs};
+
+	hsqs_inode_ref_to_block(inode_ref, &inode_block, &inode_offset);
+
+	rv = hsqs_metablock_stream_init(
+			&metablock, hsqs, hsqs_superblock_inode_table_start(superblock),
+			~0);
+	if (rv < 0) {
+		goto out;
+	}
+	rv = hsqs_metablock_stream_seek(&metablock, inode_block, inode_offset);
+	if (rv < 0) {
+		goto out;
+	}
+
+	while (available < size) {
+		rv = hsqs_metablock_stream_more(&metablock, size);
+		if (rv < 0) {
+			goto out;
+		}
+		available = size;
+		data = hsqs_metablock_stream_data(&metablock);
+		rv = inode_record_size(
+				(const struct HsqsInode *)data, available, block_size, &size);
+		if (rv < 0) {
+			goto out;
+		}
+	}
+
+	// The record is zero terminated, which also terminates symlink targets.
+	rv = hsqs_buffer_reserve(&record->data, size + 1);
+	if (rv < 0) {
+		goto out;
+	}
+	rv = hsqs_buffer_append(&record->data, data, size);
+	if (rv < 0) {
+		goto out;
+	}
+	rv = hsqs_buffer_append(&record->data, (const uint8_t *)"", 1);
+	if (rv < 0) {
+		goto out;
+	}
+
+	record->type = inode_data_type(&context);
+	record->permission = inode_data_permission(&context);
+	record->uid = inode_data_uid(&context);
+	record->gid = inode_data_gid(&context);
+	record->file_size = inode_data_file_size(&context);
+	record->modified_time = inode_data_modified_time(&context);
+	record->hard_link_count = inode_data_hard_link_count(&context);
+	record->xattr_index = inode_data_xattr_index(&context);
+	record->number = inode_data_number(&context);
+	if (record->type == HSQS_INODE_TYPE_FILE) {
+		record->block_sizes = get_size_info(&context, 0);
+	}
+
+out:
+	hsqs_metablock_stream_cleanup(&metablock);
+	return rv;
+}
+
+static int
+inode_record_dtor(void *data) {
+	struct HsqsInodeRecord *record = data;
+
+	free(record->block_index.offsets);
+	pthread_mutex_destroy(&record->block_index_lock);
+	return hsqs_buffer_cleanup(&record->data);
+}
+
+static size_t
+inode_record_weight(const struct HsqsInodeRecord *record, struct Hsqs *hsqs) {
+	struct HsqsInodeContext context = {.record = record, .hsqs = hsqs};
+	size_t weight = sizeof(struct HsqsInodeRecord) +
+			hsqs_buffer_capacity(&record->data);
+	uint32_t block_count;
+
+	// account for the block index up front, it is built on first use.
+	if (record->type == HSQS_INODE_TYPE_FILE) {
+		block_count = hsqs_inode_file_block_count(&context);
+		weight += (block_count / HSQS_INODE_BLOCK_INDEX_STRIDE + 1) *
+				sizeof(uint64_t);
+	}
+	return weight;
+}
+
+int
+hsqs_inode_load_by_ref(
+		struct HsqsInodeContext *inode, struct Hsqs *hsqs, uint64_t inode_ref) {
+	int rv = 0;
+	struct HsqsShardedLruHashmap *cache = hsqs_inode_cache(hsqs);
+	struct HsqsRefCount *record_ref = NULL;
+	struct HsqsInodeRecord *record;
+
+	inode->hsqs = hsqs;
+
+	inode->record_ref = hsqs_sharded_lru_hashmap_acquire(cache, inode_ref);
+	if (inode->record_ref != NULL) {
+		inode->record = hsqs_ref_count_data(inode->record_ref);
+		return 0;
+	}
+	inode->record = NULL;
+
+	rv = hsqs_ref_count_new(
+			&record_ref, sizeof(struct HsqsInodeRecord), inode_record_dtor);
+	if (rv < 0) {
+		goto out;
+	}
+	record = hsqs_ref_count_retain(record_ref);
+	rv = pthread_mutex_init(&record->block_index_lock, NULL);
+	if (rv != 0) {
+		rv = -HSQS_ERROR_INODE_INIT;
+		goto out;
+	}
+	rv = inode_record_load(record, hsqs, inode_ref);
+	if (rv < 0) {
+		goto out;
+	}
+
+	rv = hsqs_sharded_lru_hashmap_put_sized(
+			cache, inode_ref, record_ref, inode_record_weight(record, hsqs));
+	if (rv < 0) {
+		goto out;
+	}
+
+	inode->record_ref = record_ref;
+	inode->record = record;
+	record_ref = NULL;
+
+out:
+	hsqs_ref_count_release(record_ref);
+	return rv;
+}
+
+enum HsqsInodeContextType
+hsqs_inode_type(const struct HsqsInodeContext *context) {
+	return context->record->type;
+}
+
+uint16_t
+hsqs_inode_permission(const struct HsqsInodeContext *context) {
+	return context->record->permission;
+}
+
+uint32_t
+hsqs_inode_uid(const struct HsqsInodeContext *context) {
+	return context->record->uid;
+}
+
+uint32_t
+hsqs_inode_gid(const struct HsqsInodeContext *context) {
+	return context->record->gid;
+}
+
+uint64_t
+hsqs_inode_file_size(const struct HsqsInodeContext *context) {
+	return context->record->file_size;
+}
+
+uint32_t
+hsqs_inode_modified_time(const struct HsqsInodeContext *context) {
+	return context->record->modified_time;
+}
+
+uint32_t
+hsqs_inode_hard_link_count(const struct HsqsInodeContext *context) {
+	return context->record->hard_link_count;
+}
+
+uint32_t
+hsqs_inode_xattr_index(const struct HsqsInodeContext *context) {
+	return context->record->xattr_index;
+}
+
+uint32_t
+hsqs_inode_number(const struct HsqsInodeContext *context) {
+	return context->record->number;
+}
+
 int
 hsqs_inode_xattr_iterator(
 		const struct HsqsInodeContext *inode,
@@ -682,7 +1131,10 @@ hsqs_inode_xattr_iterator(
 
 int
 hsqs_inode_cleanup(struct HsqsInodeContext *inode) {
-	return hsqs_metablock_stream_cleanup(&inode->metablock);
+	hsqs_ref_count_release(inode->record_ref);
+	inode->record_ref = NULL;
+	inode->record = NULL;
+	return 0;
 }
 
 void
@@ -31,8 +31,10 @@
  * @file         inode.h
  */
 
+#include "../primitive/buffer.h"
+#include "../primitive/ref_count.h"
 #include "../utils.h"
-#include "metablock_stream_context.h"
+#include <pthread.h>
 #include <stdint.h>
 #include <sys/types.h>
 
@@ -43,10 +45,17 @@
 #define HSQS_INODE_NO_FRAGMENT 0xFFFFFFFF
 #define HSQS_INODE_NO_XATTR 0xFFFFFFFF
 
+// The block index stores every HSQS_INODE_BLOCK_INDEX_STRIDE-th offset of a
+// file. Seeking sums up the sizes of at most STRIDE - 1 blocks from there.
+#define HSQS_INODE_BLOCK_INDEX_STRIDE 64
+
+#define HSQS_INODE_CACHE_SIZE (4 * 1024 * 1024)
+
 struct Hsqs;
 
 struct HsqsSuperblockContext;
 struct HsqsInode;
+struct HsqsDatablockSize;
 struct HsqsInodeTable;
 struct HsqsDirectoryIterator;
 struct HsqsXattrIterator;
@@ -63,8 +72,35 @@ enum HsqsInodeContextType {
 	HSQS_INODE_TYPE_SOCKET,
 };
 
+struct HsqsInodeBlockIndex {
+	uint64_t *offsets;
+	uint32_t count;
+	uint32_t stride;
+};
+
+// Decoded attributes and the raw on-disk record of an inode, including its
+// block sizes, symlink target or directory index. Immutable once loaded and
+// shared through the inode cache of struct Hsqs, except for the block index,
+// which is built once under block_index_lock on first use.
+struct HsqsInodeRecord {
+	enum HsqsInodeContextType type;
+	uint16_t permission;
+	uint32_t uid;
+	uint32_t gid;
+	uint64_t file_size;
+	uint32_t modified_time;
+	uint32_t hard_link_count;
+	uint32_t xattr_index;
+	uint32_t number;
+	const struct HsqsDatablockSize *block_sizes;
+	struct HsqsBuffer data;
+	struct HsqsInodeBlockIndex block_index;
+	pthread_mutex_t block_index_lock;
+};
+
 struct HsqsInodeContext {
-	struct HsqsMetablockStreamContext metablock;
+	struct HsqsRefCount *record_ref;
+	const struct HsqsInodeRecord *record;
 	struct Hsqs *hsqs;
 };
 
@@ -90,6 +126,8 @@ uint32_t hsqs_inode_file_block_size(
 		const struct HsqsInodeContext *context, uint32_t index);
 bool hsqs_inode_file_block_is_compressed(
 		const struct HsqsInodeContext *context, int index);
+HSQS_NO_UNUSED int hsqs_inode_file_block_offset(
+		struct HsqsInodeContext *context, uint32_t index, uint64_t *offset);
 uint32_t
 hsqs_inode_file_fragment_block_index(const struct HsqsInodeContext *context);
 uint32_t
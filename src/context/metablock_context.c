@@ -114,40 +114,38 @@ buffer_dtor(void *data) {
 int
 hsqs_metablock_read(struct HsqsMetablockContext *context) {
 	int rv = 0;
-	struct HsqsSuperblockContext *superblock = hsqs_superblock(context->hsqs);
-	struct HsqsLruHashmap *cache = hsqs_metablock_cache(context->hsqs);
+	struct HsqsShardedLruHashmap *cache = hsqs_metablock_cache(context->hsqs);
 
 	if (context->buffer != NULL) {
 		return 0;
 	}
 
-	context->buffer_ref = hsqs_lru_hashmap_get(cache, context->address);
+	context->buffer_ref =
+			hsqs_sharded_lru_hashmap_acquire(cache, context->address);
 	if (context->buffer_ref == NULL) {
 		rv = hsqs_ref_count_new(
 				&context->buffer_ref, sizeof(struct HsqsBuffer), buffer_dtor);
 		if (rv < 0) {
 			goto out;
 		}
-		if (rv < 0) {
-			goto out;
-		}
 		context->buffer = hsqs_ref_count_retain(context->buffer_ref);
-		rv = hsqs_buffer_init(
-				context->buffer, hsqs_superblock_compression_id(superblock),
-				HSQS_METABLOCK_BLOCK_SIZE);
+		rv = hsqs_block_buffer_init(
+				context->hsqs, context->buffer, HSQS_METABLOCK_BLOCK_SIZE);
 		if (rv < 0) {
 			goto out;
 		}
-		rv = hsqs_lru_hashmap_put(cache, context->address, context->buffer_ref);
+		rv = read_buffer(context, context->buffer);
 		if (rv < 0) {
 			goto out;
 		}
-		rv = read_buffer(context, context->buffer);
+		rv = hsqs_sharded_lru_hashmap_put_sized(
+				cache, context->address, context->buffer_ref,
+				hsqs_buffer_capacity(context->buffer));
 		if (rv < 0) {
 			goto out;
 		}
 	} else {
-		context->buffer = hsqs_ref_count_retain(context->buffer_ref);
+		context->buffer = hsqs_ref_count_data(context->buffer_ref);
 	}
 
 out:
@@ -173,6 +171,8 @@ hsqs_metablock_to_buffer(
 int
 hsqs_metablock_cleanup(struct HsqsMetablockContext *context) {
 	hsqs_ref_count_release(context->buffer_ref);
+	context->buffer_ref = NULL;
+	context->buffer = NULL;
 	hsqs_mapping_unmap(&context->mapping);
 	return 0;
 }
@@ -41,6 +41,7 @@
 #define METABLOCK_CONTEXT_H
 
 #define HSQS_METABLOCK_BLOCK_SIZE 8192
+#define HSQS_METABLOCK_CACHE_SIZE (2 * 1024 * 1024)
 
 struct Hsqs;
 
@@ -41,6 +41,49 @@
 #include "superblock_context.h"
 #include <stdint.h>
 
+static void
+release_block(struct HsqsMetablockStreamContext *context) {
+	hsqs_ref_count_release(context->block_ref);
+	context->block_ref = NULL;
+	context->block = NULL;
+}
+
+// Reads the header of the metablock at address to find the address of the
+// following one. If block_ref is not NULL, the decompressed metablock is
+// retained from the metablock cache as well.
+static int
+load_block(
+		struct HsqsMetablockStreamContext *context, uint64_t address,
+		struct HsqsRefCount **block_ref, uint64_t *next_address) {
+	int rv = 0;
+	struct HsqsMetablockContext metablock = {0};
+	uint32_t metablock_size;
+
+	rv = hsqs_metablock_init(&metablock, context->hsqs, address);
+	if (rv < 0) {
+		goto out;
+	}
+	metablock_size =
+			HSQS_SIZEOF_METABLOCK + hsqs_metablock_compressed_size(&metablock);
+	if (ADD_OVERFLOW(address, metablock_size, next_address)) {
+		rv = -HSQS_ERROR_INTEGER_OVERFLOW;
+		goto out;
+	}
+
+	if (block_ref != NULL) {
+		rv = hsqs_metablock_read(&metablock);
+		if (rv < 0) {
+			goto out;
+		}
+		*block_ref = metablock.buffer_ref;
+		hsqs_ref_count_retain(*block_ref);
+	}
+
+out:
+	hsqs_metablock_cleanup(&metablock);
+	return rv;
+}
+
 HSQS_NO_UNUSED int
 hsqs_metablock_stream_init(
 		struct HsqsMetablockStreamContext *context, struct Hsqs *hsqs,
@@ -51,7 +94,7 @@ hsqs_metablock_stream_init(
 
 	context->hsqs = hsqs;
 	context->base_address = address;
-	rv = hsqs_metablock_stream_seek(context, address, 0);
+	rv = hsqs_metablock_stream_seek(context, 0, 0);
 	if (rv < 0) {
 		goto out;
 	}
@@ -75,55 +118,86 @@ int
 hsqs_metablock_stream_seek(
 		struct HsqsMetablockStreamContext *context, uint64_t address_offset,
 		uint32_t buffer_offset) {
-	int rv = 0;
-	hsqs_buffer_cleanup(&context->buffer);
-	struct HsqsSuperblockContext *superblock = hsqs_superblock(context->hsqs);
-
+	release_block(context);
 	if (ADD_OVERFLOW(
 				context->base_address, address_offset,
 				&context->current_address)) {
-		rv = -HSQS_ERROR_INTEGER_OVERFLOW;
-		goto out;
+		return -HSQS_ERROR_INTEGER_OVERFLOW;
 	}
-	context->buffer_offset = buffer_offset;
+	context->buffer_offset = 0;
 
-	enum HsqsSuperblockCompressionId compression_id =
-			hsqs_superblock_compression_id(superblock);
-	rv = hsqs_buffer_init(
-			&context->buffer, compression_id, HSQS_METABLOCK_BLOCK_SIZE);
-	if (rv < 0) {
-		goto out;
+	return hsqs_metablock_stream_skip(context, buffer_offset);
+}
+
+int
+hsqs_metablock_stream_skip(
+		struct HsqsMetablockStreamContext *context, uint64_t size) {
+	int rv = 0;
+	uint64_t offset;
+
+	if (ADD_OVERFLOW(context->buffer_offset, size, &offset)) {
+		return -HSQS_ERROR_INTEGER_OVERFLOW;
 	}
+	hsqs_buffer_reset(&context->buffer);
+
+	// All but the last metablock of a table hold exactly
+	// HSQS_METABLOCK_BLOCK_SIZE bytes, so skipped metablocks do not need to
+	// be decompressed.
+	while (offset >= HSQS_METABLOCK_BLOCK_SIZE) {
+		release_block(context);
+		rv = load_block(
+				context, context->current_address, NULL,
+				&context->current_address);
+		if (rv < 0) {
+			return rv;
+		}
+		offset -= HSQS_METABLOCK_BLOCK_SIZE;
+	}
+	context->buffer_offset = offset;
 
-out:
 	return rv;
 }
 
 static int
-add_block(struct HsqsMetablockStreamContext *context) {
+assemble(struct HsqsMetablockStreamContext *context, uint64_t size) {
 	int rv = 0;
-	struct HsqsMetablockContext metablock = {0};
-	uint64_t address = context->current_address;
-	uint32_t metablock_size;
+	struct HsqsRefCount *block_ref = NULL;
+	const struct HsqsBuffer *block = context->block;
+	size_t block_size = hsqs_buffer_size(block);
 
-	rv = hsqs_metablock_init(&metablock, context->hsqs, address);
-	if (rv < 0) {
-		goto out;
-	}
-	metablock_size =
-			HSQS_SIZEOF_METABLOCK + hsqs_metablock_compressed_size(&metablock);
-	if (ADD_OVERFLOW(address, metablock_size, &context->current_address)) {
-		rv = -HSQS_ERROR_INTEGER_OVERFLOW;
-		goto out;
+	if (hsqs_buffer_size(&context->buffer) == 0) {
+		if (context->buffer_offset > block_size) {
+			return -HSQS_ERROR_STREAM_NOT_ENOUGH_BYTES;
+		}
+		// a skip inside of the current block keeps it, but drops the
+		// blocks copied after it.
+		context->next_address = context->block_end_address;
+		rv = hsqs_buffer_append(
+				&context->buffer,
+				&hsqs_buffer_data(block)[context->buffer_offset],
+				block_size - context->buffer_offset);
+		if (rv < 0) {
+			return rv;
+		}
 	}
 
-	rv = hsqs_metablock_to_buffer(&metablock, &context->buffer);
-	if (rv < 0) {
-		goto out;
+	while (hsqs_buffer_size(&context->buffer) < size) {
+		rv = load_block(
+				context, context->next_address, &block_ref,
+				&context->next_address);
+		if (rv < 0) {
+			return rv;
+		}
+		block = hsqs_ref_count_data(block_ref);
+		rv = hsqs_buffer_append(
+				&context->buffer, hsqs_buffer_data(block),
+				hsqs_buffer_size(block));
+		hsqs_ref_count_release(block_ref);
+		if (rv < 0) {
+			return rv;
+		}
 	}
 
-out:
-	hsqs_metablock_cleanup(&metablock);
 	return rv;
 }
 
@@ -131,19 +205,30 @@ HSQS_NO_UNUSED int
 hsqs_metablock_stream_more(
 		struct HsqsMetablockStreamContext *context, uint64_t size) {
 	int rv = 0;
-	while (hsqs_metablock_stream_size(context) < size) {
-		rv = add_block(context);
+
+	if (context->block == NULL) {
+		rv = load_block(
+				context, context->current_address, &context->block_ref,
+				&context->block_end_address);
 		if (rv < 0) {
 			return rv;
 		}
+		context->block = hsqs_ref_count_data(context->block_ref);
 	}
-	return rv;
+	if (hsqs_metablock_stream_size(context) >= size) {
+		return 0;
+	}
+
+	// Only windows that straddle a metablock boundary are copied.
+	return assemble(context, size);
 }
 
 const uint8_t *
 hsqs_metablock_stream_data(const struct HsqsMetablockStreamContext *context) {
-	if (hsqs_metablock_stream_size(context) > 0) {
-		return &hsqs_buffer_data(&context->buffer)[context->buffer_offset];
+	if (hsqs_buffer_size(&context->buffer) > 0) {
+		return hsqs_buffer_data(&context->buffer);
+	} else if (hsqs_metablock_stream_size(context) > 0) {
+		return &hsqs_buffer_data(context->block)[context->buffer_offset];
 	} else {
 		return NULL;
 	}
@@ -152,9 +237,17 @@ hsqs_metablock_stream_data(const struct HsqsMetablockStreamContext *context) {
 size_t
 hsqs_metablock_stream_size(const struct HsqsMetablockStreamContext *context) {
 	size_t buffer_size = hsqs_buffer_size(&context->buffer);
+	size_t block_size;
+
+	if (buffer_size > 0) {
+		return buffer_size;
+	} else if (context->block == NULL) {
+		return 0;
+	}
 
-	if (buffer_size > context->buffer_offset) {
-		return buffer_size - context->buffer_offset;
+	block_size = hsqs_buffer_size(context->block);
+	if (block_size > context->buffer_offset) {
+		return block_size - context->buffer_offset;
 	} else {
 		return 0;
 	}
@@ -162,6 +255,7 @@ hsqs_metablock_stream_size(const struct HsqsMetablockStreamContext *context) {
 
 int
 hsqs_metablock_stream_cleanup(struct HsqsMetablockStreamContext *context) {
+	release_block(context);
 	hsqs_buffer_cleanup(&context->buffer);
 	return 0;
 }
@@ -32,17 +32,29 @@
  */
 
 #include "../primitive/buffer.h"
+#include "../primitive/ref_count.h"
 #include <stdint.h>
 
 #ifndef METABLOCK_STREAM_CONTEXT_H
 
 #define METABLOCK_STREAM_CONTEXT_H
 
+// A window into a metadata table. Windows inside of a single metablock
+// point directly into the metablock cache, only windows that straddle
+// metablock boundaries are copied into buffer.
 struct HsqsMetablockStreamContext {
 	struct Hsqs *hsqs;
+	// Cached metablock that contains the start of the window.
+	struct HsqsRefCount *block_ref;
+	const struct HsqsBuffer *block;
 	struct HsqsBuffer buffer;
 	uint64_t base_address;
+	// Address of the metablock that contains the start of the window.
 	uint64_t current_address;
+	// Address of the metablock following the one at current_address.
+	uint64_t block_end_address;
+	// Address of the metablock following the ones copied into buffer.
+	uint64_t next_address;
 	uint16_t buffer_offset;
 };
 
@@ -57,6 +69,9 @@ HSQS_NO_UNUSED int hsqs_metablock_stream_seek(
 		struct HsqsMetablockStreamContext *context, uint64_t address_offset,
 		uint32_t buffer_offset);
 
+HSQS_NO_UNUSED int hsqs_metablock_stream_skip(
+		struct HsqsMetablockStreamContext *context, uint64_t size);
+
 HSQS_NO_UNUSED int hsqs_metablock_stream_more(
 		struct HsqsMetablockStreamContext *context, uint64_t size);
 
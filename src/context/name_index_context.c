@@ -0,0 +1,327 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright (c) 2022, Enno Boland <g@s01.de>                                 *
+ *                                                                            *
+ * Redistribution and use in source and binary forms, with or without         *
+ * modification, are permitted provided that the following conditions are     *
+ * met:                                                                       *
+ *                                                                            *
+ * * Redistributions of source code must retain the above copyright notice,   *
+ *   this list of conditions and the following disclaimer.                    *
+ * * Redistributions in binary form must reproduce the above copyright        *
+ *   notice, this list of conditions and the following disclaimer in the      *
+ *   documentation and/or other materials provided with the distribution.     *
+ *                                                                            *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS    *
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,  *
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR     *
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR          *
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,      *
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,        *
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR         *
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF     *
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING       *
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS         *
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.               *
+ *                                                                            *
+ ******************************************************************************/
+
+/**
+ * @author       Enno Boland (mail@eboland.de)
+ * @file         name_index_context.c
+ */
+
+#include "name_index_context.h"
+#include "../error.h"
+#include "../hsqs.h"
+#include "../iterator/directory_iterator.h"
+#include "metablock_context.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct HsqsNameIndexEntry {
+	uint64_t hash;
+	uint64_t inode_ref;
+	uint32_t name_offset;
+	uint32_t name_size;
+	enum HsqsInodeContextType type;
+};
+
+static const struct HsqsNameIndexEntry *
+get_entries(const struct HsqsNameIndex *index) {
+	return (const struct HsqsNameIndexEntry *)hsqs_buffer_data(
+			&index->entries);
+}
+
+static size_t
+entry_count(const struct HsqsNameIndex *index) {
+	return hsqs_buffer_size(&index->entries) /
+			sizeof(struct HsqsNameIndexEntry);
+}
+
+static int
+index_dtor(void *data) {
+	struct HsqsNameIndex *index = data;
+
+	free(index->slots);
+	hsqs_buffer_cleanup(&index->entries);
+	hsqs_buffer_cleanup(&index->names);
+	return 0;
+}
+
+static int
+add_entry(
+		struct HsqsNameIndex *index, const struct HsqsDirectoryIterator *iter) {
+	int rv = 0;
+	const char *name = hsqs_directory_iterator_name(iter);
+	size_t name_size = hsqs_directory_iterator_name_size(iter);
+	struct HsqsNameIndexEntry entry = {
+			.hash = hsqs_hash(HSQS_HASH_INIT, name, name_size),
+			.inode_ref = hsqs_directory_iterator_inode_ref(iter),
+			.name_offset = hsqs_buffer_size(&index->names),
+			.name_size = name_size,
+			.type = hsqs_directory_iterator_inode_type(iter),
+	};
+
+	if (hsqs_buffer_size(&index->names) > UINT32_MAX - name_size) {
+		return -HSQS_ERROR_INTEGER_OVERFLOW;
+	}
+	rv = hsqs_buffer_append(&index->names, (const uint8_t *)name, name_size);
+	if (rv < 0) {
+		return rv;
+	}
+	return hsqs_buffer_append(
+			&index->entries, (const uint8_t *)&entry, sizeof(entry));
+}
+
+static int
+build_slots(struct HsqsNameIndex *index) {
+	const struct HsqsNameIndexEntry *entries = get_entries(index);
+	size_t count = entry_count(index);
+	size_t mask;
+
+	if (count >= UINT32_MAX) {
+		return -HSQS_ERROR_INTEGER_OVERFLOW;
+	}
+	// keep the load factor at or below 1/2
+	index->slot_count = 1;
+	while (index->slot_count < count * 2) {
+		index->slot_count <<= 1;
+	}
+	index->slots = calloc(index->slot_count, sizeof(uint32_t));
+	if (index->slots == NULL) {
+		return -HSQS_ERROR_MALLOC_FAILED;
+	}
+
+	// slots store the entry index + 1, so 0 marks an empty slot.
+	mask = index->slot_count - 1;
+	for (size_t i = 0; i < count; i++) {
+		size_t slot = entries[i].hash & mask;
+		while (index->slots[slot] != 0) {
+			slot = (slot + 1) & mask;
+		}
+		index->slots[slot] = i + 1;
+	}
+	return 0;
+}
+
+static int
+build_index(
+		struct HsqsNameIndex *index, struct Hsqs *hsqs, uint64_t directory_ref) {
+	int rv = 0;
+	struct HsqsInodeContext inode = {0};
+	struct HsqsDirectoryIterator iter = {0};
+
+	rv = hsqs_buffer_init(&index->entries, HSQS_COMPRESSION_NONE, 0);
+	if (rv < 0) {
+		goto out;
+	}
+	rv = hsqs_buffer_init(&index->names, HSQS_COMPRESSION_NONE, 0);
+	if (rv < 0) {
+		goto out;
+	}
+
+	rv = hsqs_inode_load_by_ref(&inode, hsqs, directory_ref);
+	if (rv < 0) {
+		goto out;
+	}
+	rv = hsqs_directory_iterator_init(&iter, &inode);
+	if (rv < 0) {
+		goto out;
+	}
+	while ((rv = hsqs_directory_iterator_next(&iter)) > 0) {
+		rv = add_entry(index, &iter);
+		if (rv < 0) {
+			goto out;
+		}
+	}
+	if (rv < 0) {
+		goto out;
+	}
+
+	rv = build_slots(index);
+
+out:
+	hsqs_directory_iterator_cleanup(&iter);
+	hsqs_inode_cleanup(&inode);
+	return rv;
+}
+
+static size_t
+index_weight(const struct HsqsNameIndex *index) {
+	return sizeof(struct HsqsNameIndex) +
+			index->slot_count * sizeof(uint32_t) +
+			hsqs_buffer_capacity(&index->entries) +
+			hsqs_buffer_capacity(&index->names);
+}
+
+static int
+index_build(
+		struct HsqsNameIndexContext *context, struct Hsqs *hsqs,
+		uint64_t directory_ref) {
+	int rv = 0;
+	struct HsqsShardedLruHashmap *cache = hsqs_name_index_cache(hsqs);
+	struct HsqsRefCount *index_ref = NULL;
+	struct HsqsNameIndex *index;
+
+	rv = hsqs_ref_count_new(
+			&index_ref, sizeof(struct HsqsNameIndex), index_dtor);
+	if (rv < 0) {
+		goto out;
+	}
+	index = hsqs_ref_count_retain(index_ref);
+	rv = build_index(index, hsqs, directory_ref);
+	if (rv < 0) {
+		goto out;
+	}
+
+	rv = hsqs_sharded_lru_hashmap_put_sized(
+			cache, directory_ref, index_ref, index_weight(index));
+	if (rv < 0) {
+		goto out;
+	}
+
+	context->index_ref = index_ref;
+	context->index = index;
+	index_ref = NULL;
+
+out:
+	hsqs_ref_count_release(index_ref);
+	return rv;
+}
+
+// Returns the cached index, or NULL and the lookups counted so far if it
+// has not been built yet.
+static uint32_t
+index_acquire(
+		struct HsqsNameIndexContext *context, struct Hsqs *hsqs,
+		uint64_t directory_ref) {
+	struct HsqsShardedLruHashmap *cache = hsqs_name_index_cache(hsqs);
+	struct HsqsNameIndex *index;
+	uint32_t lookups = 0;
+
+	context->index = NULL;
+	context->index_ref = hsqs_sharded_lru_hashmap_acquire(cache, directory_ref);
+	if (context->index_ref == NULL) {
+		return 0;
+	}
+	index = hsqs_ref_count_data(context->index_ref);
+	if (index->slots != NULL) {
+		context->index = index;
+		return 0;
+	}
+	lookups = __atomic_add_fetch(&index->lookups, 1, __ATOMIC_RELAXED);
+	hsqs_name_index_cleanup(context);
+	return lookups;
+}
+
+int
+hsqs_name_index_init(
+		struct HsqsNameIndexContext *context, struct Hsqs *hsqs,
+		uint64_t directory_ref) {
+	index_acquire(context, hsqs, directory_ref);
+	if (context->index != NULL) {
+		return 0;
+	}
+	return index_build(context, hsqs, directory_ref);
+}
+
+int
+hsqs_name_index_init_counted(
+		struct HsqsNameIndexContext *context,
+		const struct HsqsInodeContext *directory, uint64_t directory_ref) {
+	int rv = 0;
+	struct Hsqs *hsqs = directory->hsqs;
+	struct HsqsShardedLruHashmap *cache = hsqs_name_index_cache(hsqs);
+	struct HsqsRefCount *counter_ref = NULL;
+	struct HsqsNameIndex *counter;
+	uint32_t min_lookups =
+			hsqs_inode_file_size(directory) / HSQS_METABLOCK_BLOCK_SIZE;
+	uint32_t lookups;
+
+	min_lookups = MAX(min_lookups, HSQS_NAME_INDEX_MIN_LOOKUPS);
+	lookups = index_acquire(context, hsqs, directory_ref);
+	if (context->index != NULL) {
+		return 0;
+	} else if (lookups >= min_lookups) {
+		return index_build(context, hsqs, directory_ref);
+	} else if (lookups > 0) {
+		return 0;
+	}
+
+	// first lookup, start counting.
+	rv = hsqs_ref_count_new(
+			&counter_ref, sizeof(struct HsqsNameIndex), index_dtor);
+	if (rv < 0) {
+		goto out;
+	}
+	counter = hsqs_ref_count_retain(counter_ref);
+	counter->lookups = 1;
+	rv = hsqs_sharded_lru_hashmap_put_sized(
+			cache, directory_ref, counter_ref, index_weight(counter));
+
+out:
+	hsqs_ref_count_release(counter_ref);
+	return rv;
+}
+
+int
+hsqs_name_index_lookup(
+		const struct HsqsNameIndexContext *context, const char *name,
+		size_t name_len, uint64_t *inode_ref,
+		enum HsqsInodeContextType *type) {
+	const struct HsqsNameIndex *index = context->index;
+	const struct HsqsNameIndexEntry *entries = get_entries(index);
+	const char *names = (const char *)hsqs_buffer_data(&index->names);
+	uint64_t hash = hsqs_hash(HSQS_HASH_INIT, name, name_len);
+	size_t mask = index->slot_count - 1;
+	size_t slot = hash & mask;
+
+	for (; index->slots[slot] != 0; slot = (slot + 1) & mask) {
+		const struct HsqsNameIndexEntry *entry =
+				&entries[index->slots[slot] - 1];
+		if (entry->hash == hash && entry->name_size == name_len &&
+			memcmp(&names[entry->name_offset], name, name_len) == 0) {
+			*inode_ref = entry->inode_ref;
+			if (type != NULL) {
+				*type = entry->type;
+			}
+			return 0;
+		}
+	}
+	return -HSQS_ERROR_NO_SUCH_FILE;
+}
+
+size_t
+hsqs_name_index_count(const struct HsqsNameIndexContext *context) {
+	return entry_count(context->index);
+}
+
+int
+hsqs_name_index_cleanup(struct HsqsNameIndexContext *context) {
+	hsqs_ref_count_release(context->index_ref);
+	context->index_ref = NULL;
+	context->index = NULL;
+	return 0;
+}
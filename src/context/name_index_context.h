@@ -0,0 +1,85 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright (c) 2022, Enno Boland <g@s01.de>                                 *
+ *                                                                            *
+ * Redistribution and use in source and binary forms, with or without         *
+ * modification, are permitted provided that the following conditions are     *
+ * met:                                                                       *
+ *                                                                            *
+ * * Redistributions of source code must retain the above copyright notice,   *
+ *   this list of conditions and the following disclaimer.                    *
+ * * Redistributions in binary form must reproduce the above copyright        *
+ *   notice, this list of conditions and the following disclaimer in the      *
+ *   documentation and/or other materials provided with the distribution.     *
+ *                                                                            *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS    *
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,  *
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR     *
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR          *
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,      *
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,        *
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR         *
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF     *
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING       *
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS         *
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.               *
+ *                                                                            *
+ ******************************************************************************/
+
+/**
+ * @author       Enno Boland (mail@eboland.de)
+ * @file         name_index_context.h
+ */
+
+#include "../primitive/buffer.h"
+#include "../primitive/ref_count.h"
+#include "../utils.h"
+#include "inode_context.h"
+#include <stdint.h>
+
+#ifndef NAME_INDEX_CONTEXT_H
+
+#define NAME_INDEX_CONTEXT_H
+
+// Holds the index of a directory with 100000 entries.
+#define HSQS_NAME_INDEX_CACHE_SIZE (16 * 1024 * 1024)
+// Directories are searched at least this often before they are indexed.
+#define HSQS_NAME_INDEX_MIN_LOOKUPS 2
+
+struct Hsqs;
+
+// Hash table over all entries of one directory. Built by scanning the
+// directory once and shared through the name index cache of struct Hsqs.
+// Until then, the cache holds an entry without slots that counts the
+// lookups in the directory.
+struct HsqsNameIndex {
+	uint32_t lookups;
+	size_t slot_count;
+	uint32_t *slots;
+	struct HsqsBuffer entries;
+	struct HsqsBuffer names;
+};
+
+struct HsqsNameIndexContext {
+	struct HsqsRefCount *index_ref;
+	const struct HsqsNameIndex *index;
+};
+
+HSQS_NO_UNUSED int hsqs_name_index_init(
+		struct HsqsNameIndexContext *context, struct Hsqs *hsqs,
+		uint64_t directory_ref);
+// Counts a lookup in the directory and only builds its index once the
+// directory has been searched about as often as it has metablocks, so the
+// full scan costs no more than the lookups it replaces. context->index is
+// NULL until then.
+HSQS_NO_UNUSED int hsqs_name_index_init_counted(
+		struct HsqsNameIndexContext *context,
+		const struct HsqsInodeContext *directory, uint64_t directory_ref);
+HSQS_NO_UNUSED int hsqs_name_index_lookup(
+		const struct HsqsNameIndexContext *context, const char *name,
+		size_t name_len, uint64_t *inode_ref,
+		enum HsqsInodeContextType *type);
+size_t hsqs_name_index_count(const struct HsqsNameIndexContext *context);
+int hsqs_name_index_cleanup(struct HsqsNameIndexContext *context);
+
+#endif /* end of include guard NAME_INDEX_CONTEXT_H */
@@ -134,6 +134,12 @@ hsqs_error_str(int error_code) {
 		return "Mapper init error";
 	case HSQS_ERROR_MAPPER_MAP:
 		return "Mapper mapping error";
+	case HSQS_ERROR_WORKER_POOL_INIT:
+		return "Worker pool init error";
+	case HSQS_ERROR_WORKER_POOL_FULL:
+		return "Worker pool queue full";
+	case HSQS_ERROR_UNSUPPORTED:
+		return "Not supported by this build";
 	case HSQS_ERROR_COMPRESSION_UNKNOWN:
 		return "Compression unkown";
 	case HSQS_ERROR_TODO:
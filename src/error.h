@@ -78,6 +78,9 @@ enum HsqsError {
 	HSQS_ERROR_METABLOCK_TOO_BIG,
 	HSQS_ERROR_MAPPER_INIT,
 	HSQS_ERROR_MAPPER_MAP,
+	HSQS_ERROR_WORKER_POOL_INIT,
+	HSQS_ERROR_WORKER_POOL_FULL,
+	HSQS_ERROR_UNSUPPORTED,
 	HSQS_ERROR_TODO,
 };
 
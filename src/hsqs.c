@@ -33,6 +33,7 @@
 
 #include "hsqs.h"
 #include "compression/compression.h"
+#include <string.h>
 
 static const uint64_t NO_SEGMENT = 0xFFFFFFFFFFFFFFFF;
 
@@ -48,29 +49,154 @@ enum InitializedBitmap {
 
 static bool
 is_initialized(const struct Hsqs *hsqs, enum InitializedBitmap mask) {
-	return hsqs->initialized & mask;
+	return __atomic_load_n(&hsqs->initialized, __ATOMIC_ACQUIRE) & mask;
 }
 
+// Runs init_fn exactly once per mask, even if several threads request the
+// same lazily initialized part of the archive at the same time. A failed
+// initialization is retried on the next request.
 static int
-init(struct Hsqs *hsqs) {
+initialize_once(
+		struct Hsqs *hsqs, enum InitializedBitmap mask,
+		int (*init_fn)(struct Hsqs *)) {
 	int rv = 0;
 
+	if (is_initialized(hsqs, mask)) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&hsqs->initialize_lock);
+	if (!is_initialized(hsqs, mask)) {
+		rv = init_fn(hsqs);
+		if (rv >= 0) {
+			__atomic_fetch_or(&hsqs->initialized, mask, __ATOMIC_RELEASE);
+		}
+	}
+	pthread_mutex_unlock(&hsqs->initialize_lock);
+	return rv;
+}
+
+static void
+init_options(struct Hsqs *hsqs, const struct HsqsOptions *options) {
+	static const struct HsqsOptions default_options = {0};
+	struct HsqsOptions *target = &hsqs->options;
+
+	if (options == NULL) {
+		options = &default_options;
+	}
+	*target = *options;
+	if (target->metablock_cache_size == 0) {
+		target->metablock_cache_size = HSQS_METABLOCK_CACHE_SIZE;
+	}
+	if (target->datablock_cache_size == 0) {
+		target->datablock_cache_size = HSQS_DATABLOCK_CACHE_SIZE;
+	}
+	if (target->fragment_cache_size == 0) {
+		target->fragment_cache_size = HSQS_FRAGMENT_TABLE_CACHE_SIZE;
+	}
+	if (target->dentry_cache_entries == 0) {
+		target->dentry_cache_entries = HSQS_DENTRY_CACHE_ENTRIES;
+	}
+	if (target->name_index_cache_size == 0) {
+		target->name_index_cache_size = HSQS_NAME_INDEX_CACHE_SIZE;
+	}
+	if (target->inode_cache_size == 0) {
+		target->inode_cache_size = HSQS_INODE_CACHE_SIZE;
+	}
+	if (target->cache_shards == 0) {
+		target->cache_shards = HSQS_CACHE_SHARDS;
+	}
+	if (target->parallel_read_min_blocks == 0) {
+		target->parallel_read_min_blocks = HSQS_PARALLEL_READ_MIN_BLOCKS;
+	}
+}
+
+static int
+init_lock(struct Hsqs *hsqs) {
+	int rv = 0;
+	pthread_mutexattr_t attr;
+
+	rv = pthread_mutexattr_init(&attr);
+	if (rv != 0) {
+		return -rv;
+	}
+	// Initializing one part may need another one, e.g. tables need the
+	// table mapper.
+	rv = pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	if (rv == 0) {
+		rv = pthread_mutex_init(&hsqs->initialize_lock, &attr);
+	}
+	pthread_mutexattr_destroy(&attr);
+	return -rv;
+}
+
+static int
+init(struct Hsqs *hsqs, const struct HsqsOptions *options) {
+	int rv = 0;
+
+	init_options(hsqs, options);
+
+	rv = init_lock(hsqs);
+	if (rv < 0) {
+		goto out;
+	}
+
 	rv = hsqs_superblock_init(&hsqs->superblock, &hsqs->mapper);
 	if (rv < 0) {
 		goto out;
 	}
 
-	rv = hsqs_lru_hashmap_init(&hsqs->metablock_cache, 17);
+	rv = hsqs_sharded_lru_hashmap_init(
+			&hsqs->metablock_cache, hsqs->options.cache_shards,
+			hsqs->options.metablock_cache_entries,
+			hsqs->options.metablock_cache_size);
+	if (rv < 0) {
+		goto out;
+	}
+
+	rv = hsqs_sharded_lru_hashmap_init(
+			&hsqs->datablock_cache, hsqs->options.cache_shards, 0,
+			hsqs->options.datablock_cache_size);
+	if (rv < 0) {
+		goto out;
+	}
+
+	rv = hsqs_dentry_cache_init(
+			&hsqs->dentry_cache, hsqs->options.cache_shards,
+			hsqs->options.dentry_cache_entries);
+	if (rv < 0) {
+		goto out;
+	}
+
+	rv = hsqs_sharded_lru_hashmap_init(
+			&hsqs->name_index_cache, 1, 0,
+			hsqs->options.name_index_cache_size);
+	if (rv < 0) {
+		goto out;
+	}
+
+	rv = hsqs_sharded_lru_hashmap_init(
+			&hsqs->inode_cache, hsqs->options.cache_shards, 0,
+			hsqs->options.inode_cache_size);
+	if (rv < 0) {
+		goto out;
+	}
+
+	rv = hsqs_worker_pool_init(
+			&hsqs->worker_pool, hsqs->options.worker_count,
+			HSQS_WORKER_POOL_JOBS);
 	if (rv < 0) {
 		goto out;
 	}
 
 	if (hsqs_superblock_has_compression_options(&hsqs->superblock)) {
-		hsqs->initialized |= INITIALIZED_COMPRESSION_OPTIONS;
 		rv = hsqs_compression_options_init(&hsqs->compression_options, hsqs);
 		if (rv < 0) {
 			goto out;
 		}
+		// Set only after loading: the options block itself is decompressed
+		// with the defaults of the compressor.
+		hsqs->initialized |= INITIALIZED_COMPRESSION_OPTIONS;
 	}
 
 out:
@@ -82,6 +208,13 @@ out:
 
 int
 hsqs_init(struct Hsqs *hsqs, const uint8_t *buffer, const size_t size) {
+	return hsqs_init_ex(hsqs, buffer, size, NULL);
+}
+
+int
+hsqs_init_ex(
+		struct Hsqs *hsqs, const uint8_t *buffer, const size_t size,
+		const struct HsqsOptions *options) {
 	int rv = 0;
 
 	rv = hsqs_mapper_init_static(&hsqs->mapper, buffer, size);
@@ -89,11 +222,17 @@ hsqs_init(struct Hsqs *hsqs, const uint8_t *buffer, const size_t size) {
 		return rv;
 	}
 
-	return init(hsqs);
+	return init(hsqs, options);
 }
 
 int
 hsqs_open(struct Hsqs *hsqs, const char *path) {
+	return hsqs_open_ex(hsqs, path, NULL);
+}
+
+int
+hsqs_open_ex(
+		struct Hsqs *hsqs, const char *path, const struct HsqsOptions *options) {
 	int rv = 0;
 
 	rv = hsqs_mapper_init_mmap(&hsqs->mapper, path);
@@ -101,7 +240,62 @@ hsqs_open(struct Hsqs *hsqs, const char *path) {
 		return rv;
 	}
 
-	return init(hsqs);
+	return init(hsqs, options);
+}
+
+int
+hsqs_open_url(struct Hsqs *hsqs, const char *url) {
+	return hsqs_open_url_ex(hsqs, url, NULL);
+}
+
+int
+hsqs_open_url_ex(
+		struct Hsqs *hsqs, const char *url, const struct HsqsOptions *options) {
+#ifdef CONFIG_CURL
+	int rv = 0;
+	struct HsqsCurlOptions curl_options = {0};
+
+	if (options != NULL) {
+		curl_options.handles = options->curl_handles;
+		curl_options.host_connections = options->curl_host_connections;
+		curl_options.chunk_size = options->curl_chunk_size;
+		curl_options.cache_size = options->curl_cache_size;
+		curl_options.cache_dir = options->curl_cache_dir;
+	}
+	rv = hsqs_mapper_init_curl(&hsqs->mapper, url, &curl_options);
+	if (rv < 0) {
+		return rv;
+	}
+
+	return init(hsqs, options);
+#else
+	(void)hsqs;
+	(void)url;
+	(void)options;
+	return -HSQS_ERROR_UNSUPPORTED;
+#endif
+}
+
+int
+hsqs_open_any(struct Hsqs *hsqs, const char *path) {
+	return hsqs_open_any_ex(hsqs, path, NULL);
+}
+
+int
+hsqs_open_any_ex(
+		struct Hsqs *hsqs, const char *path, const struct HsqsOptions *options) {
+	if (strstr(path, "://") != NULL) {
+		return hsqs_open_url_ex(hsqs, path, options);
+	}
+	return hsqs_open_ex(hsqs, path, options);
+}
+
+static int
+init_id_table(struct Hsqs *hsqs) {
+	return hsqs_table_init(
+			&hsqs->id_table, hsqs,
+			hsqs_superblock_id_table_start(&hsqs->superblock),
+			sizeof(uint32_t), hsqs_superblock_id_count(&hsqs->superblock));
 }
 
 int
@@ -112,20 +306,23 @@ hsqs_id_table(struct Hsqs *hsqs, struct HsqsTable **id_table) {
 		return -HSQS_ERROR_NO_XATTR_TABLE;
 	}
 
-	if (!is_initialized(hsqs, INITIALIZED_ID_TABLE)) {
-		rv = hsqs_table_init(
-				&hsqs->id_table, hsqs, table_start, sizeof(uint32_t),
-				hsqs_superblock_id_count(&hsqs->superblock));
-		if (rv < 0) {
-			goto out;
-		}
-		hsqs->initialized |= INITIALIZED_ID_TABLE;
+	rv = initialize_once(hsqs, INITIALIZED_ID_TABLE, init_id_table);
+	if (rv < 0) {
+		goto out;
 	}
 	*id_table = &hsqs->id_table;
 out:
 	return rv;
 }
 
+static int
+init_export_table(struct Hsqs *hsqs) {
+	return hsqs_table_init(
+			&hsqs->export_table, hsqs,
+			hsqs_superblock_export_table_start(&hsqs->superblock),
+			sizeof(uint64_t), hsqs_superblock_inode_count(&hsqs->superblock));
+}
+
 int
 hsqs_export_table(struct Hsqs *hsqs, struct HsqsTable **export_table) {
 	int rv = 0;
@@ -135,20 +332,20 @@ hsqs_export_table(struct Hsqs *hsqs, struct HsqsTable **export_table) {
 		return -HSQS_ERROR_NO_XATTR_TABLE;
 	}
 
-	if (!(hsqs->initialized & INITIALIZED_EXPORT_TABLE)) {
-		rv = hsqs_table_init(
-				&hsqs->export_table, hsqs, table_start, sizeof(uint64_t),
-				hsqs_superblock_inode_count(&hsqs->superblock));
-		if (rv < 0) {
-			goto out;
-		}
-		hsqs->initialized |= INITIALIZED_EXPORT_TABLE;
+	rv = initialize_once(hsqs, INITIALIZED_EXPORT_TABLE, init_export_table);
+	if (rv < 0) {
+		goto out;
 	}
 	*export_table = &hsqs->export_table;
 out:
 	return rv;
 }
 
+static int
+init_fragment_table(struct Hsqs *hsqs) {
+	return hsqs_fragment_table_init(&hsqs->fragment_table, hsqs);
+}
+
 int
 hsqs_fragment_table(
 		struct Hsqs *hsqs, struct HsqsFragmentTable **fragment_table) {
@@ -159,19 +356,21 @@ hsqs_fragment_table(
 		return -HSQS_ERROR_NO_XATTR_TABLE;
 	}
 
-	if (!is_initialized(hsqs, INITIALIZED_FRAGMENT_TABLE)) {
-		rv = hsqs_fragment_table_init(&hsqs->fragment_table, hsqs);
-
-		if (rv < 0) {
-			goto out;
-		}
-		hsqs->initialized |= INITIALIZED_FRAGMENT_TABLE;
+	rv = initialize_once(
+			hsqs, INITIALIZED_FRAGMENT_TABLE, init_fragment_table);
+	if (rv < 0) {
+		goto out;
 	}
 	*fragment_table = &hsqs->fragment_table;
 out:
 	return rv;
 }
 
+static int
+init_xattr_table(struct Hsqs *hsqs) {
+	return hsqs_xattr_table_init(&hsqs->xattr_table, hsqs);
+}
+
 int
 hsqs_xattr_table(struct Hsqs *hsqs, struct HsqsXattrTable **xattr_table) {
 	int rv = 0;
@@ -182,12 +381,9 @@ hsqs_xattr_table(struct Hsqs *hsqs, struct HsqsXattrTable **xattr_table) {
 		return -HSQS_ERROR_NO_XATTR_TABLE;
 	}
 
-	if (!(hsqs->initialized & INITIALIZED_XATTR_TABLE)) {
-		rv = hsqs_xattr_table_init(&hsqs->xattr_table, hsqs);
-		if (rv < 0) {
-			goto out;
-		}
-		hsqs->initialized |= INITIALIZED_XATTR_TABLE;
+	rv = initialize_once(hsqs, INITIALIZED_XATTR_TABLE, init_xattr_table);
+	if (rv < 0) {
+		goto out;
 	}
 	*xattr_table = &hsqs->xattr_table;
 out:
@@ -206,19 +402,39 @@ hsqs_compression_options(
 	}
 }
 
+int
+hsqs_block_buffer_init(
+		struct Hsqs *hsqs, struct HsqsBuffer *buffer, int block_size) {
+	int rv = 0;
+
+	rv = hsqs_buffer_init(
+			buffer, hsqs_superblock_compression_id(&hsqs->superblock),
+			block_size);
+	if (rv < 0) {
+		return rv;
+	}
+	if (is_initialized(hsqs, INITIALIZED_COMPRESSION_OPTIONS)) {
+		hsqs_buffer_set_compression_options(
+				buffer,
+				hsqs_compression_options_data(&hsqs->compression_options),
+				hsqs_compression_options_size(&hsqs->compression_options));
+	}
+	return rv;
+}
+
 struct HsqsSuperblockContext *
 hsqs_superblock(struct Hsqs *hsqs) {
 	return &hsqs->superblock;
 }
 
+const struct HsqsOptions *
+hsqs_options(struct Hsqs *hsqs) {
+	return &hsqs->options;
+}
+
 static int
-get_table_mapper(struct Hsqs *hsqs, struct HsqsMapper **table_mapper) {
+init_table_mapper(struct Hsqs *hsqs) {
 	int rv = 0;
-	if (is_initialized(hsqs, INITIALIZED_TABLE_MAPPER)) {
-		*table_mapper = &hsqs->table_mapper;
-		goto out;
-	}
-	*table_mapper = NULL;
 	struct HsqsSuperblockContext *superblock = hsqs_superblock(hsqs);
 	uint64_t inode_table_start = hsqs_superblock_inode_table_start(superblock);
 	uint64_t archive_size = hsqs_mapper_size(&hsqs->mapper);
@@ -228,6 +444,8 @@ get_table_mapper(struct Hsqs *hsqs, struct HsqsMapper **table_mapper) {
 
 	const uint64_t table_size = archive_size - inode_table_start;
 
+	// All tables live in this region. Remote archives fetch it with a
+	// single range request.
 	rv = hsqs_mapper_map(
 			&hsqs->table_map, &hsqs->mapper, inode_table_start, table_size);
 	if (rv < 0) {
@@ -236,15 +454,27 @@ get_table_mapper(struct Hsqs *hsqs, struct HsqsMapper **table_mapper) {
 	const uint8_t *table_data = hsqs_mapping_data(&hsqs->table_map);
 	rv = hsqs_mapper_init_static(&hsqs->table_mapper, table_data, table_size);
 	if (rv < 0) {
+		hsqs_mapping_unmap(&hsqs->table_map);
 		goto out;
 	}
-	*table_mapper = &hsqs->table_mapper;
-	hsqs->initialized |= INITIALIZED_TABLE_MAPPER;
 
 out:
 	return rv;
 }
 
+static int
+get_table_mapper(struct Hsqs *hsqs, struct HsqsMapper **table_mapper) {
+	int rv = 0;
+
+	*table_mapper = NULL;
+	rv = initialize_once(hsqs, INITIALIZED_TABLE_MAPPER, init_table_mapper);
+	if (rv < 0) {
+		return rv;
+	}
+	*table_mapper = &hsqs->table_mapper;
+	return rv;
+}
+
 int
 hsqs_request_map(
 		struct Hsqs *hsqs, struct HsqsMapping *mapping, uint64_t offset,
@@ -269,36 +499,68 @@ out:
 	return rv;
 }
 
-struct HsqsLruHashmap *
+struct HsqsShardedLruHashmap *
 hsqs_metablock_cache(struct Hsqs *hsqs) {
 	return &hsqs->metablock_cache;
 }
 
-const uint8_t *
-hsqs_trailing_bytes(struct Hsqs *hsqs) {
-	if (!is_initialized(hsqs, INITIALIZED_TRAILING_BYTES)) {
-		struct HsqsSuperblockContext *superblock = hsqs_superblock(hsqs);
-		uint64_t trailing_start = hsqs_superblock_bytes_used(superblock);
-		size_t archive_size = hsqs_mapper_size(&hsqs->mapper);
-		uint64_t trailing_size;
-
-		if (archive_size <= trailing_start) {
-			return NULL;
-		}
+struct HsqsShardedLruHashmap *
+hsqs_datablock_cache(struct Hsqs *hsqs) {
+	return &hsqs->datablock_cache;
+}
 
-		trailing_size = archive_size - trailing_start;
+struct HsqsDentryCache *
+hsqs_dentry_cache(struct Hsqs *hsqs) {
+	return &hsqs->dentry_cache;
+}
+
+struct HsqsShardedLruHashmap *
+hsqs_name_index_cache(struct Hsqs *hsqs) {
+	return &hsqs->name_index_cache;
+}
 
-		hsqs_request_map(
-				hsqs, &hsqs->trailing_map, trailing_start, trailing_size);
+struct HsqsShardedLruHashmap *
+hsqs_inode_cache(struct Hsqs *hsqs) {
+	return &hsqs->inode_cache;
+}
+
+struct HsqsWorkerPool *
+hsqs_worker_pool(struct Hsqs *hsqs) {
+	return &hsqs->worker_pool;
+}
+
+static int
+init_trailing_bytes(struct Hsqs *hsqs) {
+	struct HsqsSuperblockContext *superblock = hsqs_superblock(hsqs);
+	uint64_t trailing_start = hsqs_superblock_bytes_used(superblock);
+	size_t archive_size = hsqs_mapper_size(&hsqs->mapper);
+	uint64_t trailing_size;
+
+	if (archive_size <= trailing_start) {
+		return 0;
+	}
+
+	trailing_size = archive_size - trailing_start;
+
+	return hsqs_request_map(
+			hsqs, &hsqs->trailing_map, trailing_start, trailing_size);
+}
+
+const uint8_t *
+hsqs_trailing_bytes(struct Hsqs *hsqs) {
+	if (initialize_once(hsqs, INITIALIZED_TRAILING_BYTES, init_trailing_bytes) <
+				0 ||
+		hsqs_trailing_bytes_size(hsqs) == 0) {
+		return NULL;
 	}
 	return hsqs_mapping_data(&hsqs->trailing_map);
 }
 size_t
 hsqs_trailing_bytes_size(struct Hsqs *hsqs) {
-	if (!is_initialized(hsqs, INITIALIZED_TRAILING_BYTES)) {
-		if (hsqs_mapping_data(&hsqs->trailing_map) == NULL) {
-			return 0;
-		}
+	if (initialize_once(hsqs, INITIALIZED_TRAILING_BYTES, init_trailing_bytes) <
+				0 ||
+		hsqs->trailing_map.mapper == NULL) {
+		return 0;
 	}
 	return hsqs_mapping_size(&hsqs->trailing_map);
 }
@@ -307,6 +569,8 @@ int
 hsqs_cleanup(struct Hsqs *hsqs) {
 	int rv = 0;
 
+	// Pending jobs still use the caches and tables below.
+	hsqs_worker_pool_cleanup(&hsqs->worker_pool);
 	if (is_initialized(hsqs, INITIALIZED_ID_TABLE)) {
 		hsqs_table_cleanup(&hsqs->id_table);
 	}
@@ -322,13 +586,21 @@ hsqs_cleanup(struct Hsqs *hsqs) {
 	if (is_initialized(hsqs, INITIALIZED_COMPRESSION_OPTIONS)) {
 		hsqs_compression_options_cleanup(&hsqs->compression_options);
 	}
+	if (is_initialized(hsqs, INITIALIZED_TRAILING_BYTES)) {
+		hsqs_mapping_unmap(&hsqs->trailing_map);
+	}
 	if (is_initialized(hsqs, INITIALIZED_TABLE_MAPPER)) {
 		hsqs_mapper_cleanup(&hsqs->table_mapper);
 		hsqs_mapping_unmap(&hsqs->table_map);
 	}
-	hsqs_lru_hashmap_cleanup(&hsqs->metablock_cache);
+	hsqs_sharded_lru_hashmap_cleanup(&hsqs->metablock_cache);
+	hsqs_sharded_lru_hashmap_cleanup(&hsqs->datablock_cache);
+	hsqs_dentry_cache_cleanup(&hsqs->dentry_cache);
+	hsqs_sharded_lru_hashmap_cleanup(&hsqs->name_index_cache);
+	hsqs_sharded_lru_hashmap_cleanup(&hsqs->inode_cache);
 	hsqs_superblock_cleanup(&hsqs->superblock);
 	hsqs_mapper_cleanup(&hsqs->mapper);
+	pthread_mutex_destroy(&hsqs->initialize_lock);
 
 	return rv;
 }
@@ -32,14 +32,20 @@
  */
 
 #include "context/compression_options_context.h"
+#include "context/datablock_context.h"
+#include "context/name_index_context.h"
 #include "context/superblock_context.h"
 #include "error.h"
 #include "mapper/mapper.h"
+#include "primitive/dentry_cache.h"
+#include "primitive/sharded_lru_hashmap.h"
+#include "primitive/worker_pool.h"
 #include "table/fragment_table.h"
 #include "table/table.h"
 #include "table/xattr_table.h"
 #include "utils.h"
 
+#include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
 
@@ -47,9 +53,52 @@
 
 #define HSQS_H
 
+#define HSQS_CACHE_SHARDS 8
+#define HSQS_WORKER_POOL_JOBS 256
+#define HSQS_PARALLEL_READ_MIN_BLOCKS 4
+
+struct HsqsOptions {
+	// Limits of the decompressed block caches. 0 selects the default.
+	size_t metablock_cache_entries;
+	size_t metablock_cache_size;
+	size_t datablock_cache_size;
+	size_t fragment_cache_size;
+	// Maximum number of cached path lookups. 0 selects the default.
+	size_t dentry_cache_entries;
+	// Limit of the per directory name hash tables. The cache is not
+	// sharded, so a single index may use all of it. 0 selects the default.
+	size_t name_index_cache_size;
+	// Limit of the parsed inode records. 0 selects the default.
+	size_t inode_cache_size;
+	// Number of independently locked shards of the metablock, datablock,
+	// dentry and inode caches. 0 selects the default.
+	size_t cache_shards;
+	// Number of background threads prefetching data blocks for sequential
+	// reads and decompressing the blocks of large reads in parallel. 0
+	// disables both.
+	size_t worker_count;
+	// Reads spanning fewer data blocks are decompressed on the calling
+	// thread only. 0 selects the default.
+	size_t parallel_read_min_blocks;
+	// Tunables of images opened with hsqs_open_url(). 0 selects the
+	// defaults of the curl mapper.
+	size_t curl_handles;
+	size_t curl_host_connections;
+	size_t curl_chunk_size;
+	size_t curl_cache_size;
+	// Directory of a persistent cache of downloaded chunks. NULL disables
+	// the cache.
+	const char *curl_cache_dir;
+};
+
 struct Hsqs {
 	uint32_t error;
-	struct HsqsLruHashmap metablock_cache;
+	struct HsqsOptions options;
+	struct HsqsShardedLruHashmap metablock_cache;
+	struct HsqsShardedLruHashmap datablock_cache;
+	struct HsqsDentryCache dentry_cache;
+	struct HsqsShardedLruHashmap name_index_cache;
+	struct HsqsShardedLruHashmap inode_cache;
 	struct HsqsMapper mapper;
 	struct HsqsMapper table_mapper;
 	struct HsqsMapping table_map;
@@ -60,20 +109,45 @@ struct Hsqs {
 	struct HsqsFragmentTable fragment_table;
 	struct HsqsCompressionOptionsContext compression_options;
 	struct HsqsMapping trailing_map;
+	struct HsqsWorkerPool worker_pool;
+	// Guards the lazy initialization of the tables and mappings above.
+	pthread_mutex_t initialize_lock;
 	uint8_t initialized;
 };
 
 HSQS_NO_UNUSED int
 hsqs_init(struct Hsqs *hsqs, const uint8_t *buffer, const size_t size);
 
+HSQS_NO_UNUSED int hsqs_init_ex(
+		struct Hsqs *hsqs, const uint8_t *buffer, const size_t size,
+		const struct HsqsOptions *options);
+
 HSQS_NO_UNUSED int hsqs_open(struct Hsqs *hsqs, const char *path);
 
+HSQS_NO_UNUSED int hsqs_open_ex(
+		struct Hsqs *hsqs, const char *path, const struct HsqsOptions *options);
+
+// Return -HSQS_ERROR_UNSUPPORTED if the library is built without curl.
+HSQS_NO_UNUSED int hsqs_open_url(struct Hsqs *hsqs, const char *url);
+
+HSQS_NO_UNUSED int hsqs_open_url_ex(
+		struct Hsqs *hsqs, const char *url, const struct HsqsOptions *options);
+
+// Opens paths containing "://" with hsqs_open_url_ex(), others with
+// hsqs_open_ex().
+HSQS_NO_UNUSED int hsqs_open_any(struct Hsqs *hsqs, const char *path);
+
+HSQS_NO_UNUSED int hsqs_open_any_ex(
+		struct Hsqs *hsqs, const char *path, const struct HsqsOptions *options);
+
 int hsqs_request_map(
 		struct Hsqs *hsqs, struct HsqsMapping *mapping, uint64_t offset,
 		uint64_t size);
 
 struct HsqsSuperblockContext *hsqs_superblock(struct Hsqs *hsqs);
 
+const struct HsqsOptions *hsqs_options(struct Hsqs *hsqs);
+
 int hsqs_id_table(struct Hsqs *hsqs, struct HsqsTable **id_table);
 int hsqs_export_table(struct Hsqs *hsqs, struct HsqsTable **export_table);
 int hsqs_fragment_table(
@@ -82,7 +156,14 @@ int hsqs_xattr_table(struct Hsqs *hsqs, struct HsqsXattrTable **xattr_table);
 int hsqs_compression_options(
 		struct Hsqs *hsqs,
 		struct HsqsCompressionOptionsContext **compression_options);
-struct HsqsLruHashmap *hsqs_metablock_cache(struct Hsqs *hsqs);
+HSQS_NO_UNUSED int hsqs_block_buffer_init(
+		struct Hsqs *hsqs, struct HsqsBuffer *buffer, int block_size);
+struct HsqsShardedLruHashmap *hsqs_metablock_cache(struct Hsqs *hsqs);
+struct HsqsShardedLruHashmap *hsqs_datablock_cache(struct Hsqs *hsqs);
+struct HsqsDentryCache *hsqs_dentry_cache(struct Hsqs *hsqs);
+struct HsqsShardedLruHashmap *hsqs_name_index_cache(struct Hsqs *hsqs);
+struct HsqsShardedLruHashmap *hsqs_inode_cache(struct Hsqs *hsqs);
+struct HsqsWorkerPool *hsqs_worker_pool(struct Hsqs *hsqs);
 const uint8_t *hsqs_trailing_bytes(struct Hsqs *hsqs);
 size_t hsqs_trailing_bytes_size(struct Hsqs *hsqs);
 int hsqs_cleanup(struct Hsqs *hsqs);
@@ -41,8 +41,8 @@ static const uint64_t INODE_HEADER_SIZE =
 
 static const struct HsqsInode *
 get_inode(const struct HsqsInodeDirectoryIndexIterator *iterator) {
-	return (const struct HsqsInode *)hsqs_metablock_stream_data(
-			&iterator->inode->metablock);
+	return (const struct HsqsInode *)hsqs_buffer_data(
+			&iterator->inode->record->data);
 }
 
 // TODO: use hsqs_data_inode_directory_ext_index().
@@ -57,7 +57,10 @@ current_directory_index(
 static int
 directory_index_data_more(
 		struct HsqsInodeDirectoryIndexIterator *iterator, size_t size) {
-	return hsqs_metablock_stream_more(&iterator->inode->metablock, size);
+	if (size > hsqs_buffer_size(&iterator->inode->record->data)) {
+		return -HSQS_ERROR_STREAM_NOT_ENOUGH_BYTES;
+	}
+	return 0;
 }
 
 int
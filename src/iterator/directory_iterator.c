@@ -40,8 +40,23 @@
 #include "../hsqs.h"
 #include "directory_index_iterator.h"
 
+#include <stdlib.h>
 #include <string.h>
 
+// Orders names like mksquashfs sorts directory entries: bytewise, with a
+// name sorting before all names it is a prefix of.
+static int
+compare_name(
+		const char *name, size_t name_len, const char *other,
+		size_t other_len) {
+	int rv = memcmp(name, other, MIN(name_len, other_len));
+
+	if (rv != 0) {
+		return rv;
+	}
+	return (name_len > other_len) - (name_len < other_len);
+}
+
 static int
 directory_iterator_index_lookup(
 		struct HsqsDirectoryIterator *iterator, const char *name,
@@ -49,55 +64,88 @@ directory_iterator_index_lookup(
 	int rv = 0;
 	struct HsqsInodeDirectoryIndexIterator index_iterator = {0};
 	struct HsqsInodeContext *inode = iterator->inode;
+	hsqs_index_t *offsets = NULL;
+	size_t count;
+	size_t lower = 0;
+	size_t upper;
+	size_t middle;
 
+	iterator->remaining_entries = 0;
 	rv = hsqs_inode_directory_index_iterator_init(&index_iterator, inode);
 	if (rv < 0) {
+		// Not an extended directory, so there is no index to search.
 		return 0;
 	}
-	while ((rv = hsqs_inode_directory_index_iterator_next(&index_iterator)) >
-		   0) {
-		const char *index_name =
-				hsqs_inode_directory_index_iterator_name(&index_iterator);
-		uint32_t index_name_size =
-				hsqs_inode_directory_index_iterator_name_size(&index_iterator);
-
-		// BUG: the branch could be taken too early when the name is a prefix
-		if (strncmp(name, (char *)index_name,
-					MIN(index_name_size, name_len + 1)) < 0) {
-			break;
+	count = index_iterator.remaining_entries;
+	if (count == 0) {
+		return 0;
+	}
+
+	// Index entries have variable length, so their offsets are collected
+	// first to allow random access.
+	offsets = calloc(count, sizeof(hsqs_index_t));
+	if (offsets == NULL) {
+		return -HSQS_ERROR_MALLOC_FAILED;
+	}
+	for (size_t i = 0; i < count; i++) {
+		rv = hsqs_inode_directory_index_iterator_next(&index_iterator);
+		if (rv < 0) {
+			goto out;
 		}
+		offsets[i] = index_iterator.current_offset;
+	}
+	rv = 0;
+
+	// Find the last index entry that does not sort after name. Its
+	// directory header is the first one that can contain name.
+	upper = count;
+	while (lower < upper) {
+		middle = lower + (upper - lower) / 2;
+		index_iterator.current_offset = offsets[middle];
+		if (compare_name(
+					hsqs_inode_directory_index_iterator_name(&index_iterator),
+					hsqs_inode_directory_index_iterator_name_size(
+							&index_iterator),
+					name, name_len) <= 0) {
+			lower = middle + 1;
+		} else {
+			upper = middle;
+		}
+	}
+	if (lower > 0) {
+		index_iterator.current_offset = offsets[lower - 1];
 		iterator->next_offset =
 				hsqs_inode_directory_index_iterator_index(&index_iterator);
 	}
-	iterator->remaining_entries = 0;
-	return rv;
-}
 
-static const struct HsqsDirectoryFragment *
-directory_iterator_current_fragment(
-		const struct HsqsDirectoryIterator *iterator) {
-	const uint8_t *tmp = (const uint8_t *)iterator->fragments;
-	return (const struct HsqsDirectoryFragment
-					*)&tmp[iterator->current_fragment_offset];
+out:
+	free(offsets);
+	return rv;
 }
 
+// Moves the window of the metablock stream forward to offset and makes
+// sure that size bytes are loaded behind it.
 static int
-directory_data_more(struct HsqsDirectoryIterator *iterator, size_t size) {
-	int rv = hsqs_metablock_stream_more(&iterator->metablock, size);
-	if (rv < 0) {
-		return rv;
-	}
+directory_data_at(
+		struct HsqsDirectoryIterator *iterator, hsqs_index_t offset,
+		size_t size) {
+	int rv = 0;
 
-	iterator->fragments =
-			(struct HsqsDirectoryFragment *)hsqs_metablock_stream_data(
-					&iterator->metablock);
-	return 0;
+	if (offset > iterator->window_offset) {
+		rv = hsqs_metablock_stream_skip(
+				&iterator->metablock, offset - iterator->window_offset);
+		if (rv < 0) {
+			return rv;
+		}
+		iterator->window_offset = offset;
+	}
+	return hsqs_metablock_stream_more(&iterator->metablock, size);
 }
 
-static struct HsqsDirectoryEntry *
+static const struct HsqsDirectoryEntry *
 current_entry(const struct HsqsDirectoryIterator *iterator) {
-	const uint8_t *tmp = (const uint8_t *)iterator->fragments;
-	return (struct HsqsDirectoryEntry *)&tmp[iterator->current_offset];
+	return (const struct HsqsDirectoryEntry *)hsqs_metablock_stream_data(
+			&iterator->metablock);
 }
 
 int
@@ -110,16 +158,20 @@ hsqs_directory_iterator_lookup(
 	if (rv < 0)
 		return rv;
 
-	while (hsqs_directory_iterator_next(iterator) > 0) {
-		size_t entry_name_size = hsqs_directory_iterator_name_size(iterator);
-		const char *entry_name = hsqs_directory_iterator_name(iterator);
-		if (name_len != entry_name_size) {
-			continue;
-		}
-		if (strncmp(name, (char *)entry_name, entry_name_size) == 0) {
+	while ((rv = hsqs_directory_iterator_next(iterator)) > 0) {
+		int cmp = compare_name(
+				hsqs_directory_iterator_name(iterator),
+				hsqs_directory_iterator_name_size(iterator), name, name_len);
+		if (cmp == 0) {
 			return 0;
+		} else if (cmp > 0) {
+			// Entries are sorted, so name cannot follow.
+			break;
 		}
 	}
+	if (rv < 0) {
+		return rv;
+	}
 
 	return -HSQS_ERROR_NO_SUCH_FILE;
 }
@@ -153,7 +205,8 @@ hsqs_directory_iterator_init(
 		return rv;
 	}
 
-	iterator->current_fragment_offset = 0;
+	iterator->window_offset = 0;
+	iterator->fragment_start = 0;
 	iterator->remaining_entries = 0;
 	iterator->next_offset = 0;
 	iterator->current_offset = 0;
@@ -171,13 +224,10 @@ hsqs_directory_iterator_name_size(
 uint64_t
 hsqs_directory_iterator_inode_ref(
 		const struct HsqsDirectoryIterator *iterator) {
-	const struct HsqsDirectoryFragment *fragment =
-			directory_iterator_current_fragment(iterator);
-	uint32_t block_index = hsqs_data_directory_fragment_start(fragment);
 	uint16_t block_offset =
 			hsqs_data_directory_entry_offset(current_entry(iterator));
 
-	return hsqs_inode_ref_from_block(block_index, block_offset);
+	return hsqs_inode_ref_from_block(iterator->fragment_start, block_offset);
 }
 
 enum HsqsInodeContextType
@@ -215,6 +265,9 @@ hsqs_directory_iterator_inode_load(
 int
 hsqs_directory_iterator_next(struct HsqsDirectoryIterator *iterator) {
 	int rv = 0;
+	const struct HsqsDirectoryFragment *fragment;
+	size_t entry_size = HSQS_SIZEOF_DIRECTORY_ENTRY;
+
 	iterator->current_offset = iterator->next_offset;
 
 	if (iterator->next_offset >= iterator->size) {
@@ -222,38 +275,35 @@ hsqs_directory_iterator_next(struct HsqsDirectoryIterator *iterator) {
 		return 0;
 	} else if (iterator->remaining_entries == 0) {
 		// New fragment begins
-		iterator->next_offset += HSQS_SIZEOF_DIRECTORY_FRAGMENT;
-
-		rv = directory_data_more(iterator, iterator->next_offset);
+		rv = directory_data_at(
+				iterator, iterator->current_offset,
+				HSQS_SIZEOF_DIRECTORY_FRAGMENT);
 		if (rv < 0) {
 			return rv;
 		}
-		iterator->current_fragment_offset = iterator->current_offset;
-
-		const struct HsqsDirectoryFragment *current_fragment =
-				directory_iterator_current_fragment(iterator);
+		fragment = (const struct HsqsDirectoryFragment *)
+				hsqs_metablock_stream_data(&iterator->metablock);
 		iterator->remaining_entries =
-				hsqs_data_directory_fragment_count(current_fragment) + 1;
+				hsqs_data_directory_fragment_count(fragment) + 1;
+		iterator->fragment_start = hsqs_data_directory_fragment_start(fragment);
 
-		iterator->current_offset = iterator->next_offset;
+		iterator->current_offset += HSQS_SIZEOF_DIRECTORY_FRAGMENT;
 	}
 	iterator->remaining_entries--;
 
-	// Make sure next entry is loaded:
-	iterator->next_offset += HSQS_SIZEOF_DIRECTORY_ENTRY;
-	rv = directory_data_more(iterator, iterator->next_offset);
+	// Make sure the entry is loaded:
+	rv = directory_data_at(iterator, iterator->current_offset, entry_size);
 	if (rv < 0) {
 		return rv;
 	}
 
-	// Make sure next entry has its name populated
-	iterator->next_offset += hsqs_directory_iterator_name_size(iterator);
-	// May invalidate pointers into directory entries. that's why the
-	// current_entry() call is repeated below.
-	rv = directory_data_more(iterator, iterator->next_offset);
+	// Make sure the entry has its name populated
+	entry_size += hsqs_directory_iterator_name_size(iterator);
+	rv = directory_data_at(iterator, iterator->current_offset, entry_size);
 	if (rv < 0) {
 		return rv;
 	}
+	iterator->next_offset = iterator->current_offset + entry_size;
 
 	return 1;
 }
@@ -49,11 +49,12 @@ struct HsqsDirectoryIterator {
 	uint32_t block_offset;
 	uint32_t size;
 
-	const struct HsqsDirectoryFragment *fragments;
 	struct HsqsDirectoryContext *directory;
 	struct HsqsMetablockStreamContext metablock;
+	// Offset of the metablock stream window in the directory listing.
+	hsqs_index_t window_offset;
+	uint32_t fragment_start;
 	size_t remaining_entries;
-	hsqs_index_t current_fragment_offset;
 	hsqs_index_t next_offset;
 	hsqs_index_t current_offset;
 };
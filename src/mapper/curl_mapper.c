@@ -38,6 +38,7 @@
 #include "mapper.h"
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -52,17 +53,27 @@
 #define CONTENT_RANGE "Content-Range: "
 #define CONTENT_RANGE_LENGTH (sizeof(CONTENT_RANGE) - 1)
 
+struct CurlChunk {
+	size_t size;
+	uint8_t data[];
+};
+
+struct CurlRequest {
+	struct HsqsBuffer *buffer;
+	uint64_t total_size;
+};
+
 static size_t
 write_data(void *ptr, size_t size, size_t nmemb, void *userdata) {
 	int rv = 0;
 	size_t byte_size;
-	struct HsqsMapping *mapping = userdata;
+	struct CurlRequest *request = userdata;
 
 	if (MULT_OVERFLOW(size, nmemb, &byte_size)) {
 		rv = -HSQS_ERROR_INTEGER_OVERFLOW;
 		goto out;
 	}
-	rv = hsqs_buffer_append(mapping->data.cl.buffer, ptr, byte_size);
+	rv = hsqs_buffer_append(request->buffer, ptr, byte_size);
 	if (rv < 0) {
 		goto out;
 	}
@@ -82,7 +93,7 @@ header_callback(char *buffer, size_t size, size_t nitems, void *userdata) {
 	uint64_t end = 0;
 	uint64_t total = 0;
 	size_t header_size = size * nitems;
-	struct HsqsMapping *mapping = (struct HsqsMapping *)userdata;
+	struct CurlRequest *request = userdata;
 
 	if (header_size < CONTENT_RANGE_LENGTH) {
 		return header_size;
@@ -103,173 +114,349 @@ header_callback(char *buffer, size_t size, size_t nitems, void *userdata) {
 		return 0;
 	}
 
-	mapping->data.cl.total_size = total;
+	request->total_size = total;
 
 	free(header);
 	return header_size;
 }
 
+static void
+share_lock(
+		CURL *handle, curl_lock_data data, curl_lock_access access,
+		void *userptr) {
+	(void)handle;
+	(void)access;
+	struct HsqsCurlMapper *mapper = userptr;
+	pthread_mutex_lock(&mapper->share_locks[data]);
+}
+
+static void
+share_unlock(CURL *handle, curl_lock_data data, void *userptr) {
+	(void)handle;
+	struct HsqsCurlMapper *mapper = userptr;
+	pthread_mutex_unlock(&mapper->share_locks[data]);
+}
+
+// Takes an idle handle, creates a new one while the pool has room, or
+// waits for another request to finish.
 static CURL *
-get_handle(struct HsqsMapping *mapping) {
-	CURL *handle = mapping->mapper->data.cl.handle;
-	pthread_mutex_lock(&mapping->mapper->data.cl.handle_lock);
+acquire_handle(struct HsqsCurlMapper *mapper) {
+	CURL *handle = NULL;
+
+	pthread_mutex_lock(&mapper->handle_lock);
+	while (mapper->idle_count == 0 &&
+		   mapper->handle_count == mapper->handle_limit) {
+		pthread_cond_wait(&mapper->handle_available, &mapper->handle_lock);
+	}
+	if (mapper->idle_count > 0) {
+		mapper->idle_count--;
+		handle = mapper->handles[mapper->idle_count];
+	} else {
+		handle = curl_easy_init();
+		if (handle != NULL) {
+			mapper->handle_count++;
+		}
+	}
+	pthread_mutex_unlock(&mapper->handle_lock);
+	return handle;
+}
+
+static void
+release_handle(struct HsqsCurlMapper *mapper, CURL *handle) {
+	pthread_mutex_lock(&mapper->handle_lock);
+	mapper->handles[mapper->idle_count] = handle;
+	mapper->idle_count++;
+	pthread_cond_signal(&mapper->handle_available);
+	pthread_mutex_unlock(&mapper->handle_lock);
+}
+
+static void
+setup_handle(
+		struct HsqsCurlMapper *mapper, CURL *handle,
+		struct CurlRequest *request) {
+	// curl_easy_reset() keeps the open connection of the handle, so
+	// consecutive requests reuse it.
 	curl_easy_reset(handle);
-	curl_easy_setopt(handle, CURLOPT_URL, mapping->mapper->data.cl.url);
+	curl_easy_setopt(handle, CURLOPT_URL, mapper->url);
+	curl_easy_setopt(handle, CURLOPT_SHARE, mapper->share);
 	curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 1L);
+	curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
 	curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
 	curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
 	curl_easy_setopt(handle, CURLOPT_FAILONERROR, 1L);
 	curl_easy_setopt(handle, CURLOPT_FILETIME, 1L);
 	curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, header_callback);
-	curl_easy_setopt(handle, CURLOPT_HEADERDATA, mapping);
-	return handle;
+	curl_easy_setopt(handle, CURLOPT_HEADERDATA, request);
+	curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, write_data);
+	curl_easy_setopt(handle, CURLOPT_WRITEDATA, request);
 }
 
-static void
-release_handle(struct HsqsMapper *mapper, CURL *handle) {
-	if (handle == mapper->data.cl.handle) {
-		pthread_mutex_unlock(&mapper->data.cl.handle_lock);
+static int
+share_init(struct HsqsCurlMapper *mapper) {
+	mapper->share = curl_share_init();
+	if (mapper->share == NULL) {
+		return -HSQS_ERROR_MAPPER_INIT;
+	}
+	for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+		if (pthread_mutex_init(&mapper->share_locks[i], NULL) != 0) {
+			return -HSQS_ERROR_MAPPER_INIT;
+		}
+		mapper->share_lock_count++;
 	}
+	curl_share_setopt(mapper->share, CURLSHOPT_LOCKFUNC, share_lock);
+	curl_share_setopt(mapper->share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+	curl_share_setopt(mapper->share, CURLSHOPT_USERDATA, mapper);
+	// libcurl does not support sharing connections between concurrent
+	// threads. Every handle keeps its own connection alive instead.
+	curl_share_setopt(mapper->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	curl_share_setopt(
+			mapper->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+	return 0;
 }
 
 static int
-hsqs_mapper_curl_init(
-		struct HsqsMapper *mapper, const void *input, size_t size) {
-	(void)size;
-	int rv = 0;
-	struct HsqsMapping mapping = {0};
-	curl_global_init(CURL_GLOBAL_ALL);
+chunk_dtor(void *data) {
+	(void)data;
+	return 0;
+}
 
-	mapper->data.cl.url = input;
-	mapper->data.cl.handle = curl_easy_init();
-	mapper->data.cl.expected_size = UINT64_MAX;
-	mapper->data.cl.expected_time = UINT64_MAX;
+static int
+chunk_new(struct HsqsRefCount **chunk_ref, size_t size) {
+	int rv = 0;
+	struct CurlChunk *chunk;
 
-	rv = hsqs_lru_hashmap_init(&mapper->data.cl.cache, 16);
+	rv = hsqs_ref_count_new(
+			chunk_ref, sizeof(struct CurlChunk) + size, chunk_dtor);
 	if (rv < 0) {
-		goto out;
+		return rv;
 	}
+	chunk = hsqs_ref_count_retain(*chunk_ref);
+	chunk->size = size;
+	return 0;
+}
 
-	rv = pthread_mutex_init(&mapper->data.cl.handle_lock, NULL);
-	if (rv != 0) {
-		rv = -HSQS_ERROR_MAPPER_INIT;
-		goto out;
+// Errors of the disk cache are ignored. They only cost another download.
+static void
+disk_cache_store(
+		struct HsqsCurlMapper *mapper, uint64_t index,
+		const struct CurlChunk *chunk) {
+	int rv = 0;
+
+	if (mapper->disk_cache.fd < 0) {
+		return;
 	}
+	rv = hsqs_chunk_file_write(
+			&mapper->disk_cache, index, chunk->data, chunk->size);
+	(void)rv;
+}
 
-	rv = hsqs_mapper_map(&mapping, mapper, 0, SUPERBLOCK_REQUEST_SIZE);
+static int
+disk_cache_load(
+		struct HsqsCurlMapper *mapper, uint64_t index,
+		struct HsqsRefCount **chunk_ref) {
+	int rv = 0;
+	size_t size;
+	struct CurlChunk *chunk;
+
+	*chunk_ref = NULL;
+	if (mapper->disk_cache.fd < 0) {
+		return 0;
+	}
+	size = hsqs_chunk_file_chunk_size(&mapper->disk_cache, index);
+	if (size == 0) {
+		return 0;
+	}
+	rv = chunk_new(chunk_ref, size);
 	if (rv < 0) {
-		goto out;
+		return rv;
 	}
-	mapper->data.cl.expected_size = mapping.data.cl.total_size;
-	mapper->data.cl.expected_time = mapping.data.cl.file_time;
-	hsqs_mapping_unmap(&mapping);
+	chunk = hsqs_ref_count_data(*chunk_ref);
+	if (hsqs_chunk_file_read(&mapper->disk_cache, index, chunk->data) <= 0) {
+		hsqs_ref_count_release(*chunk_ref);
+		*chunk_ref = NULL;
+		return 0;
+	}
+	return hsqs_lru_hashmap_put_sized(&mapper->cache, index, *chunk_ref, size);
+}
 
-out:
-	return rv;
+static void
+disk_cache_open(struct HsqsCurlMapper *mapper) {
+	int rv = 0;
+	char path[PATH_MAX];
+	uint64_t hash =
+			hsqs_hash(HSQS_HASH_INIT, mapper->url, strlen(mapper->url));
+	struct HsqsRefCount *chunk_ref;
+
+	rv = snprintf(
+			path, sizeof(path), "%s/%016" PRIx64 ".cache", mapper->cache_dir,
+			hash);
+	if (rv < 0 || (size_t)rv >= sizeof(path)) {
+		return;
+	}
+	rv = hsqs_chunk_file_open(
+			&mapper->disk_cache, path, mapper->expected_size,
+			mapper->expected_time, mapper->chunk_size);
+	if (rv < 0) {
+		return;
+	}
+
+	// The superblock request ran before the cache file was opened.
+	chunk_ref = hsqs_lru_hashmap_acquire(&mapper->cache, 0);
+	if (chunk_ref != NULL) {
+		disk_cache_store(mapper, 0, hsqs_ref_count_data(chunk_ref));
+		hsqs_ref_count_release(chunk_ref);
+	}
 }
 
 static int
-buffer_dtor(void *data) {
-	struct HsqsBuffer *buffer = data;
-	hsqs_buffer_cleanup(buffer);
+hsqs_mapper_curl_cleanup(struct HsqsMapper *mapper) {
+	struct HsqsCurlMapper *cl = &mapper->data.cl;
+
+	if (cl->cache_initialized) {
+		hsqs_lru_hashmap_cleanup(&cl->cache);
+		cl->cache_initialized = false;
+	}
+	hsqs_chunk_file_cleanup(&cl->disk_cache);
+	for (size_t i = 0; i < cl->idle_count; i++) {
+		curl_easy_cleanup(cl->handles[i]);
+	}
+	cl->idle_count = 0;
+	cl->handle_count = 0;
+	free(cl->handles);
+	cl->handles = NULL;
+	if (cl->share != NULL) {
+		curl_share_cleanup(cl->share);
+		cl->share = NULL;
+	}
+	for (int i = 0; i < cl->share_lock_count; i++) {
+		pthread_mutex_destroy(&cl->share_locks[i]);
+	}
+	cl->share_lock_count = 0;
+	if (cl->handle_available_initialized) {
+		pthread_cond_destroy(&cl->handle_available);
+		cl->handle_available_initialized = false;
+	}
+	if (cl->handle_lock_initialized) {
+		pthread_mutex_destroy(&cl->handle_lock);
+		cl->handle_lock_initialized = false;
+	}
 	return 0;
 }
 
 static int
-hsqs_mapper_curl_map(struct HsqsMapping *mapping, off_t offset, size_t size) {
+hsqs_mapper_curl_init(
+		struct HsqsMapper *mapper, const void *input, size_t size) {
+	(void)size;
 	int rv = 0;
-	struct HsqsRefCount *buffer_ref;
-	struct HsqsBuffer *buffer;
+	struct HsqsCurlMapper *cl = &mapper->data.cl;
+	struct HsqsMapping mapping = {0};
+	curl_global_init(CURL_GLOBAL_ALL);
 
-	mapping->data.cl.offset = offset;
-	buffer_ref = hsqs_lru_hashmap_get(&mapping->mapper->data.cl.cache, offset);
-	if (buffer_ref == NULL) {
-		rv = hsqs_ref_count_new(
-				&buffer_ref, sizeof(struct HsqsBuffer), buffer_dtor);
-		if (rv < 0) {
-			goto out;
-		}
-		rv = hsqs_lru_hashmap_put(
-				&mapping->mapper->data.cl.cache, offset, buffer_ref);
-		if (rv < 0) {
-			goto out;
-		}
-		buffer = hsqs_ref_count_retain(buffer_ref);
-		rv = hsqs_buffer_init(buffer, HSQS_COMPRESSION_NONE, 8192);
-		if (rv < 0) {
-			goto out;
-		}
-	} else {
-		buffer = hsqs_ref_count_retain(buffer_ref);
+	cl->url = input;
+	cl->disk_cache.fd = -1;
+	cl->expected_size = UINT64_MAX;
+	cl->expected_time = UINT64_MAX;
+	if (cl->handle_limit == 0) {
+		cl->handle_limit = HSQS_CURL_HANDLES;
+	}
+	// All requests go to the same host and every handle holds one
+	// connection, so the host limit caps the pool.
+	if (cl->host_connections != 0) {
+		cl->handle_limit = MIN(cl->handle_limit, cl->host_connections);
+	}
+	cl->handle_count = 0;
+	cl->idle_count = 0;
+	cl->share = NULL;
+	cl->cache_initialized = false;
+	cl->handle_lock_initialized = false;
+	cl->handle_available_initialized = false;
+	cl->share_lock_count = 0;
+	cl->handles = calloc(cl->handle_limit, sizeof(CURL *));
+	if (cl->handles == NULL) {
+		rv = -HSQS_ERROR_MALLOC_FAILED;
+		goto out;
+	}
+
+	if (cl->chunk_size == 0) {
+		cl->chunk_size = HSQS_CURL_CHUNK_SIZE;
+	}
+	if (cl->cache_size == 0) {
+		cl->cache_size = HSQS_CURL_CACHE_SIZE;
+	}
+	rv = hsqs_lru_hashmap_init_limits(&cl->cache, 0, cl->cache_size);
+	if (rv < 0) {
+		goto out;
+	}
+	cl->cache_initialized = true;
+
+	if (pthread_mutex_init(&cl->handle_lock, NULL) != 0) {
+		rv = -HSQS_ERROR_MAPPER_INIT;
+		goto out;
+	}
+	cl->handle_lock_initialized = true;
+	if (pthread_cond_init(&cl->handle_available, NULL) != 0) {
+		rv = -HSQS_ERROR_MAPPER_INIT;
+		goto out;
+	}
+	cl->handle_available_initialized = true;
+
+	rv = share_init(cl);
+	if (rv < 0) {
+		goto out;
 	}
-	mapping->data.cl.buffer_ref = buffer_ref;
-	mapping->data.cl.buffer = buffer;
 
-	rv = hsqs_mapping_resize(mapping, size);
+	rv = hsqs_mapper_map(&mapping, mapper, 0, SUPERBLOCK_REQUEST_SIZE);
 	if (rv < 0) {
 		goto out;
 	}
+	cl->expected_size = mapping.data.cl.total_size;
+	cl->expected_time = mapping.data.cl.file_time;
+	hsqs_mapping_unmap(&mapping);
+
+	if (cl->cache_dir != NULL) {
+		disk_cache_open(cl);
+	}
 
 out:
 	if (rv < 0) {
-		hsqs_mapping_unmap(mapping);
+		hsqs_mapper_curl_cleanup(mapper);
 	}
 	return rv;
 }
+
 static size_t
 hsqs_mapper_curl_size(const struct HsqsMapper *mapper) {
 	return mapper->data.cl.expected_size;
 }
-static int
-hsqs_mapper_curl_cleanup(struct HsqsMapper *mapper) {
-	hsqs_lru_hashmap_cleanup(&mapper->data.cl.cache);
-	pthread_mutex_destroy(&mapper->data.cl.handle_lock);
-	curl_easy_cleanup(mapper->data.cl.handle);
-	return 0;
-}
-static int
-hsqs_mapping_curl_unmap(struct HsqsMapping *mapping) {
-	hsqs_ref_count_release(mapping->data.cl.buffer_ref);
-	mapping->data.cl.buffer_ref = NULL;
-	return 0;
-}
-static const uint8_t *
-hsqs_mapping_curl_data(const struct HsqsMapping *mapping) {
-	return hsqs_buffer_data(mapping->data.cl.buffer);
-}
 
 static int
-hsqs_mapping_curl_resize(struct HsqsMapping *mapping, size_t new_size) {
+fetch_range(
+		struct HsqsMapping *mapping, struct HsqsBuffer *buffer,
+		uint64_t start_offset, uint64_t end_offset) {
 	int rv = 0;
 	char range_buffer[512] = {0};
-	CURL *handle = get_handle(mapping);
-	new_size = HSQS_PADDING(new_size, 512);
-	size_t current_size = hsqs_mapping_size(mapping);
-	uint64_t new_offset = mapping->data.cl.offset + current_size;
-	uint64_t end_offset = new_offset + new_size - current_size - 1;
+	struct HsqsCurlMapper *mapper = &mapping->mapper->data.cl;
+	struct CurlRequest request = {.buffer = buffer};
 	long http_code = 0;
-	uint64_t expected_size = mapping->mapper->data.cl.expected_size;
-	uint64_t expected_time = mapping->mapper->data.cl.expected_time;
-
-	if (new_size <= current_size) {
-		return 0;
-	}
+	long file_time_info = -1;
+	uint64_t file_time;
+	CURL *handle = acquire_handle(mapper);
 
-	if (end_offset > mapping->mapper->data.cl.expected_size - 1) {
-		end_offset = mapping->mapper->data.cl.expected_size - 1;
+	if (handle == NULL) {
+		rv = -HSQS_ERROR_MAPPER_MAP;
+		goto out;
 	}
+	setup_handle(mapper, handle, &request);
 
 	// TODO: check for negative values of offset
 	rv = snprintf(
 			range_buffer, sizeof(range_buffer), "%" PRIu64 "-%" PRIu64,
-			new_offset, end_offset);
+			start_offset, end_offset);
 	if (rv >= (int)sizeof(range_buffer)) {
 		rv = -HSQS_ERROR_MAPPER_MAP;
 		goto out;
 	}
 	curl_easy_setopt(handle, CURLOPT_RANGE, range_buffer);
-	curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, write_data);
-	curl_easy_setopt(handle, CURLOPT_WRITEDATA, mapping);
 
 	rv = curl_easy_perform(handle);
 	if (rv != CURLE_OK) {
@@ -284,39 +471,252 @@ hsqs_mapping_curl_resize(struct HsqsMapping *mapping, size_t new_size) {
 		goto out;
 	}
 
-	uint64_t file_time;
-	rv = curl_easy_getinfo(handle, CURLINFO_FILETIME, &file_time);
+	rv = curl_easy_getinfo(handle, CURLINFO_FILETIME, &file_time_info);
 	if (rv != CURLE_OK) {
 		rv = -HSQS_ERROR_MAPPER_MAP;
 		goto out;
 	}
 	rv = 0;
+	// -1 if the server did not send a modification time.
+	file_time = file_time_info < 0 ? UINT64_MAX : (uint64_t)file_time_info;
 	mapping->data.cl.file_time = file_time;
+	mapping->data.cl.total_size = request.total_size;
 
 	if (file_time == UINT64_MAX) {
 		rv = -HSQS_ERROR_MAPPER_MAP;
 		goto out;
 	}
 
-	if (expected_time != UINT64_MAX && file_time != expected_time) {
+	if (mapper->expected_time != UINT64_MAX &&
+		file_time != mapper->expected_time) {
 		rv = -HSQS_ERROR_MAPPER_MAP;
 		goto out;
 	}
 
-	if (expected_size != UINT64_MAX &&
-		mapping->data.cl.total_size != expected_size) {
+	if (mapper->expected_size != UINT64_MAX &&
+		request.total_size != mapper->expected_size) {
 		rv = -HSQS_ERROR_MAPPER_MAP;
 		goto out;
 	}
 
 out:
-	release_handle(mapping->mapper, handle);
+	if (handle != NULL) {
+		release_handle(mapper, handle);
+	}
+	return rv;
+}
+
+// Downloads count consecutive chunks with a single range request and adds
+// them to the cache. Chunks past the end of the file stay NULL.
+static int
+fetch_chunks(
+		struct HsqsMapping *mapping, uint64_t index, size_t count,
+		struct HsqsRefCount **chunks) {
+	int rv = 0;
+	struct HsqsCurlMapper *mapper = &mapping->mapper->data.cl;
+	struct HsqsBuffer buffer = {0};
+	struct CurlChunk *chunk;
+	size_t chunk_size = mapper->chunk_size;
+	uint64_t start_offset = index * chunk_size;
+	uint64_t end_offset = start_offset + count * chunk_size - 1;
+	const uint8_t *data;
+	size_t size;
+	size_t length;
+
+	if (end_offset > mapper->expected_size - 1) {
+		end_offset = mapper->expected_size - 1;
+	}
+
+	rv = hsqs_buffer_init(&buffer, HSQS_COMPRESSION_NONE, 8192);
+	if (rv < 0) {
+		goto out;
+	}
+	rv = hsqs_buffer_reserve(&buffer, end_offset - start_offset + 1);
+	if (rv < 0) {
+		goto out;
+	}
+	rv = fetch_range(mapping, &buffer, start_offset, end_offset);
+	if (rv < 0) {
+		goto out;
+	}
+
+	data = hsqs_buffer_data(&buffer);
+	size = hsqs_buffer_size(&buffer);
+	for (size_t i = 0; i < count && i * chunk_size < size; i++) {
+		length = size - i * chunk_size;
+		if (length > chunk_size) {
+			length = chunk_size;
+		}
+		rv = chunk_new(&chunks[i], length);
+		if (rv < 0) {
+			goto out;
+		}
+		chunk = hsqs_ref_count_data(chunks[i]);
+		memcpy(chunk->data, &data[i * chunk_size], length);
+		disk_cache_store(mapper, index + i, chunk);
+
+		rv = hsqs_lru_hashmap_put_sized(
+				&mapper->cache, index + i, chunks[i], length);
+		if (rv < 0) {
+			goto out;
+		}
+	}
+
+out:
+	hsqs_buffer_cleanup(&buffer);
 	return rv;
 }
 
+// Looks up count chunks starting at index. Runs of missing chunks are
+// fetched with one request each. The caller releases the chunks.
+static int
+load_chunks(
+		struct HsqsMapping *mapping, uint64_t index, size_t count,
+		struct HsqsRefCount **chunks) {
+	int rv = 0;
+	struct HsqsCurlMapper *mapper = &mapping->mapper->data.cl;
+	size_t missing = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		chunks[i] = hsqs_lru_hashmap_acquire(&mapper->cache, index + i);
+		if (chunks[i] == NULL) {
+			rv = disk_cache_load(mapper, index + i, &chunks[i]);
+			if (rv < 0) {
+				goto out;
+			}
+		}
+	}
+	for (size_t i = 0; i <= count; i++) {
+		if (i < count && chunks[i] == NULL) {
+			missing++;
+		} else if (missing > 0) {
+			rv = fetch_chunks(
+					mapping, index + i - missing, missing,
+					&chunks[i - missing]);
+			if (rv < 0) {
+				goto out;
+			}
+			missing = 0;
+		}
+	}
+
+out:
+	return rv;
+}
+
+static int
+map_range(struct HsqsMapping *mapping, uint64_t offset, size_t size) {
+	int rv = 0;
+	struct HsqsCurlMap *map = &mapping->data.cl;
+	size_t chunk_size = mapping->mapper->data.cl.chunk_size;
+	uint64_t index = offset / chunk_size;
+	size_t count = 0;
+	struct HsqsRefCount *single_chunk = NULL;
+	struct HsqsRefCount **chunks = &single_chunk;
+	const struct CurlChunk *chunk;
+	size_t chunk_offset;
+	size_t length;
+	size_t copied = 0;
+
+	map->chunk_ref = NULL;
+	map->copy = NULL;
+	map->data = NULL;
+	map->offset = offset;
+	map->size = size;
+	if (size == 0) {
+		goto out;
+	}
+
+	count = (offset + size - 1) / chunk_size - index + 1;
+	if (count > 1) {
+		chunks = calloc(count, sizeof(struct HsqsRefCount *));
+		map->copy = malloc(size);
+		if (chunks == NULL || map->copy == NULL) {
+			rv = -HSQS_ERROR_MALLOC_FAILED;
+			goto out;
+		}
+	}
+	rv = load_chunks(mapping, index, count, chunks);
+	if (rv < 0) {
+		goto out;
+	}
+
+	chunk_offset = offset - index * chunk_size;
+	for (size_t i = 0; i < count; i++) {
+		length = MIN(size - copied, chunk_size - chunk_offset);
+		chunk = chunks[i] == NULL ? NULL : hsqs_ref_count_data(chunks[i]);
+		if (chunk == NULL || chunk_offset + length > chunk->size) {
+			rv = -HSQS_ERROR_MAPPER_MAP;
+			goto out;
+		}
+		if (count == 1) {
+			map->chunk_ref = chunks[0];
+			map->data = &chunk->data[chunk_offset];
+			chunks[0] = NULL;
+		} else {
+			memcpy(&map->copy[copied], &chunk->data[chunk_offset], length);
+			map->data = map->copy;
+		}
+		copied += length;
+		chunk_offset = 0;
+	}
+
+out:
+	for (size_t i = 0; i < count; i++) {
+		hsqs_ref_count_release(chunks[i]);
+	}
+	if (chunks != &single_chunk) {
+		free(chunks);
+	}
+	if (rv < 0) {
+		hsqs_ref_count_release(map->chunk_ref);
+		free(map->copy);
+		map->chunk_ref = NULL;
+		map->copy = NULL;
+		map->data = NULL;
+	}
+	return rv;
+}
+
+static int
+hsqs_mapper_curl_map(struct HsqsMapping *mapping, off_t offset, size_t size) {
+	mapping->data.cl.total_size = UINT64_MAX;
+	mapping->data.cl.file_time = UINT64_MAX;
+	return map_range(mapping, offset, size);
+}
+
+static int
+hsqs_mapping_curl_unmap(struct HsqsMapping *mapping) {
+	hsqs_ref_count_release(mapping->data.cl.chunk_ref);
+	free(mapping->data.cl.copy);
+	mapping->data.cl.chunk_ref = NULL;
+	mapping->data.cl.copy = NULL;
+	mapping->data.cl.data = NULL;
+	return 0;
+}
+
+static const uint8_t *
+hsqs_mapping_curl_data(const struct HsqsMapping *mapping) {
+	return mapping->data.cl.data;
+}
+
+static int
+hsqs_mapping_curl_resize(struct HsqsMapping *mapping, size_t new_size) {
+	int rv = 0;
+	struct HsqsMapping resized = *mapping;
+
+	rv = map_range(&resized, mapping->data.cl.offset, new_size);
+	if (rv < 0) {
+		return rv;
+	}
+	hsqs_mapping_curl_unmap(mapping);
+	mapping->data.cl = resized.data.cl;
+	return 0;
+}
+
 static size_t
 hsqs_mapping_curl_size(const struct HsqsMapping *mapping) {
-	return hsqs_buffer_size(mapping->data.cl.buffer);
+	return mapping->data.cl.size;
 }
 
 struct HsqsMemoryMapperImpl hsqs_mapper_impl_curl = {
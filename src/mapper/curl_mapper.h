@@ -32,27 +32,71 @@
  */
 
 #include "../primitive/buffer.h"
+#include "../primitive/chunk_file.h"
 #include "../primitive/lru_hashmap.h"
 #include <curl/curl.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 #ifndef CURL_MAPPER_H
 
 #define CURL_MAPPER_H
 
+#define HSQS_CURL_HANDLES 8
+#define HSQS_CURL_CHUNK_SIZE (256 * 1024)
+#define HSQS_CURL_CACHE_SIZE (64 * 1024 * 1024)
+
+struct HsqsCurlOptions {
+	// 0 selects the defaults above. host_connections defaults to handles.
+	size_t handles;
+	size_t host_connections;
+	size_t chunk_size;
+	size_t cache_size;
+	// Optional directory for a persistent cache of the downloaded chunks.
+	const char *cache_dir;
+};
+
 struct HsqsCurlMapper {
 	const char *url;
 	uint64_t expected_time;
 	uint64_t expected_size;
+	// Chunks of chunk_size bytes, keyed by offset / chunk_size. The cache
+	// evicts by the total size of the chunks.
 	struct HsqsLruHashmap cache;
-	CURL *handle;
+	size_t chunk_size;
+	size_t cache_size;
+	const char *cache_dir;
+	// fd is -1 if no disk cache is used.
+	struct HsqsChunkFile disk_cache;
+	// Easy handles share DNS and TLS session caches.
+	CURLSH *share;
+	pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+	// Each handle runs one range request at a time over its own keep-alive
+	// connection. Idle handles are kept on a stack for reuse.
+	CURL **handles;
+	size_t handle_count;
+	size_t idle_count;
+	size_t handle_limit;
+	size_t host_connections;
 	pthread_mutex_t handle_lock;
+	pthread_cond_t handle_available;
+	// Parts that have been initialized. Cleanup releases only these, so it
+	// also runs after a failed init.
+	bool cache_initialized;
+	bool handle_lock_initialized;
+	bool handle_available_initialized;
+	int share_lock_count;
 };
 
 struct HsqsCurlMap {
-	struct HsqsRefCount *buffer_ref;
-	struct HsqsBuffer *buffer;
+	// Set if the mapping lies in a single chunk. Otherwise the chunks are
+	// copied to copy.
+	struct HsqsRefCount *chunk_ref;
+	uint8_t *copy;
+	const uint8_t *data;
 	uint64_t offset;
+	size_t size;
 	uint64_t total_size;
 	uint64_t file_time;
 };
@@ -57,6 +57,21 @@ hsqs_mapper_init_static(
 	return mapper->impl->init(mapper, input, size);
 }
 
+#ifdef CONFIG_CURL
+int
+hsqs_mapper_init_curl(
+		struct HsqsMapper *mapper, const char *url,
+		const struct HsqsCurlOptions *options) {
+	mapper->impl = &hsqs_mapper_impl_curl;
+	mapper->data.cl.handle_limit = options->handles;
+	mapper->data.cl.host_connections = options->host_connections;
+	mapper->data.cl.chunk_size = options->chunk_size;
+	mapper->data.cl.cache_size = options->cache_size;
+	mapper->data.cl.cache_dir = options->cache_dir;
+	return mapper->impl->init(mapper, url, strlen(url));
+}
+#endif
+
 int
 hsqs_mapper_map(
 		struct HsqsMapping *mapping, struct HsqsMapper *mapper,
@@ -83,6 +83,11 @@ struct HsqsMapper {
 int hsqs_mapper_init_mmap(struct HsqsMapper *mapper, const char *path);
 int hsqs_mapper_init_static(
 		struct HsqsMapper *mapper, const uint8_t *input, size_t size);
+#ifdef CONFIG_CURL
+int hsqs_mapper_init_curl(
+		struct HsqsMapper *mapper, const char *url,
+		const struct HsqsCurlOptions *options);
+#endif
 int hsqs_mapper_map(
 		struct HsqsMapping *mapping, struct HsqsMapper *mapper,
 		hsqs_index_t offset, size_t size);
@@ -74,7 +74,7 @@ compression_by_id(int id) {
 	case HSQS_COMPRESSION_LZMA:
 		return &hsqs_compression_lzma;
 #endif
-#ifdef CONFIG_XZ
+#ifdef CONFIG_LZMA
 	case HSQS_COMPRESSION_XZ:
 		return &hsqs_compression_xz;
 #endif
@@ -110,13 +110,59 @@ hsqs_buffer_init(
 		return rv;
 	}
 	buffer->impl = impl;
+	buffer->options = NULL;
+	buffer->options_size = 0;
 	buffer->block_size = block_size;
 	buffer->data = NULL;
 	buffer->size = 0;
+	buffer->capacity = 0;
 
 	return rv;
 }
 
+static int
+set_capacity(struct HsqsBuffer *buffer, size_t capacity) {
+	uint8_t *data = realloc(buffer->data, capacity);
+	if (data == NULL) {
+		return -HSQS_ERROR_MALLOC_FAILED;
+	}
+	buffer->data = data;
+	buffer->capacity = capacity;
+	return 0;
+}
+
+static int
+grow(struct HsqsBuffer *buffer, size_t additional) {
+	size_t min_capacity;
+	size_t capacity;
+
+	if (ADD_OVERFLOW(buffer->size, additional, &min_capacity)) {
+		return -HSQS_ERROR_INTEGER_OVERFLOW;
+	}
+	if (min_capacity <= buffer->capacity) {
+		return 0;
+	}
+	// Grow geometrically so that a sequence of appends only needs a
+	// logarithmic number of reallocations.
+	if (MULT_OVERFLOW(buffer->capacity, 2, &capacity)) {
+		capacity = min_capacity;
+	}
+	return set_capacity(buffer, MAX(capacity, min_capacity));
+}
+
+int
+hsqs_buffer_reserve(struct HsqsBuffer *buffer, size_t capacity) {
+	if (capacity <= buffer->capacity) {
+		return 0;
+	}
+	return set_capacity(buffer, capacity);
+}
+
+void
+hsqs_buffer_reset(struct HsqsBuffer *buffer) {
+	buffer->size = 0;
+}
+
 int
 hsqs_buffer_append(
 		struct HsqsBuffer *buffer, const uint8_t *source,
@@ -124,20 +170,15 @@ hsqs_buffer_append(
 	int rv = 0;
 	const size_t buffer_size = buffer->size;
 	size_t target_size;
-	size_t new_size;
-
-	if (ADD_OVERFLOW(buffer_size, source_size, &new_size)) {
-		return -HSQS_ERROR_INTEGER_OVERFLOW;
-	}
 
-	buffer->data = realloc(buffer->data, new_size);
-	if (buffer->data == NULL) {
-		return -HSQS_ERROR_MALLOC_FAILED;
+	rv = grow(buffer, source_size);
+	if (rv < 0) {
+		return rv;
 	}
 
 	target_size = source_size;
 	rv = hsqs_compression_null.extract(
-			NULL, 0, &buffer->data[buffer_size], &target_size, source,
+			NULL, NULL, 0, &buffer->data[buffer_size], &target_size, source,
 			source_size);
 	if (rv < 0)
 		return rv;
@@ -146,40 +187,64 @@ hsqs_buffer_append(
 
 	return rv;
 }
+
+void
+hsqs_buffer_set_compression_options(
+		struct HsqsBuffer *buffer, const union HsqsCompressionOptions *options,
+		size_t options_size) {
+	if (options_size == 0) {
+		options = NULL;
+	}
+	buffer->options = options;
+	buffer->options_size = options_size;
+}
+
+// Decompresses one block into memory owned by the caller. It only reads the
+// compression settings of the buffer, so several threads may extract
+// through the same buffer at once.
+int
+hsqs_buffer_extract_block(
+		const struct HsqsBuffer *buffer, uint8_t *target, size_t *target_size,
+		const uint8_t *source, const size_t source_size, bool is_compressed) {
+	if (is_compressed) {
+		return hsqs_compression_extract(
+				buffer->impl, buffer->options, buffer->options_size, target,
+				target_size, source, source_size);
+	} else {
+		return hsqs_compression_null.extract(
+				NULL, NULL, 0, target, target_size, source, source_size);
+	}
+}
+
+int
+hsqs_buffer_extend(struct HsqsBuffer *buffer, size_t size, uint8_t **target) {
+	int rv = 0;
+
+	rv = grow(buffer, size);
+	if (rv < 0) {
+		return rv;
+	}
+	*target = &buffer->data[buffer->size];
+	buffer->size += size;
+	return rv;
+}
+
 int
 hsqs_buffer_append_block(
 		struct HsqsBuffer *buffer, const uint8_t *source,
 		const size_t source_size, bool is_compressed) {
-	const union HsqsCompressionOptions *options = NULL;
-	size_t options_size = 0;
-	// const struct HsqsCompressionOptionsContext *options_context;
-	const struct HsqsCompressionImplementation *impl =
-			is_compressed ? buffer->impl : &hsqs_compression_null;
 	int rv = 0;
 	size_t block_size = buffer->block_size;
 	const size_t buffer_size = buffer->size;
-	size_t new_size;
 
-	if (ADD_OVERFLOW(buffer_size, block_size, &new_size)) {
-		return -HSQS_ERROR_INTEGER_OVERFLOW;
+	rv = grow(buffer, block_size);
+	if (rv < 0) {
+		return rv;
 	}
 
-	buffer->data = realloc(buffer->data, new_size);
-	if (buffer->data == NULL) {
-		return -HSQS_ERROR_MALLOC_FAILED;
-	}
-	// if (is_compressed) {
-	//	options_context = NULL;
-	//			//hsqs_superblock_compression_options(buffer->superblock);
-	//	if (options_context) {
-	//		options = hsqs_compression_options(options_context);
-	//		options_size = hsqs_compression_options_size(options_context);
-	//	}
-	//}
-
-	rv = impl->extract(
-			options, options_size, &buffer->data[buffer_size], &block_size,
-			source, source_size);
+	rv = hsqs_buffer_extract_block(
+			buffer, &buffer->data[buffer_size], &block_size, source,
+			source_size, is_compressed);
 	if (rv < 0)
 		return rv;
 
@@ -196,11 +261,16 @@ size_t
 hsqs_buffer_size(const struct HsqsBuffer *buffer) {
 	return buffer->size;
 }
+size_t
+hsqs_buffer_capacity(const struct HsqsBuffer *buffer) {
+	return buffer->capacity;
+}
 
 int
 hsqs_buffer_cleanup(struct HsqsBuffer *buffer) {
 	free(buffer->data);
 	buffer->data = NULL;
 	buffer->size = 0;
+	buffer->capacity = 0;
 	return 0;
 }
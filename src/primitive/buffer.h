@@ -43,27 +43,48 @@
 #define HSQS_BUFFER_H
 
 struct HsqsSuperblockContext;
+union HsqsCompressionOptions;
 
 struct HsqsBuffer {
 	const struct HsqsCompressionImplementation *impl;
+	const union HsqsCompressionOptions *options;
+	size_t options_size;
 	int block_size;
 	uint8_t *data;
 	size_t size;
+	size_t capacity;
 };
 
 HSQS_NO_UNUSED int
 hsqs_buffer_init(struct HsqsBuffer *buffer, int compression_id, int block_size);
 
+void hsqs_buffer_set_compression_options(
+		struct HsqsBuffer *buffer, const union HsqsCompressionOptions *options,
+		size_t options_size);
+
+HSQS_NO_UNUSED int
+hsqs_buffer_reserve(struct HsqsBuffer *buffer, size_t capacity);
+
+void hsqs_buffer_reset(struct HsqsBuffer *buffer);
+
 HSQS_NO_UNUSED int hsqs_buffer_append_block(
 		struct HsqsBuffer *buffer, const uint8_t *source,
 		const size_t source_size, bool is_compressed);
 
+HSQS_NO_UNUSED int hsqs_buffer_extract_block(
+		const struct HsqsBuffer *buffer, uint8_t *target, size_t *target_size,
+		const uint8_t *source, const size_t source_size, bool is_compressed);
+
+HSQS_NO_UNUSED int
+hsqs_buffer_extend(struct HsqsBuffer *buffer, size_t size, uint8_t **target);
+
 HSQS_NO_UNUSED int hsqs_buffer_append(
 		struct HsqsBuffer *buffer, const uint8_t *source,
 		const size_t source_size);
 
 const uint8_t *hsqs_buffer_data(const struct HsqsBuffer *buffer);
 size_t hsqs_buffer_size(const struct HsqsBuffer *buffer);
+size_t hsqs_buffer_capacity(const struct HsqsBuffer *buffer);
 
 int hsqs_buffer_cleanup(struct HsqsBuffer *buffer);
 
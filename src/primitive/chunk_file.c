@@ -0,0 +1,227 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright (c) 2022, Enno Boland <g@s01.de>                                 *
+ *                                                                            *
+ * Redistribution and use in source and binary forms, with or without         *
+ * modification, are permitted provided that the following conditions are     *
+ * met:                                                                       *
+ *                                                                            *
+ * * Redistributions of source code must retain the above copyright notice,   *
+ *   this list of conditions and the following disclaimer.                    *
+ * * Redistributions in binary form must reproduce the above copyright        *
+ *   notice, this list of conditions and the following disclaimer in the      *
+ *   documentation and/or other materials provided with the distribution.     *
+ *                                                                            *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS    *
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,  *
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR     *
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR          *
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,      *
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,        *
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR         *
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF     *
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING       *
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS         *
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.               *
+ *                                                                            *
+ ******************************************************************************/
+
+/**
+ * @author       Enno Boland (mail@eboland.de)
+ * @file         chunk_file.c
+ */
+
+#include "chunk_file.h"
+#include "../error.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#define CHUNK_FILE_MAGIC "hsqschk1"
+#define CHUNK_FILE_HEADER_SIZE 4096
+
+struct ChunkFileHeader {
+	char magic[8];
+	uint64_t size;
+	uint64_t time;
+	uint64_t chunk_size;
+};
+
+static int
+pread_all(int fd, void *target, size_t size, off_t offset) {
+	uint8_t *p = target;
+	ssize_t rv;
+
+	while (size > 0) {
+		rv = pread(fd, p, size, offset);
+		if (rv < 0 && errno == EINTR) {
+			continue;
+		} else if (rv < 0) {
+			return -errno;
+		} else if (rv == 0) {
+			return -HSQS_ERROR_SIZE_MISSMATCH;
+		}
+		p += rv;
+		size -= rv;
+		offset += rv;
+	}
+	return 0;
+}
+
+static int
+pwrite_all(int fd, const void *data, size_t size, off_t offset) {
+	const uint8_t *p = data;
+	ssize_t rv;
+
+	while (size > 0) {
+		rv = pwrite(fd, p, size, offset);
+		if (rv < 0 && errno == EINTR) {
+			continue;
+		} else if (rv < 0) {
+			return -errno;
+		}
+		p += rv;
+		size -= rv;
+		offset += rv;
+	}
+	return 0;
+}
+
+static int
+reset(struct HsqsChunkFile *file, const struct ChunkFileHeader *header) {
+	int rv = 0;
+
+	if (ftruncate(file->fd, 0) < 0 ||
+		ftruncate(file->fd, file->data_offset + file->size) < 0) {
+		return -errno;
+	}
+	// the header is written last, so an interrupted reset stays invalid.
+	rv = pwrite_all(file->fd, header, sizeof(*header), 0);
+	if (rv < 0) {
+		return rv;
+	}
+	return 0;
+}
+
+int
+hsqs_chunk_file_open(
+		struct HsqsChunkFile *file, const char *path, uint64_t size,
+		uint64_t time, size_t chunk_size) {
+	int rv = 0;
+	struct ChunkFileHeader header = {
+			.size = size, .time = time, .chunk_size = chunk_size};
+	struct ChunkFileHeader current = {0};
+
+	memcpy(header.magic, CHUNK_FILE_MAGIC, sizeof(header.magic));
+	file->size = size;
+	file->chunk_size = chunk_size;
+	file->chunk_count = (size + chunk_size - 1) / chunk_size;
+	file->data_offset =
+			HSQS_PADDING(CHUNK_FILE_HEADER_SIZE + file->chunk_count, 4096);
+
+	file->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (file->fd < 0) {
+		rv = -errno;
+		goto out;
+	}
+
+	// Every user holds a shared lock. The file is only reset while no
+	// other process uses it.
+	if (flock(file->fd, LOCK_SH) < 0) {
+		rv = -errno;
+		goto out;
+	}
+	rv = pread_all(file->fd, &current, sizeof(current), 0);
+	if (rv == 0 && memcmp(&current, &header, sizeof(header)) == 0) {
+		goto out;
+	}
+
+	if (flock(file->fd, LOCK_EX | LOCK_NB) < 0) {
+		rv = -errno;
+		goto out;
+	}
+	rv = reset(file, &header);
+	if (rv < 0) {
+		goto out;
+	}
+	if (flock(file->fd, LOCK_SH) < 0) {
+		rv = -errno;
+		goto out;
+	}
+
+out:
+	if (rv < 0) {
+		hsqs_chunk_file_cleanup(file);
+	}
+	return rv;
+}
+
+size_t
+hsqs_chunk_file_chunk_size(const struct HsqsChunkFile *file, size_t index) {
+	uint64_t offset = (uint64_t)index * file->chunk_size;
+
+	if (offset >= file->size) {
+		return 0;
+	}
+	return MIN(file->size - offset, file->chunk_size);
+}
+
+ssize_t
+hsqs_chunk_file_read(
+		const struct HsqsChunkFile *file, size_t index, uint8_t *target) {
+	int rv = 0;
+	uint8_t state = 0;
+	size_t size = hsqs_chunk_file_chunk_size(file, index);
+
+	if (size == 0) {
+		return 0;
+	}
+	rv = pread_all(file->fd, &state, 1, CHUNK_FILE_HEADER_SIZE + index);
+	if (rv < 0) {
+		return rv;
+	} else if (state == 0) {
+		return 0;
+	}
+
+	rv = pread_all(
+			file->fd, target, size,
+			file->data_offset + (off_t)index * file->chunk_size);
+	if (rv < 0) {
+		return rv;
+	}
+	return size;
+}
+
+int
+hsqs_chunk_file_write(
+		const struct HsqsChunkFile *file, size_t index, const uint8_t *data,
+		size_t size) {
+	int rv = 0;
+	const uint8_t state = 1;
+
+	if (size != hsqs_chunk_file_chunk_size(file, index)) {
+		return -HSQS_ERROR_SIZE_MISSMATCH;
+	}
+
+	rv = pwrite_all(
+			file->fd, data, size,
+			file->data_offset + (off_t)index * file->chunk_size);
+	if (rv < 0) {
+		return rv;
+	}
+	// A whole byte per chunk lets processes mark chunks without a
+	// read-modify-write race.
+	return pwrite_all(file->fd, &state, 1, CHUNK_FILE_HEADER_SIZE + index);
+}
+
+int
+hsqs_chunk_file_cleanup(struct HsqsChunkFile *file) {
+	if (file->fd >= 0) {
+		close(file->fd);
+	}
+	file->fd = -1;
+	return 0;
+}
@@ -0,0 +1,67 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright (c) 2022, Enno Boland <g@s01.de>                                 *
+ *                                                                            *
+ * Redistribution and use in source and binary forms, with or without         *
+ * modification, are permitted provided that the following conditions are     *
+ * met:                                                                       *
+ *                                                                            *
+ * * Redistributions of source code must retain the above copyright notice,   *
+ *   this list of conditions and the following disclaimer.                    *
+ * * Redistributions in binary form must reproduce the above copyright        *
+ *   notice, this list of conditions and the following disclaimer in the      *
+ *   documentation and/or other materials provided with the distribution.     *
+ *                                                                            *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS    *
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,  *
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR     *
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR          *
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,      *
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,        *
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR         *
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF     *
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING       *
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS         *
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.               *
+ *                                                                            *
+ ******************************************************************************/
+
+/**
+ * @author       Enno Boland (mail@eboland.de)
+ * @file         chunk_file.h
+ */
+
+#include "../utils.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifndef CHUNK_FILE_H
+
+#define CHUNK_FILE_H
+
+// A sparse local file holding chunks of a remote file of the given size
+// and modification time. A state byte per chunk marks the chunks that are
+// present. The file is reset if size, time or chunk size change.
+struct HsqsChunkFile {
+	int fd;
+	uint64_t size;
+	size_t chunk_size;
+	size_t chunk_count;
+	off_t data_offset;
+};
+
+HSQS_NO_UNUSED int hsqs_chunk_file_open(
+		struct HsqsChunkFile *file, const char *path, uint64_t size,
+		uint64_t time, size_t chunk_size);
+size_t
+hsqs_chunk_file_chunk_size(const struct HsqsChunkFile *file, size_t index);
+// Returns the size of the chunk, or 0 if the chunk is not present.
+HSQS_NO_UNUSED ssize_t hsqs_chunk_file_read(
+		const struct HsqsChunkFile *file, size_t index, uint8_t *target);
+HSQS_NO_UNUSED int hsqs_chunk_file_write(
+		const struct HsqsChunkFile *file, size_t index, const uint8_t *data,
+		size_t size);
+int hsqs_chunk_file_cleanup(struct HsqsChunkFile *file);
+
+#endif /* end of include guard CHUNK_FILE_H */
@@ -0,0 +1,134 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright (c) 2022, Enno Boland <g@s01.de>                                 *
+ *                                                                            *
+ * Redistribution and use in source and binary forms, with or without         *
+ * modification, are permitted provided that the following conditions are     *
+ * met:                                                                       *
+ *                                                                            *
+ * * Redistributions of source code must retain the above copyright notice,   *
+ *   this list of conditions and the following disclaimer.                    *
+ * * Redistributions in binary form must reproduce the above copyright        *
+ *   notice, this list of conditions and the following disclaimer in the      *
+ *   documentation and/or other materials provided with the distribution.     *
+ *                                                                            *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS    *
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,  *
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR     *
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR          *
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,      *
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,        *
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR         *
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF     *
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING       *
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS         *
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.               *
+ *                                                                            *
+ ******************************************************************************/
+
+/**
+ * @author       Enno Boland (mail@eboland.de)
+ * @file         dentry_cache.c
+ */
+
+#include "dentry_cache.h"
+#include "../error.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct HsqsDentry {
+	uint64_t parent_ref;
+	uint64_t inode_ref;
+	int result;
+	size_t name_size;
+	char name[];
+};
+
+static uint64_t
+dentry_hash(uint64_t parent_ref, const char *name, size_t name_size) {
+	uint64_t hash = hsqs_hash(HSQS_HASH_INIT, &parent_ref, sizeof(parent_ref));
+
+	return hsqs_hash(hash, name, name_size);
+}
+
+static int
+dentry_dtor(void *data) {
+	(void)data;
+	return 0;
+}
+
+int
+hsqs_dentry_cache_init(
+		struct HsqsDentryCache *cache, size_t shard_count,
+		size_t max_entries) {
+	return hsqs_sharded_lru_hashmap_init(
+			&cache->hashmap, shard_count, max_entries, 0);
+}
+
+bool
+hsqs_dentry_cache_get(
+		struct HsqsDentryCache *cache, uint64_t parent_ref, const char *name,
+		size_t name_size, uint64_t *inode_ref, int *result) {
+	bool found = false;
+	struct HsqsRefCount *ref = hsqs_sharded_lru_hashmap_acquire(
+			&cache->hashmap, dentry_hash(parent_ref, name, name_size));
+	const struct HsqsDentry *dentry;
+
+	if (ref == NULL) {
+		return false;
+	}
+	dentry = hsqs_ref_count_data(ref);
+	// The hashmap only knows the hash, so collisions are detected here.
+	if (dentry->parent_ref == parent_ref && dentry->name_size == name_size &&
+		memcmp(dentry->name, name, name_size) == 0) {
+		*inode_ref = dentry->inode_ref;
+		*result = dentry->result;
+		found = true;
+	}
+	hsqs_ref_count_release(ref);
+	return found;
+}
+
+int
+hsqs_dentry_cache_put(
+		struct HsqsDentryCache *cache, uint64_t parent_ref, const char *name,
+		size_t name_size, uint64_t inode_ref, int result) {
+	int rv = 0;
+	struct HsqsRefCount *ref = NULL;
+	struct HsqsDentry *dentry;
+	size_t dentry_size;
+
+	if (ADD_OVERFLOW(sizeof(struct HsqsDentry), name_size, &dentry_size)) {
+		return -HSQS_ERROR_INTEGER_OVERFLOW;
+	}
+	rv = hsqs_ref_count_new(&ref, dentry_size, dentry_dtor);
+	if (rv < 0) {
+		return rv;
+	}
+	dentry = hsqs_ref_count_data(ref);
+	dentry->parent_ref = parent_ref;
+	dentry->inode_ref = inode_ref;
+	dentry->result = result;
+	dentry->name_size = name_size;
+	memcpy(dentry->name, name, name_size);
+
+	return hsqs_sharded_lru_hashmap_put(
+			&cache->hashmap, dentry_hash(parent_ref, name, name_size), ref);
+}
+
+size_t
+hsqs_dentry_cache_hits(const struct HsqsDentryCache *cache) {
+	return hsqs_sharded_lru_hashmap_hits(&cache->hashmap);
+}
+
+size_t
+hsqs_dentry_cache_misses(const struct HsqsDentryCache *cache) {
+	return hsqs_sharded_lru_hashmap_misses(&cache->hashmap);
+}
+
+int
+hsqs_dentry_cache_cleanup(struct HsqsDentryCache *cache) {
+	return hsqs_sharded_lru_hashmap_cleanup(&cache->hashmap);
+}
@@ -0,0 +1,70 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright (c) 2022, Enno Boland <g@s01.de>                                 *
+ *                                                                            *
+ * Redistribution and use in source and binary forms, with or without         *
+ * modification, are permitted provided that the following conditions are     *
+ * met:                                                                       *
+ *                                                                            *
+ * * Redistributions of source code must retain the above copyright notice,   *
+ *   this list of conditions and the following disclaimer.                    *
+ * * Redistributions in binary form must reproduce the above copyright        *
+ *   notice, this list of conditions and the following disclaimer in the      *
+ *   documentation and/or other materials provided with the distribution.     *
+ *                                                                            *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS    *
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,  *
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR     *
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR          *
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,      *
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,        *
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR         *
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF     *
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING       *
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS         *
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.               *
+ *                                                                            *
+ ******************************************************************************/
+
+/**
+ * @author       Enno Boland (mail@eboland.de)
+ * @file         dentry_cache.h
+ */
+
+#include "../utils.h"
+#include "sharded_lru_hashmap.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifndef DENTRY_CACHE_H
+
+#define DENTRY_CACHE_H
+
+#define HSQS_DENTRY_CACHE_ENTRIES 16384
+// Parent of entries that map a whole path, relative to the root directory,
+// to its inode. Inode references only use 48 bits, so this never collides
+// with a real directory.
+#define HSQS_DENTRY_PATH UINT64_MAX
+
+struct HsqsDentryCache {
+	struct HsqsShardedLruHashmap hashmap;
+};
+
+HSQS_NO_UNUSED int hsqs_dentry_cache_init(
+		struct HsqsDentryCache *cache, size_t shard_count,
+		size_t max_entries);
+// Returns true if the lookup of name in the directory parent_ref is cached.
+// result is set to 0 and inode_ref to the found inode for positive entries,
+// or to the negative error of the lookup for negative entries.
+bool hsqs_dentry_cache_get(
+		struct HsqsDentryCache *cache, uint64_t parent_ref, const char *name,
+		size_t name_size, uint64_t *inode_ref, int *result);
+HSQS_NO_UNUSED int hsqs_dentry_cache_put(
+		struct HsqsDentryCache *cache, uint64_t parent_ref, const char *name,
+		size_t name_size, uint64_t inode_ref, int result);
+size_t hsqs_dentry_cache_hits(const struct HsqsDentryCache *cache);
+size_t hsqs_dentry_cache_misses(const struct HsqsDentryCache *cache);
+int hsqs_dentry_cache_cleanup(struct HsqsDentryCache *cache);
+
+#endif /* end of include guard DENTRY_CACHE_H */
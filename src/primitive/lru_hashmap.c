@@ -31,6 +31,7 @@
  * @file         lru_hashmap.c
  */
 
+
 #include "lru_hashmap.h"
 #include "../error.h"
 
@@ -39,81 +40,46 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-static uint32_t
-hash_to_start_index(struct HsqsLruHashmap *hashmap, uint64_t hash) {
-	union {
-		uint64_t hash;
-		uint8_t bytes[8];
-	} hash_bytes = {.hash = hash}, target_bytes = {0};
+#define HSQS_LRU_HASHMAP_MIN_SIZE 4
+#define HSQS_LRU_HASHMAP_INITIAL_ENTRIES 64
 
-	for (size_t i = 0; i < sizeof(uint64_t); i++) {
-		target_bytes.bytes[i] = hash_bytes.bytes[i] ^
-				hash_bytes.bytes[sizeof(uint64_t) - i - 1];
-	}
-	// reserve the lower 2 bits for collisions.
-	target_bytes.hash <<= 2;
-	return target_bytes.hash % hashmap->size;
+static size_t
+hash_to_start_index(const struct HsqsLruHashmap *hashmap, uint64_t hash) {
+	uint64_t mixed = hash * 0x9E3779B97F4A7C15ULL;
+	mixed ^= mixed >> 32;
+	// size is always a power of two.
+	return mixed & (hashmap->size - 1);
+}
+
+static bool
+is_over_limit(const struct HsqsLruHashmap *hashmap, size_t weight) {
+	return hashmap->count >= hashmap->max_entries ||
+			hashmap->bytes + weight > hashmap->max_bytes;
 }
 
 static struct HsqsLruEntry *
-find_entry(struct HsqsLruHashmap *hashmap, uint64_t hash, bool find_free) {
-	uint32_t start_index = hash_to_start_index(hashmap, hash);
-	hsqs_index_t i = 0, index = 0;
+find_entry(struct HsqsLruHashmap *hashmap, uint64_t hash) {
+	size_t mask = hashmap->size - 1;
+	size_t index = hash_to_start_index(hashmap, hash);
 	struct HsqsLruEntry *candidate = NULL;
 
-	for (i = 0; i < hashmap->size; i++) {
-		index = (start_index + i) % hashmap->size;
+	for (hsqs_index_t i = 0; i < hashmap->size; i++) {
 		candidate = &hashmap->entries[index];
 
 		if (candidate->pointer == NULL) {
-			if (find_free) {
-				return candidate;
-			} else {
-#ifdef DEBUG
-				hashmap->misses++;
-#endif
-				return NULL;
-			}
+			return NULL;
 		}
 		if (candidate->hash == hash) {
-#ifdef DEBUG
-			hashmap->hits++;
-#endif
 			return candidate;
 		}
 #ifdef DEBUG
 		hashmap->collisions++;
 #endif
+		index = (index + 1) & mask;
 	}
 	return NULL;
 }
 
-/*
-static int
-lru_swap(struct HsqsLruHashmap *hashmap, struct HsqsLruEntry *entry1, struct
-HsqsLruEntry *entry2) { struct HsqsLruEntry *newer, *older;
-
-	newer = entry1->newer;
-	older = entry1->older;
-	entry1->older = entry2->older;
-	entry1->newer = entry2->newer;
-	entry2->older = older;
-	entry2->newer = newer;
-
-	if (entry1 == hashmap->oldest) {
-		hashmap->oldest = entry2;
-	} else if (entry2 == hashmap->oldest) {
-		hashmap->oldest = entry1;
-	}
-	if (entry1 == hashmap->newest) {
-		hashmap->newest = entry2;
-	} else if (entry2 == hashmap->newest) {
-		hashmap->newest = entry1;
-	}
-	return 0;
-}
-*/
-
 static int
 lru_detach(struct HsqsLruHashmap *hashmap, struct HsqsLruEntry *entry) {
 	struct HsqsLruEntry *tmp;
@@ -152,13 +118,138 @@ lru_attach(struct HsqsLruHashmap *hashmap, struct HsqsLruEntry *entry) {
 	return 0;
 }
 
+static void
+move_entry(
+		struct HsqsLruHashmap *hashmap, struct HsqsLruEntry *target,
+		struct HsqsLruEntry *source) {
+	*target = *source;
+	if (target->newer) {
+		target->newer->older = target;
+	} else {
+		hashmap->newest = target;
+	}
+	if (target->older) {
+		target->older->newer = target;
+	} else {
+		hashmap->oldest = target;
+	}
+	source->pointer = NULL;
+	source->newer = NULL;
+	source->older = NULL;
+}
+
+static struct HsqsLruEntry *
+insert_entry(
+		struct HsqsLruHashmap *hashmap, uint64_t hash,
+		struct HsqsRefCount *pointer, size_t weight) {
+	size_t mask = hashmap->size - 1;
+	size_t index = hash_to_start_index(hashmap, hash);
+	struct HsqsLruEntry *entry = &hashmap->entries[index];
+
+	while (entry->pointer != NULL) {
+		index = (index + 1) & mask;
+		entry = &hashmap->entries[index];
+	}
+
+	entry->pointer = pointer;
+	entry->hash = hash;
+	entry->weight = weight;
+	lru_attach(hashmap, entry);
+	hashmap->count++;
+	hashmap->bytes += weight;
+	return entry;
+}
+
+// Removes the entry and closes the gap in its probe sequence by shifting
+// later entries back, so lookups never need tombstones.
+static struct HsqsRefCount *
+remove_entry(struct HsqsLruHashmap *hashmap, struct HsqsLruEntry *entry) {
+	size_t mask = hashmap->size - 1;
+	size_t hole = entry - hashmap->entries;
+	size_t index = hole;
+	size_t start_index;
+	struct HsqsRefCount *pointer = entry->pointer;
+
+	lru_detach(hashmap, entry);
+	hashmap->count--;
+	hashmap->bytes -= entry->weight;
+	entry->pointer = NULL;
+
+	for (;;) {
+		index = (index + 1) & mask;
+		if (hashmap->entries[index].pointer == NULL) {
+			break;
+		}
+		start_index =
+				hash_to_start_index(hashmap, hashmap->entries[index].hash);
+		// keep the entry if its start index lies cyclically in (hole, index]
+		if (((index - start_index) & mask) < ((index - hole) & mask)) {
+			continue;
+		}
+		move_entry(hashmap, &hashmap->entries[hole], &hashmap->entries[index]);
+		hole = index;
+	}
+
+	return pointer;
+}
+
+static int
+rehash(struct HsqsLruHashmap *hashmap, size_t size) {
+	struct HsqsLruEntry *old_entries = hashmap->entries;
+	struct HsqsLruEntry *entry = hashmap->oldest;
+	struct HsqsLruEntry *newer;
+
+	hashmap->entries = calloc(size, sizeof(struct HsqsLruEntry));
+	if (hashmap->entries == NULL) {
+		hashmap->entries = old_entries;
+		return -HSQS_ERROR_MALLOC_FAILED;
+	}
+	hashmap->size = size;
+	hashmap->oldest = NULL;
+	hashmap->newest = NULL;
+	hashmap->count = 0;
+	hashmap->bytes = 0;
+
+	// reinsert from oldest to newest to keep the LRU order.
+	for (; entry; entry = newer) {
+		newer = entry->newer;
+		insert_entry(hashmap, entry->hash, entry->pointer, entry->weight);
+	}
+
+	free(old_entries);
+	return 0;
+}
+
 int
 hsqs_lru_hashmap_init(struct HsqsLruHashmap *hashmap, size_t size) {
+	return hsqs_lru_hashmap_init_limits(hashmap, size, 0);
+}
+
+int
+hsqs_lru_hashmap_init_limits(
+		struct HsqsLruHashmap *hashmap, size_t max_entries, size_t max_bytes) {
 	int rv = 0;
-	hashmap->size = size;
+	size_t initial_entries;
+	hashmap->max_entries = max_entries == 0 ? SIZE_MAX : max_entries;
+	hashmap->max_bytes = max_bytes == 0 ? SIZE_MAX : max_bytes;
+	hashmap->size = HSQS_LRU_HASHMAP_MIN_SIZE;
+	hashmap->count = 0;
+	hashmap->bytes = 0;
 	hashmap->newest = NULL;
 	hashmap->oldest = NULL;
 	hashmap->entries = NULL;
+	hashmap->hits = 0;
+	hashmap->misses = 0;
+#ifdef DEBUG
+	hashmap->collisions = 0;
+	hashmap->overflows = 0;
+#endif
+
+	initial_entries =
+			MIN(hashmap->max_entries, HSQS_LRU_HASHMAP_INITIAL_ENTRIES);
+	while (hashmap->size / 4 * 3 < initial_entries) {
+		hashmap->size *= 2;
+	}
 
 	rv = pthread_mutex_init(&hashmap->lock, NULL);
 	if (rv != 0) {
@@ -166,7 +257,7 @@ hsqs_lru_hashmap_init(struct HsqsLruHashmap *hashmap, size_t size) {
 		goto out;
 	}
 
-	hashmap->entries = calloc(size, sizeof(struct HsqsLruEntry));
+	hashmap->entries = calloc(hashmap->size, sizeof(struct HsqsLruEntry));
 	if (hashmap->entries == NULL) {
 		rv = -HSQS_ERROR_MALLOC_FAILED;
 		goto out;
@@ -175,56 +266,91 @@ out:
 	if (rv < 0) {
 		hsqs_lru_hashmap_cleanup(hashmap);
 	}
-	return 0;
+	return rv;
 }
 
 int
 hsqs_lru_hashmap_put(
 		struct HsqsLruHashmap *hashmap, uint64_t hash,
 		struct HsqsRefCount *pointer) {
+	return hsqs_lru_hashmap_put_sized(hashmap, hash, pointer, 0);
+}
+
+int
+hsqs_lru_hashmap_put_sized(
+		struct HsqsLruHashmap *hashmap, uint64_t hash,
+		struct HsqsRefCount *pointer, size_t weight) {
 	pthread_mutex_lock(&hashmap->lock);
 	int rv = 0;
-	struct HsqsLruEntry *candidate = find_entry(hashmap, hash, true);
+	struct HsqsLruEntry *candidate = find_entry(hashmap, hash);
 	hsqs_ref_count_retain(pointer);
 
-	if (candidate == NULL) {
-		if (hashmap->oldest == NULL) {
-			//
-			// Should never happen:
-			rv = -HSQS_ERROR_HASHMAP_INTERNAL_ERROR;
-			goto out;
-		}
+	if (candidate != NULL) {
+		hsqs_ref_count_release(remove_entry(hashmap, candidate));
+	}
 
+	while (hashmap->oldest != NULL && is_over_limit(hashmap, weight)) {
 #ifdef DEBUG
 		hashmap->overflows++;
 #endif
-		// TODO: This is potentional slow. Instead find the current first match
-		// and switch places with this one.
-		candidate = hashmap->oldest;
+		hsqs_ref_count_release(remove_entry(hashmap, hashmap->oldest));
 	}
 
-	if (candidate->pointer != NULL) {
-		hsqs_ref_count_release(candidate->pointer);
+	// keep the load factor below 3/4
+	if ((hashmap->count + 1) * 4 > hashmap->size * 3) {
+		rv = rehash(hashmap, hashmap->size * 2);
+		if (rv < 0) {
+			hsqs_ref_count_release(pointer);
+			goto out;
+		}
 	}
-	lru_detach(hashmap, candidate);
-	candidate->pointer = pointer;
-	candidate->hash = hash;
-	lru_attach(hashmap, candidate);
+
+	insert_entry(hashmap, hash, pointer, weight);
 out:
 	pthread_mutex_unlock(&hashmap->lock);
 	return rv;
 }
 
-struct HsqsRefCount *
-hsqs_lru_hashmap_get(struct HsqsLruHashmap *hashmap, uint64_t hash) {
+static struct HsqsRefCount *
+get(struct HsqsLruHashmap *hashmap, uint64_t hash, bool retain) {
 	pthread_mutex_lock(&hashmap->lock);
 	struct HsqsRefCount *pointer = NULL;
-	struct HsqsLruEntry *candidate = find_entry(hashmap, hash, false);
+	struct HsqsLruEntry *candidate = find_entry(hashmap, hash);
 
 	if (candidate != NULL) {
 		lru_detach(hashmap, candidate);
 		lru_attach(hashmap, candidate);
 		pointer = candidate->pointer;
+		if (retain) {
+			hsqs_ref_count_retain(pointer);
+		}
+		hashmap->hits++;
+	} else {
+		hashmap->misses++;
+	}
+
+	pthread_mutex_unlock(&hashmap->lock);
+	return pointer;
+}
+
+struct HsqsRefCount *
+hsqs_lru_hashmap_get(struct HsqsLruHashmap *hashmap, uint64_t hash) {
+	return get(hashmap, hash, false);
+}
+
+struct HsqsRefCount *
+hsqs_lru_hashmap_acquire(struct HsqsLruHashmap *hashmap, uint64_t hash) {
+	return get(hashmap, hash, true);
+}
+
+struct HsqsRefCount *
+hsqs_lru_hashmap_remove(struct HsqsLruHashmap *hashmap, uint64_t hash) {
+	pthread_mutex_lock(&hashmap->lock);
+	struct HsqsRefCount *pointer = NULL;
+	struct HsqsLruEntry *candidate = find_entry(hashmap, hash);
+
+	if (candidate != NULL) {
+		pointer = remove_entry(hashmap, candidate);
 	}
 
 	pthread_mutex_unlock(&hashmap->lock);
@@ -240,9 +366,11 @@ hsqs_lru_hashmap_cleanup(struct HsqsLruHashmap *hashmap) {
 			}
 		}
 		free(hashmap->entries);
+		hashmap->entries = NULL;
 	}
 #ifdef DEBUG
 	fprintf(stderr, "Hashmap size:        %lu\n", hashmap->size);
+	fprintf(stderr, "Hashmap bytes:       %lu\n", hashmap->bytes);
 	fprintf(stderr, "Hashmap collisions:  %lu\n", hashmap->collisions);
 	fprintf(stderr, "Hashmap misses:      %lu\n", hashmap->misses);
 	fprintf(stderr, "Hashmap hits:        %lu\n", hashmap->hits);
@@ -48,29 +48,45 @@ struct HsqsLruEntry {
 	struct HsqsLruEntry *newer;
 	struct HsqsLruEntry *older;
 	uint64_t hash;
+	size_t weight;
 };
 
 struct HsqsLruHashmap {
 	size_t size;
+	size_t count;
+	size_t max_entries;
+	size_t bytes;
+	size_t max_bytes;
 	struct HsqsLruEntry *oldest;
 	struct HsqsLruEntry *newest;
 	struct HsqsLruEntry *entries;
 	pthread_mutex_t lock;
-#ifdef DEBUG
-	size_t collisions;
 	size_t misses;
 	size_t hits;
+#ifdef DEBUG
+	size_t collisions;
 	size_t overflows;
 #endif
 };
 
 HSQS_NO_UNUSED int
 hsqs_lru_hashmap_init(struct HsqsLruHashmap *hashmap, size_t size);
+// Evicts the least recently used entries once either limit is reached.
+// A limit of 0 means unlimited.
+HSQS_NO_UNUSED int hsqs_lru_hashmap_init_limits(
+		struct HsqsLruHashmap *hashmap, size_t max_entries, size_t max_bytes);
 HSQS_NO_UNUSED int hsqs_lru_hashmap_put(
 		struct HsqsLruHashmap *hashmap, uint64_t hash,
 		struct HsqsRefCount *pointer);
+HSQS_NO_UNUSED int hsqs_lru_hashmap_put_sized(
+		struct HsqsLruHashmap *hashmap, uint64_t hash,
+		struct HsqsRefCount *pointer, size_t weight);
 struct HsqsRefCount *
 hsqs_lru_hashmap_get(struct HsqsLruHashmap *hashmap, uint64_t hash);
+// Like hsqs_lru_hashmap_get(), but retains the value while the hashmap is
+// locked, so a concurrent eviction can not free it. The caller releases it.
+struct HsqsRefCount *
+hsqs_lru_hashmap_acquire(struct HsqsLruHashmap *hashmap, uint64_t hash);
 struct HsqsRefCount *
 hsqs_lru_hashmap_remove(struct HsqsLruHashmap *hashmap, uint64_t hash);
 int hsqs_lru_hashmap_cleanup(struct HsqsLruHashmap *hashmap);
@@ -56,29 +56,55 @@ hsqs_ref_count_new(
 	}
 
 	tmp->dtor = dtor;
+#ifdef CONFIG_SINGLE_THREADED
 	tmp->references = 0;
+#else
+	atomic_init(&tmp->references, 0);
+#endif
 	*ref_count = tmp;
 	return 0;
 }
 
 void *
 hsqs_ref_count_retain(struct HsqsRefCount *ref_count) {
+#ifdef CONFIG_SINGLE_THREADED
 	ref_count->references++;
+#else
+	// A new reference can only be taken from an existing one, so no
+	// ordering is needed here.
+	atomic_fetch_add_explicit(&ref_count->references, 1, memory_order_relaxed);
+#endif
+	return get_data(ref_count);
+}
+
+void *
+hsqs_ref_count_data(struct HsqsRefCount *ref_count) {
 	return get_data(ref_count);
 }
 
 int
 hsqs_ref_count_release(struct HsqsRefCount *ref_count) {
+	size_t references;
 	if (ref_count == NULL) {
 		return 0;
 	}
 
-	ref_count->references--;
-	if (ref_count->references == 0) {
+#ifdef CONFIG_SINGLE_THREADED
+	references = --ref_count->references;
+#else
+	// Publish all writes to the object before dropping the reference, and
+	// make the last releaser observe all of them before destroying it.
+	// acq_rel instead of a release plus acquire fence keeps
+	// ThreadSanitizer, which does not model fences, usable.
+	references = atomic_fetch_sub_explicit(
+						 &ref_count->references, 1, memory_order_acq_rel) -
+			1;
+#endif
+	if (references == 0) {
 		ref_count->dtor(get_data(ref_count));
 		free(ref_count);
 		return 0;
 	} else {
-		return ref_count->references;
+		return references;
 	}
 }
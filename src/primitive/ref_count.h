@@ -33,6 +33,9 @@
 
 #include "../utils.h"
 #include <stddef.h>
+#ifndef CONFIG_SINGLE_THREADED
+#include <stdatomic.h>
+#endif
 
 #ifndef REFCOUNT_H
 
@@ -40,8 +43,14 @@
 
 typedef int (*hsqsRefCountDtor)(void *);
 
+#ifdef CONFIG_SINGLE_THREADED
+typedef size_t hsqs_ref_count_t;
+#else
+typedef atomic_size_t hsqs_ref_count_t;
+#endif
+
 struct HsqsRefCount {
-	size_t references;
+	hsqs_ref_count_t references;
 	hsqsRefCountDtor dtor;
 };
 
@@ -51,6 +60,8 @@ int hsqs_ref_count_new(
 
 void *hsqs_ref_count_retain(struct HsqsRefCount *ref_count);
 
+void *hsqs_ref_count_data(struct HsqsRefCount *ref_count);
+
 int hsqs_ref_count_release(struct HsqsRefCount *ref_count);
 
 #endif /* end of include guard REFCOUNT_H */
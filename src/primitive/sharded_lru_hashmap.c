@@ -0,0 +1,164 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright (c) 2022, Enno Boland <g@s01.de>                                 *
+ *                                                                            *
+ * Redistribution and use in source and binary forms, with or without         *
+ * modification, are permitted provided that the following conditions are     *
+ * met:                                                                       *
+ *                                                                            *
+ * * Redistributions of source code must retain the above copyright notice,   *
+ *   this list of conditions and the following disclaimer.                    *
+ * * Redistributions in binary form must reproduce the above copyright        *
+ *   notice, this list of conditions and the following disclaimer in the      *
+ *   documentation and/or other materials provided with the distribution.     *
+ *                                                                            *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS    *
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,  *
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR     *
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR          *
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,      *
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,        *
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR         *
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF     *
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING       *
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS         *
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.               *
+ *                                                                            *
+ ******************************************************************************/
+
+
+/**
+ * @author       Enno Boland (mail@eboland.de)
+ * @file         sharded_lru_hashmap.c
+ */
+
+#include "sharded_lru_hashmap.h"
+#include "../error.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct HsqsLruHashmap *
+shard_for(struct HsqsShardedLruHashmap *hashmap, uint64_t hash) {
+	// Use a different multiplier than the shards themselves so the shard
+	// index and the slot index inside a shard are not correlated.
+	uint64_t mixed = hash * 0xC2B2AE3D27D4EB4FULL;
+	mixed ^= mixed >> 29;
+	return &hashmap->shards[mixed % hashmap->shard_count].hashmap;
+}
+
+static size_t
+per_shard_limit(size_t limit, size_t shard_count) {
+	if (limit == 0) {
+		return 0;
+	}
+	return HSQS_DEVIDE_CEIL(limit, shard_count);
+}
+
+int
+hsqs_sharded_lru_hashmap_init(
+		struct HsqsShardedLruHashmap *hashmap, size_t shard_count,
+		size_t max_entries, size_t max_bytes) {
+	int rv = 0;
+	size_t alloc_size;
+	size_t shard_entries;
+	size_t shard_bytes;
+
+	hashmap->shard_count = 0;
+	hashmap->shards = NULL;
+	if (shard_count == 0) {
+		shard_count = 1;
+	}
+	shard_entries = per_shard_limit(max_entries, shard_count);
+	shard_bytes = per_shard_limit(max_bytes, shard_count);
+
+	if (MULT_OVERFLOW(
+				shard_count, sizeof(struct HsqsLruHashmapShard), &alloc_size)) {
+		rv = -HSQS_ERROR_INTEGER_OVERFLOW;
+		goto out;
+	}
+	hashmap->shards = aligned_alloc(HSQS_CACHE_LINE_SIZE, alloc_size);
+	if (hashmap->shards == NULL) {
+		rv = -HSQS_ERROR_MALLOC_FAILED;
+		goto out;
+	}
+	memset(hashmap->shards, 0, alloc_size);
+
+	for (; hashmap->shard_count < shard_count; hashmap->shard_count++) {
+		rv = hsqs_lru_hashmap_init_limits(
+				&hashmap->shards[hashmap->shard_count].hashmap, shard_entries,
+				shard_bytes);
+		if (rv < 0) {
+			goto out;
+		}
+	}
+
+out:
+	if (rv < 0) {
+		hsqs_sharded_lru_hashmap_cleanup(hashmap);
+	}
+	return rv;
+}
+
+int
+hsqs_sharded_lru_hashmap_put(
+		struct HsqsShardedLruHashmap *hashmap, uint64_t hash,
+		struct HsqsRefCount *pointer) {
+	return hsqs_lru_hashmap_put(shard_for(hashmap, hash), hash, pointer);
+}
+
+int
+hsqs_sharded_lru_hashmap_put_sized(
+		struct HsqsShardedLruHashmap *hashmap, uint64_t hash,
+		struct HsqsRefCount *pointer, size_t weight) {
+	return hsqs_lru_hashmap_put_sized(
+			shard_for(hashmap, hash), hash, pointer, weight);
+}
+
+struct HsqsRefCount *
+hsqs_sharded_lru_hashmap_get(
+		struct HsqsShardedLruHashmap *hashmap, uint64_t hash) {
+	return hsqs_lru_hashmap_get(shard_for(hashmap, hash), hash);
+}
+
+struct HsqsRefCount *
+hsqs_sharded_lru_hashmap_acquire(
+		struct HsqsShardedLruHashmap *hashmap, uint64_t hash) {
+	return hsqs_lru_hashmap_acquire(shard_for(hashmap, hash), hash);
+}
+
+struct HsqsRefCount *
+hsqs_sharded_lru_hashmap_remove(
+		struct HsqsShardedLruHashmap *hashmap, uint64_t hash) {
+	return hsqs_lru_hashmap_remove(shard_for(hashmap, hash), hash);
+}
+
+size_t
+hsqs_sharded_lru_hashmap_hits(const struct HsqsShardedLruHashmap *hashmap) {
+	size_t hits = 0;
+	for (hsqs_index_t i = 0; i < hashmap->shard_count; i++) {
+		hits += hashmap->shards[i].hashmap.hits;
+	}
+	return hits;
+}
+
+size_t
+hsqs_sharded_lru_hashmap_misses(const struct HsqsShardedLruHashmap *hashmap) {
+	size_t misses = 0;
+	for (hsqs_index_t i = 0; i < hashmap->shard_count; i++) {
+		misses += hashmap->shards[i].hashmap.misses;
+	}
+	return misses;
+}
+
+int
+hsqs_sharded_lru_hashmap_cleanup(struct HsqsShardedLruHashmap *hashmap) {
+	for (hsqs_index_t i = 0; i < hashmap->shard_count; i++) {
+		hsqs_lru_hashmap_cleanup(&hashmap->shards[i].hashmap);
+	}
+	free(hashmap->shards);
+	hashmap->shards = NULL;
+	hashmap->shard_count = 0;
+	return 0;
+}
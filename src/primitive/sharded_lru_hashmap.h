@@ -0,0 +1,78 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright (c) 2022, Enno Boland <g@s01.de>                                 *
+ *                                                                            *
+ * Redistribution and use in source and binary forms, with or without         *
+ * modification, are permitted provided that the following conditions are     *
+ * met:                                                                       *
+ *                                                                            *
+ * * Redistributions of source code must retain the above copyright notice,   *
+ *   this list of conditions and the following disclaimer.                    *
+ * * Redistributions in binary form must reproduce the above copyright        *
+ *   notice, this list of conditions and the following disclaimer in the      *
+ *   documentation and/or other materials provided with the distribution.     *
+ *                                                                            *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS    *
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,  *
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR     *
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR          *
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,      *
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,        *
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR         *
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF     *
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING       *
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS         *
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.               *
+ *                                                                            *
+ ******************************************************************************/
+
+
+/**
+ * @author       Enno Boland (mail@eboland.de)
+ * @file         sharded_lru_hashmap.h
+ */
+
+#include "../utils.h"
+#include "lru_hashmap.h"
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifndef SHARDED_LRU_HASHMAP_H
+
+#define SHARDED_LRU_HASHMAP_H
+
+#define HSQS_CACHE_LINE_SIZE 64
+
+struct HsqsLruHashmapShard {
+	// each shard starts on its own cache line so locks of different shards
+	// never share one.
+	_Alignas(HSQS_CACHE_LINE_SIZE) struct HsqsLruHashmap hashmap;
+};
+
+struct HsqsShardedLruHashmap {
+	size_t shard_count;
+	struct HsqsLruHashmapShard *shards;
+};
+
+HSQS_NO_UNUSED int hsqs_sharded_lru_hashmap_init(
+		struct HsqsShardedLruHashmap *hashmap, size_t shard_count,
+		size_t max_entries, size_t max_bytes);
+HSQS_NO_UNUSED int hsqs_sharded_lru_hashmap_put(
+		struct HsqsShardedLruHashmap *hashmap, uint64_t hash,
+		struct HsqsRefCount *pointer);
+HSQS_NO_UNUSED int hsqs_sharded_lru_hashmap_put_sized(
+		struct HsqsShardedLruHashmap *hashmap, uint64_t hash,
+		struct HsqsRefCount *pointer, size_t weight);
+struct HsqsRefCount *hsqs_sharded_lru_hashmap_get(
+		struct HsqsShardedLruHashmap *hashmap, uint64_t hash);
+struct HsqsRefCount *hsqs_sharded_lru_hashmap_acquire(
+		struct HsqsShardedLruHashmap *hashmap, uint64_t hash);
+struct HsqsRefCount *hsqs_sharded_lru_hashmap_remove(
+		struct HsqsShardedLruHashmap *hashmap, uint64_t hash);
+size_t
+hsqs_sharded_lru_hashmap_hits(const struct HsqsShardedLruHashmap *hashmap);
+size_t
+hsqs_sharded_lru_hashmap_misses(const struct HsqsShardedLruHashmap *hashmap);
+int hsqs_sharded_lru_hashmap_cleanup(struct HsqsShardedLruHashmap *hashmap);
+
+#endif /* end of include guard SHARDED_LRU_HASHMAP_H */
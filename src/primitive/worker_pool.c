@@ -0,0 +1,236 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright (c) 2022, Enno Boland <g@s01.de>                                 *
+ *                                                                            *
+ * Redistribution and use in source and binary forms, with or without         *
+ * modification, are permitted provided that the following conditions are     *
+ * met:                                                                       *
+ *                                                                            *
+ * * Redistributions of source code must retain the above copyright notice,   *
+ *   this list of conditions and the following disclaimer.                    *
+ * * Redistributions in binary form must reproduce the above copyright        *
+ *   notice, this list of conditions and the following disclaimer in the      *
+ *   documentation and/or other materials provided with the distribution.     *
+ *                                                                            *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS    *
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,  *
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR     *
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR          *
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,      *
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,        *
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR         *
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF     *
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING       *
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS         *
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.               *
+ *                                                                            *
+ ******************************************************************************/
+
+/**
+ * @author       Enno Boland (mail@eboland.de)
+ * @file         worker_pool.c
+ */
+
+#include "worker_pool.h"
+#include "../error.h"
+
+#include <stdlib.h>
+
+static void *
+worker_main(void *data) {
+	struct HsqsWorkerPool *pool = data;
+	struct HsqsWorkerJob job;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (pool->job_count == 0 && !pool->shutdown) {
+			pthread_cond_wait(&pool->job_available, &pool->lock);
+		}
+		if (pool->job_count == 0) {
+			break;
+		}
+		job = pool->jobs[pool->job_head];
+		pool->job_head = (pool->job_head + 1) % pool->job_capacity;
+		pool->job_count--;
+		pool->running++;
+		pthread_mutex_unlock(&pool->lock);
+
+		job.function(job.argument);
+
+		pthread_mutex_lock(&pool->lock);
+		pool->running--;
+		if (job.group != NULL) {
+			job.group->pending--;
+		}
+		pthread_cond_broadcast(&pool->job_done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+int
+hsqs_worker_pool_init(
+		struct HsqsWorkerPool *pool, size_t thread_count, size_t job_capacity) {
+	int rv = 0;
+
+	pool->threads = NULL;
+	pool->thread_count = 0;
+	pool->started_count = 0;
+	pool->job_head = 0;
+	pool->job_count = 0;
+	pool->running = 0;
+	pool->shutdown = false;
+	pool->job_capacity = MAX(job_capacity, 1);
+	pool->jobs = calloc(pool->job_capacity, sizeof(struct HsqsWorkerJob));
+	if (pool->jobs == NULL) {
+		return -HSQS_ERROR_MALLOC_FAILED;
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->job_available, NULL);
+	pthread_cond_init(&pool->job_done, NULL);
+
+#ifdef CONFIG_SINGLE_THREADED
+	// Reference counts are not atomic, so nothing may run in the
+	// background.
+	thread_count = 0;
+#endif
+	if (thread_count == 0) {
+		return 0;
+	}
+	pool->threads = calloc(thread_count, sizeof(pthread_t));
+	if (pool->threads == NULL) {
+		rv = -HSQS_ERROR_MALLOC_FAILED;
+		goto out;
+	}
+	pool->thread_count = thread_count;
+
+out:
+	if (rv < 0) {
+		hsqs_worker_pool_cleanup(pool);
+	}
+	return rv;
+}
+
+// Called with the lock held. The new threads wait for it before they look
+// at the queue. Threads that fail to start are retried on the next submit.
+static int
+start_threads(struct HsqsWorkerPool *pool) {
+	for (; pool->started_count < pool->thread_count; pool->started_count++) {
+		if (pthread_create(
+					&pool->threads[pool->started_count], NULL, worker_main,
+					pool) != 0) {
+			break;
+		}
+	}
+	if (pool->started_count == 0) {
+		return -HSQS_ERROR_WORKER_POOL_INIT;
+	}
+	return 0;
+}
+
+static int
+submit(
+		struct HsqsWorkerPool *pool, struct HsqsWorkerGroup *group,
+		hsqsWorkerFunction function, void *argument) {
+	int rv = 0;
+	size_t tail;
+
+	pthread_mutex_lock(&pool->lock);
+	if (pool->thread_count == 0 || pool->shutdown ||
+		pool->job_count == pool->job_capacity) {
+		rv = -HSQS_ERROR_WORKER_POOL_FULL;
+		goto out;
+	}
+	if (pool->started_count < pool->thread_count) {
+		rv = start_threads(pool);
+		if (rv < 0) {
+			goto out;
+		}
+	}
+	tail = (pool->job_head + pool->job_count) % pool->job_capacity;
+	pool->jobs[tail].function = function;
+	pool->jobs[tail].argument = argument;
+	pool->jobs[tail].group = group;
+	if (group != NULL) {
+		group->pending++;
+	}
+	pool->job_count++;
+	pthread_cond_signal(&pool->job_available);
+
+out:
+	pthread_mutex_unlock(&pool->lock);
+	return rv;
+}
+
+int
+hsqs_worker_pool_try_submit(
+		struct HsqsWorkerPool *pool, hsqsWorkerFunction function,
+		void *argument) {
+	return submit(pool, NULL, function, argument);
+}
+
+size_t
+hsqs_worker_pool_thread_count(const struct HsqsWorkerPool *pool) {
+	return pool->thread_count;
+}
+
+void
+hsqs_worker_pool_wait(struct HsqsWorkerPool *pool) {
+	pthread_mutex_lock(&pool->lock);
+	while (pool->job_count != 0 || pool->running != 0) {
+		pthread_cond_wait(&pool->job_done, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+int
+hsqs_worker_pool_cleanup(struct HsqsWorkerPool *pool) {
+	if (pool->jobs == NULL) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->shutdown = true;
+	pthread_cond_broadcast(&pool->job_available);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (size_t i = 0; i < pool->started_count; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&pool->job_done);
+	pthread_cond_destroy(&pool->job_available);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->threads);
+	free(pool->jobs);
+	pool->threads = NULL;
+	pool->jobs = NULL;
+	pool->thread_count = 0;
+	pool->started_count = 0;
+	return 0;
+}
+
+void
+hsqs_worker_group_init(
+		struct HsqsWorkerGroup *group, struct HsqsWorkerPool *pool) {
+	group->pool = pool;
+	group->pending = 0;
+}
+
+int
+hsqs_worker_group_try_submit(
+		struct HsqsWorkerGroup *group, hsqsWorkerFunction function,
+		void *argument) {
+	return submit(group->pool, group, function, argument);
+}
+
+void
+hsqs_worker_group_wait(struct HsqsWorkerGroup *group) {
+	struct HsqsWorkerPool *pool = group->pool;
+
+	pthread_mutex_lock(&pool->lock);
+	while (group->pending != 0) {
+		pthread_cond_wait(&pool->job_done, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
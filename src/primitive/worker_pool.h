@@ -0,0 +1,94 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright (c) 2022, Enno Boland <g@s01.de>                                 *
+ *                                                                            *
+ * Redistribution and use in source and binary forms, with or without         *
+ * modification, are permitted provided that the following conditions are     *
+ * met:                                                                       *
+ *                                                                            *
+ * * Redistributions of source code must retain the above copyright notice,   *
+ *   this list of conditions and the following disclaimer.                    *
+ * * Redistributions in binary form must reproduce the above copyright        *
+ *   notice, this list of conditions and the following disclaimer in the      *
+ *   documentation and/or other materials provided with the distribution.     *
+ *                                                                            *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS    *
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,  *
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR     *
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR          *
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,      *
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,        *
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR         *
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF     *
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING       *
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS         *
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.               *
+ *                                                                            *
+ ******************************************************************************/
+
+/**
+ * @author       Enno Boland (mail@eboland.de)
+ * @file         worker_pool.h
+ */
+
+#include "../utils.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef WORKER_POOL_H
+
+#define WORKER_POOL_H
+
+typedef void (*hsqsWorkerFunction)(void *);
+
+struct HsqsWorkerGroup;
+
+struct HsqsWorkerJob {
+	hsqsWorkerFunction function;
+	void *argument;
+	struct HsqsWorkerGroup *group;
+};
+
+// Fixed number of threads serving a bounded job queue. Jobs left in the
+// queue are still run before cleanup returns. The threads are started by
+// the first submit, so a process may fork between init and first use.
+struct HsqsWorkerPool {
+	pthread_mutex_t lock;
+	pthread_cond_t job_available;
+	pthread_cond_t job_done;
+	pthread_t *threads;
+	size_t thread_count;
+	size_t started_count;
+	struct HsqsWorkerJob *jobs;
+	size_t job_capacity;
+	size_t job_head;
+	size_t job_count;
+	size_t running;
+	bool shutdown;
+};
+
+// Jobs submitted through a group can be waited for independently of the
+// other jobs of the pool.
+struct HsqsWorkerGroup {
+	struct HsqsWorkerPool *pool;
+	size_t pending;
+};
+
+HSQS_NO_UNUSED int hsqs_worker_pool_init(
+		struct HsqsWorkerPool *pool, size_t thread_count, size_t job_capacity);
+HSQS_NO_UNUSED int hsqs_worker_pool_try_submit(
+		struct HsqsWorkerPool *pool, hsqsWorkerFunction function,
+		void *argument);
+size_t hsqs_worker_pool_thread_count(const struct HsqsWorkerPool *pool);
+void hsqs_worker_pool_wait(struct HsqsWorkerPool *pool);
+int hsqs_worker_pool_cleanup(struct HsqsWorkerPool *pool);
+
+void hsqs_worker_group_init(
+		struct HsqsWorkerGroup *group, struct HsqsWorkerPool *pool);
+HSQS_NO_UNUSED int hsqs_worker_group_try_submit(
+		struct HsqsWorkerGroup *group, hsqsWorkerFunction function,
+		void *argument);
+void hsqs_worker_group_wait(struct HsqsWorkerGroup *group);
+
+#endif /* end of include guard WORKER_POOL_H */
@@ -54,6 +54,13 @@ hsqs_fragment_table_init(struct HsqsFragmentTable *table, struct Hsqs *hsqs) {
 		goto out;
 	}
 
+	rv = hsqs_lru_hashmap_init_limits(
+			&table->cache, 0, hsqs_options(hsqs)->fragment_cache_size);
+	if (rv < 0) {
+		hsqs_table_cleanup(&table->table);
+		goto out;
+	}
+
 	table->superblock = superblock;
 
 out:
@@ -98,50 +105,125 @@ out:
 	return rv;
 }
 
+static int
+buffer_dtor(void *data) {
+	struct HsqsBuffer *buffer = data;
+	hsqs_buffer_cleanup(buffer);
+	return 0;
+}
+
+static int
+load_fragment_block(
+		struct HsqsFragmentTable *table, uint32_t index,
+		struct HsqsRefCount **block_ref, const struct HsqsBuffer **block) {
+	int rv = 0;
+	struct HsqsRefCount *ref = NULL;
+	struct HsqsBuffer *buffer = NULL;
+	uint32_t block_size = hsqs_superblock_block_size(table->superblock);
+
+	ref = hsqs_lru_hashmap_acquire(&table->cache, index);
+	if (ref != NULL) {
+		buffer = hsqs_ref_count_data(ref);
+		goto out;
+	}
+
+	rv = hsqs_ref_count_new(&ref, sizeof(struct HsqsBuffer), buffer_dtor);
+	if (rv < 0) {
+		goto out;
+	}
+	buffer = hsqs_ref_count_retain(ref);
+	rv = hsqs_block_buffer_init(table->hsqs, buffer, block_size);
+	if (rv < 0) {
+		goto out;
+	}
+
+	rv = read_fragment_data(table, buffer, index);
+	if (rv < 0) {
+		goto out;
+	}
+
+	rv = hsqs_lru_hashmap_put_sized(
+			&table->cache, index, ref, hsqs_buffer_capacity(buffer));
+	if (rv < 0) {
+		goto out;
+	}
+
+out:
+	if (rv < 0) {
+		hsqs_ref_count_release(ref);
+		ref = NULL;
+		buffer = NULL;
+	}
+	*block_ref = ref;
+	*block = buffer;
+	return rv;
+}
+
 int
-hsqs_fragment_table_to_buffer(
-		const struct HsqsFragmentTable *table,
-		const struct HsqsInodeContext *inode, struct HsqsBuffer *buffer) {
+hsqs_fragment_table_slice(
+		struct HsqsFragmentTable *table, const struct HsqsInodeContext *inode,
+		struct HsqsRefCount **slice_ref, const uint8_t **data,
+		uint32_t *size) {
 	int rv = 0;
-	struct HsqsBuffer intermediate_buffer = {0};
-	const uint8_t *data;
+	struct HsqsRefCount *block_ref = NULL;
+	const struct HsqsBuffer *block;
 	uint32_t block_size = hsqs_superblock_block_size(table->superblock);
 	uint32_t index = hsqs_inode_file_fragment_block_index(inode);
 	uint32_t offset = hsqs_inode_file_fragment_block_offset(inode);
-	uint32_t size = hsqs_inode_file_size(inode) % block_size;
+	uint32_t slice_size = hsqs_inode_file_size(inode) % block_size;
 	uint32_t end_offset;
-	if (ADD_OVERFLOW(offset, size, &end_offset)) {
-		return -HSQS_ERROR_INTEGER_OVERFLOW;
-	}
-	enum HsqsSuperblockCompressionId compression_id =
-			hsqs_superblock_compression_id(table->superblock);
-	rv = hsqs_buffer_init(&intermediate_buffer, compression_id, block_size);
-	if (rv < 0) {
+
+	if (ADD_OVERFLOW(offset, slice_size, &end_offset)) {
+		rv = -HSQS_ERROR_INTEGER_OVERFLOW;
 		goto out;
 	}
 
-	rv = read_fragment_data(table, &intermediate_buffer, index);
+	rv = load_fragment_block(table, index, &block_ref, &block);
 	if (rv < 0) {
 		goto out;
 	}
 
-	if (end_offset > hsqs_buffer_size(&intermediate_buffer)) {
-		return -HSQS_ERROR_SIZE_MISSMATCH;
+	if (end_offset > hsqs_buffer_size(block)) {
+		rv = -HSQS_ERROR_SIZE_MISSMATCH;
+		goto out;
 	}
 
-	data = hsqs_buffer_data(&intermediate_buffer);
+	*data = &hsqs_buffer_data(block)[offset];
+	*size = slice_size;
+	*slice_ref = block_ref;
+	block_ref = NULL;
 
-	rv = hsqs_buffer_append_block(buffer, &data[offset], size, false);
+out:
+	hsqs_ref_count_release(block_ref);
+	return rv;
+}
+
+int
+hsqs_fragment_table_to_buffer(
+		struct HsqsFragmentTable *table, const struct HsqsInodeContext *inode,
+		struct HsqsBuffer *buffer) {
+	int rv = 0;
+	struct HsqsRefCount *slice_ref = NULL;
+	const uint8_t *data;
+	uint32_t size;
+
+	rv = hsqs_fragment_table_slice(table, inode, &slice_ref, &data, &size);
+	if (rv < 0) {
+		goto out;
+	}
+
+	rv = hsqs_buffer_append(buffer, data, size);
 	if (rv < 0) {
 		goto out;
 	}
 out:
-	hsqs_buffer_cleanup(&intermediate_buffer);
-	return 0;
+	hsqs_ref_count_release(slice_ref);
+	return rv;
 }
 
 int
 hsqs_fragment_table_cleanup(struct HsqsFragmentTable *table) {
+	hsqs_lru_hashmap_cleanup(&table->cache);
 	hsqs_table_cleanup(&table->table);
 	return 0;
 }
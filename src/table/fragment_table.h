@@ -31,6 +31,7 @@
  * @file         fragment_table.h
  */
 
+#include "../primitive/lru_hashmap.h"
 #include "../utils.h"
 #include "table.h"
 
@@ -38,6 +39,8 @@
 
 #define FRAGMENT_TABLE_H
 
+#define HSQS_FRAGMENT_TABLE_CACHE_SIZE (4 * 1024 * 1024)
+
 struct HsqsSuperblockContext;
 struct HsqsInodeContext;
 struct HsqsBuffer;
@@ -45,14 +48,20 @@ struct HsqsBuffer;
 struct HsqsFragmentTable {
 	const struct HsqsSuperblockContext *superblock;
 	struct HsqsTable table;
+	struct HsqsLruHashmap cache;
 	struct Hsqs *hsqs;
 };
 
 HSQS_NO_UNUSED int
 hsqs_fragment_table_init(struct HsqsFragmentTable *context, struct Hsqs *hsqs);
 
+HSQS_NO_UNUSED int hsqs_fragment_table_slice(
+		struct HsqsFragmentTable *context,
+		const struct HsqsInodeContext *inode, struct HsqsRefCount **slice_ref,
+		const uint8_t **data, uint32_t *size);
+
 HSQS_NO_UNUSED int hsqs_fragment_table_to_buffer(
-		const struct HsqsFragmentTable *context,
+		struct HsqsFragmentTable *context,
 		const struct HsqsInodeContext *inode, struct HsqsBuffer *buffer);
 
 int hsqs_fragment_table_cleanup(struct HsqsFragmentTable *context);
@@ -91,38 +91,34 @@ int
 hsqs_table_get(const struct HsqsTable *table, off_t index, void *target) {
 	int rv = 0;
 	struct Hsqs *hsqs = table->hsqs;
-	struct HsqsSuperblockContext *superblock = hsqs_superblock(hsqs);
 	struct HsqsMetablockContext metablock = {0};
-	struct HsqsBuffer buffer = {0};
 	uint64_t lookup_index =
 			index * table->element_size / HSQS_METABLOCK_BLOCK_SIZE;
 	uint64_t metablock_address = lookup_table_get(table, lookup_index);
 	uint64_t element_index =
 			(index * table->element_size) % HSQS_METABLOCK_BLOCK_SIZE;
 
-	enum HsqsSuperblockCompressionId compression_id =
-			hsqs_superblock_compression_id(superblock);
-	rv = hsqs_buffer_init(&buffer, compression_id, HSQS_METABLOCK_BLOCK_SIZE);
+	rv = hsqs_metablock_init(&metablock, hsqs, metablock_address);
 	if (rv < 0) {
 		goto out;
 	}
 
-	rv = hsqs_metablock_init(&metablock, hsqs, metablock_address);
+	// Copies the element straight out of the metablock cache.
+	rv = hsqs_metablock_read(&metablock);
 	if (rv < 0) {
 		goto out;
 	}
-
-	rv = hsqs_metablock_to_buffer(&metablock, &buffer);
-	if (rv < 0) {
+	if (element_index + table->element_size >
+		hsqs_buffer_size(metablock.buffer)) {
+		rv = -HSQS_ERROR_SIZE_MISSMATCH;
 		goto out;
 	}
 
-	memcpy(target, &hsqs_buffer_data(&buffer)[element_index],
+	memcpy(target, &hsqs_buffer_data(metablock.buffer)[element_index],
 		   table->element_size);
 
 out:
 	hsqs_metablock_cleanup(&metablock);
-	hsqs_buffer_cleanup(&buffer);
 	return rv;
 }
 
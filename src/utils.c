@@ -45,3 +45,13 @@ hsqs_memdup(const void *source, size_t size) {
 
 	return target;
 }
+
+uint64_t
+hsqs_hash(uint64_t hash, const void *data, size_t size) {
+	const uint8_t *bytes = data;
+
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+	}
+	return hash;
+}
@@ -54,8 +54,13 @@
 
 #define HSQS_PADDING(x, p) HSQS_DEVIDE_CEIL(x, p) * p
 
+#define HSQS_HASH_INIT 0xcbf29ce484222325ULL
+
 typedef size_t hsqs_index_t;
 
 HSQS_NO_UNUSED void *hsqs_memdup(const void *source, size_t size);
 
+// FNV-1a. Start with HSQS_HASH_INIT and chain calls to hash several fields.
+uint64_t hsqs_hash(uint64_t hash, const void *data, size_t size);
+
 #endif /* end of include guard HSQS_UTILS_H */
@@ -33,7 +33,10 @@
 
 #include "../src/context/content_context.h"
 #include "../src/context/inode_context.h"
+#include "../src/context/metablock_context.h"
+#include "../src/context/metablock_stream_context.h"
 #include "../src/context/superblock_context.h"
+#include "../src/data/metablock.h"
 #include "../src/data/superblock.h"
 #include "../src/error.h"
 #include "../src/hsqs.h"
@@ -42,8 +45,10 @@
 #include "../src/table/xattr_table.h"
 #include "common.h"
 #include "test.h"
+#include <pthread.h>
 #include <squashfs_image.h>
 #include <stdint.h>
+#include <string.h>
 
 static void
 hsqs_empty() {
@@ -69,6 +74,170 @@ hsqs_get_nonexistant() {
 	assert(rv == 0);
 }
 
+static void
+hsqs_lookup_root_path() {
+	int rv;
+	struct HsqsInodeContext root = {0};
+	struct HsqsInodeContext inode = {0};
+	struct Hsqs hsqs = {0};
+
+	rv = hsqs_init(&hsqs, squash_image, sizeof(squash_image));
+	assert(rv == 0);
+	rv = hsqs_inode_load_root(&root, &hsqs);
+	assert(rv == 0);
+
+	rv = hsqs_inode_load_by_path(&inode, &hsqs, NULL);
+	assert(rv == 0);
+	assert(hsqs_inode_type(&inode) == HSQS_INODE_TYPE_DIRECTORY);
+	assert(hsqs_inode_number(&inode) == hsqs_inode_number(&root));
+	rv = hsqs_inode_cleanup(&inode);
+	assert(rv == 0);
+
+	rv = hsqs_inode_load_by_path(&inode, &hsqs, "");
+	assert(rv == 0);
+	assert(hsqs_inode_number(&inode) == hsqs_inode_number(&root));
+	rv = hsqs_inode_cleanup(&inode);
+	assert(rv == 0);
+
+	rv = hsqs_inode_cleanup(&root);
+	assert(rv == 0);
+	rv = hsqs_cleanup(&hsqs);
+	assert(rv == 0);
+}
+
+static void
+hsqs_lookup_dentry_cache() {
+	int rv;
+	struct HsqsInodeContext inode = {0};
+	struct Hsqs hsqs = {0};
+	struct HsqsDentryCache *cache;
+	size_t misses, hits;
+
+	rv = hsqs_init(&hsqs, squash_image, sizeof(squash_image));
+	assert(rv == 0);
+	cache = hsqs_dentry_cache(&hsqs);
+
+	// neither the path nor the directory entry are cached yet
+	rv = hsqs_inode_load_by_path(&inode, &hsqs, "/b");
+	assert(rv == 0);
+	assert(hsqs_inode_file_size(&inode) == 1050000);
+	rv = hsqs_inode_cleanup(&inode);
+	assert(rv == 0);
+	misses = hsqs_dentry_cache_misses(cache);
+	hits = hsqs_dentry_cache_hits(cache);
+	assert(misses == 2);
+	assert(hits == 0);
+
+	// the normalized path is found directly
+	rv = hsqs_inode_load_by_path(&inode, &hsqs, "./b");
+	assert(rv == 0);
+	assert(hsqs_inode_file_size(&inode) == 1050000);
+	rv = hsqs_inode_cleanup(&inode);
+	assert(rv == 0);
+	assert(hsqs_dentry_cache_misses(cache) == misses);
+	assert(hsqs_dentry_cache_hits(cache) == hits + 1);
+
+	// failed lookups are cached as negative entries
+	rv = hsqs_inode_load_by_path(&inode, &hsqs, "/nonexistant");
+	assert(rv == -HSQS_ERROR_NO_SUCH_FILE);
+	hits = hsqs_dentry_cache_hits(cache);
+	rv = hsqs_inode_load_by_path(&inode, &hsqs, "/nonexistant");
+	assert(rv == -HSQS_ERROR_NO_SUCH_FILE);
+	assert(hsqs_dentry_cache_hits(cache) == hits + 1);
+
+	// paths with ".." are resolved segment by segment
+	rv = hsqs_inode_load_by_path(&inode, &hsqs, "/a/../b");
+	assert(rv == 0);
+	assert(hsqs_inode_file_size(&inode) == 1050000);
+	rv = hsqs_inode_cleanup(&inode);
+	assert(rv == 0);
+
+	rv = hsqs_cleanup(&hsqs);
+	assert(rv == 0);
+}
+
+static void
+hsqs_lookup_name_index() {
+	int rv;
+	uint64_t inode_ref;
+	enum HsqsInodeContextType type;
+	struct HsqsNameIndexContext index = {0};
+	struct Hsqs hsqs = {0};
+	struct HsqsShardedLruHashmap *cache;
+	uint64_t root_ref;
+
+	rv = hsqs_init(&hsqs, squash_image, sizeof(squash_image));
+	assert(rv == 0);
+	cache = hsqs_name_index_cache(&hsqs);
+	root_ref = hsqs_superblock_inode_root_ref(hsqs_superblock(&hsqs));
+
+	rv = hsqs_name_index_init(&index, &hsqs, root_ref);
+	assert(rv == 0);
+	assert(hsqs_name_index_count(&index) == 4);
+	assert(hsqs_sharded_lru_hashmap_misses(cache) == 1);
+
+	rv = hsqs_name_index_lookup(&index, "b", 1, &inode_ref, &type);
+	assert(rv == 0);
+	assert(type == HSQS_INODE_TYPE_FILE);
+	rv = hsqs_name_index_lookup(&index, "bb", 2, &inode_ref, &type);
+	assert(rv == -HSQS_ERROR_NO_SUCH_FILE);
+	rv = hsqs_name_index_cleanup(&index);
+	assert(rv == 0);
+
+	// the index is built only once per directory
+	rv = hsqs_name_index_init(&index, &hsqs, root_ref);
+	assert(rv == 0);
+	assert(hsqs_sharded_lru_hashmap_misses(cache) == 1);
+	assert(hsqs_sharded_lru_hashmap_hits(cache) == 1);
+	rv = hsqs_name_index_lookup(&index, "a", 1, &inode_ref, NULL);
+	assert(rv == 0);
+	rv = hsqs_name_index_cleanup(&index);
+	assert(rv == 0);
+
+	rv = hsqs_cleanup(&hsqs);
+	assert(rv == 0);
+}
+
+static void
+hsqs_lookup_name_index_counted() {
+	int rv;
+	uint64_t root_ref;
+	struct HsqsInodeContext root = {0};
+	struct HsqsInodeContext inode = {0};
+	struct HsqsNameIndexContext index = {0};
+	struct Hsqs hsqs = {0};
+
+	rv = hsqs_init(&hsqs, squash_image, sizeof(squash_image));
+	assert(rv == 0);
+	root_ref = hsqs_superblock_inode_root_ref(hsqs_superblock(&hsqs));
+	rv = hsqs_inode_load_root(&root, &hsqs);
+	assert(rv == 0);
+
+	// a one-off lookup scans the directory instead of indexing it.
+	rv = hsqs_inode_load_by_path(&inode, &hsqs, "a");
+	assert(rv == 0);
+	rv = hsqs_inode_cleanup(&inode);
+	assert(rv == 0);
+	rv = hsqs_name_index_init_counted(&index, &root, root_ref);
+	assert(rv == 0);
+	// the root fits into one metablock, so the second lookup indexes it.
+	assert(index.index != NULL);
+	assert(hsqs_name_index_count(&index) == 4);
+	rv = hsqs_name_index_cleanup(&index);
+	assert(rv == 0);
+
+	rv = hsqs_inode_load_by_path(&inode, &hsqs, "b");
+	assert(rv == 0);
+	assert(hsqs_inode_file_size(&inode) == 1050000);
+	rv = hsqs_inode_cleanup(&inode);
+	assert(rv == 0);
+
+	rv = hsqs_inode_cleanup(&root);
+	assert(rv == 0);
+	rv = hsqs_cleanup(&hsqs);
+	assert(rv == 0);
+}
+
 static void
 hsqs_ls() {
 	int rv;
@@ -99,6 +268,20 @@ hsqs_ls() {
 	assert(strcmp("b", name) == 0);
 	free(name);
 
+	rv = hsqs_directory_iterator_next(&iter);
+	assert(rv >= 0);
+	rv = hsqs_directory_iterator_name_dup(&iter, &name);
+	assert(rv == 1);
+	assert(strcmp("c", name) == 0);
+	free(name);
+
+	rv = hsqs_directory_iterator_next(&iter);
+	assert(rv > 0);
+	rv = hsqs_directory_iterator_name_dup(&iter, &name);
+	assert(rv == 1);
+	assert(strcmp("d", name) == 0);
+	free(name);
+
 	rv = hsqs_directory_iterator_next(&iter);
 	// End of file list
 	assert(rv == 0);
@@ -227,6 +410,640 @@ hsqs_cat_size_overflow() {
 	assert(rv == 0);
 }
 
+static void
+hsqs_cat_window() {
+	int rv;
+	const uint8_t *data;
+	struct HsqsInodeContext inode = {0};
+	struct HsqsFileContext file = {0};
+	struct Hsqs hsqs = {0};
+	rv = hsqs_init(&hsqs, squash_image, sizeof(squash_image));
+	assert(rv == 0);
+
+	rv = hsqs_inode_load_by_path(&inode, &hsqs, "b");
+	assert(rv == 0);
+
+	rv = hsqs_content_init(&file, &inode);
+	assert(rv == 0);
+	hsqs_content_set_read_ahead(&file, 2);
+
+	rv = hsqs_content_seek(&file, 3 * 131072 + 5);
+	assert(rv == 0);
+
+	rv = hsqs_content_read(&file, 100);
+	assert(rv >= 0);
+	// only the block containing the window is decompressed
+	assert(hsqs_content_size(&file) == 131072 - 5);
+
+	data = hsqs_content_data(&file);
+	for (hsqs_index_t i = 0; i < 100; i++) {
+		assert(data[i] == 'b');
+	}
+
+	rv = hsqs_content_cleanup(&file);
+	assert(rv == 0);
+
+	rv = hsqs_inode_cleanup(&inode);
+	assert(rv == 0);
+
+	rv = hsqs_cleanup(&hsqs);
+	assert(rv == 0);
+}
+
+static void
+hsqs_cat_reuse_context() {
+	int rv;
+	const uint8_t *data;
+	struct HsqsInodeContext inode = {0};
+	struct HsqsFileContext file = {0};
+	struct Hsqs hsqs = {0};
+	rv = hsqs_init(&hsqs, squash_image, sizeof(squash_image));
+	assert(rv == 0);
+
+	rv = hsqs_inode_load_by_path(&inode, &hsqs, "b");
+	assert(rv == 0);
+
+	rv = hsqs_content_init(&file, &inode);
+	assert(rv == 0);
+
+	rv = hsqs_content_seek(&file, 3 * 131072 + 5);
+	assert(rv == 0);
+	rv = hsqs_content_read(&file, 100);
+	assert(rv >= 0);
+	assert(hsqs_content_size(&file) == 131072 - 5);
+	data = hsqs_content_data(&file);
+
+	// a second read of the same size reuses the allocation
+	rv = hsqs_content_seek(&file, 131072 + 5);
+	assert(rv == 0);
+	rv = hsqs_content_read(&file, 100);
+	assert(rv >= 0);
+	assert(hsqs_content_size(&file) == 131072 - 5);
+	assert(hsqs_content_data(&file) == data);
+	assert(hsqs_buffer_capacity(&file.buffer) == 131072);
+
+	// the last block is followed by the fragment
+	rv = hsqs_content_seek(&file, 8 * 131072 - 10);
+	assert(rv == 0);
+	rv = hsqs_content_read(&file, 100);
+	assert(rv >= 0);
+	assert(hsqs_content_size(&file) == 1050000 - 8 * 131072 + 10);
+	assert(hsqs_buffer_capacity(&file.buffer) == 1050000 - 7 * 131072);
+	data = hsqs_content_data(&file);
+	for (hsqs_index_t i = 0; i < 100; i++) {
+		assert(data[i] == 'b');
+	}
+
+	rv = hsqs_content_cleanup(&file);
+	assert(rv == 0);
+
+	rv = hsqs_inode_cleanup(&inode);
+	assert(rv == 0);
+
+	rv = hsqs_cleanup(&hsqs);
+	assert(rv == 0);
+}
+
+static void
+hsqs_cat_datablock_cache() {
+	int rv;
+	size_t misses, hits;
+	struct HsqsInodeContext inode = {0};
+	struct HsqsFileContext file1 = {0};
+	struct HsqsFileContext file2 = {0};
+	struct Hsqs hsqs = {0};
+	struct HsqsShardedLruHashmap *cache;
+	rv = hsqs_init(&hsqs, squash_image, sizeof(squash_image));
+	assert(rv == 0);
+	cache = hsqs_datablock_cache(&hsqs);
+
+	rv = hsqs_inode_load_by_path(&inode, &hsqs, "b");
+	assert(rv == 0);
+
+	rv = hsqs_content_init(&file1, &inode);
+	assert(rv == 0);
+	rv = hsqs_content_read(&file1, 131072);
+	assert(rv >= 0);
+	misses = hsqs_sharded_lru_hashmap_misses(cache);
+	hits = hsqs_sharded_lru_hashmap_hits(cache);
+	assert(misses == 1);
+
+	rv = hsqs_content_init(&file2, &inode);
+	assert(rv == 0);
+	rv = hsqs_content_read(&file2, 131072);
+	assert(rv >= 0);
+	assert(hsqs_sharded_lru_hashmap_misses(cache) == misses);
+	assert(hsqs_sharded_lru_hashmap_hits(cache) == hits + 1);
+
+	assert(hsqs_content_size(&file1) == hsqs_content_size(&file2));
+	assert(memcmp(hsqs_content_data(&file1), hsqs_content_data(&file2),
+				  hsqs_content_size(&file1)) == 0);
+
+	rv = hsqs_content_cleanup(&file1);
+	assert(rv == 0);
+	rv = hsqs_content_cleanup(&file2);
+	assert(rv == 0);
+
+	rv = hsqs_inode_cleanup(&inode);
+	assert(rv == 0);
+
+	rv = hsqs_cleanup(&hsqs);
+	assert(rv == 0);
+}
+
+#ifndef CONFIG_SINGLE_THREADED
+static void
+hsqs_cat_prefetch() {
+	int rv;
+	const uint8_t *data;
+	struct HsqsInodeContext inode = {0};
+	struct HsqsFileContext file = {0};
+	struct Hsqs hsqs = {0};
+	struct HsqsOptions options = {.worker_count = 2};
+	rv = hsqs_init_ex(&hsqs, squash_image, sizeof(squash_image), &options);
+	assert(rv == 0);
+
+	rv = hsqs_inode_load_by_path(&inode, &hsqs, "b");
+	assert(rv == 0);
+	rv = hsqs_content_init(&file, &inode);
+	assert(rv == 0);
+
+	// the first read misses and queues the next block.
+	rv = hsqs_content_read(&file, 131072);
+	assert(rv >= 0);
+	assert(file.prefetch_window == 1);
+	assert(file.prefetch_end_block == 2);
+	hsqs_worker_pool_wait(hsqs_worker_pool(&hsqs));
+
+	// the next block was prefetched, so the window stays as it is.
+	rv = hsqs_content_seek(&file, 131072);
+	assert(rv == 0);
+	rv = hsqs_content_read(&file, 131072);
+	assert(rv >= 0);
+	assert(file.prefetch_window == 1);
+	assert(file.prefetch_end_block == 3);
+	data = hsqs_content_data(&file);
+	for (hsqs_index_t i = 0; i < 131072; i++) {
+		assert(data[i] == 'b');
+	}
+
+	// random access shrinks the window.
+	rv = hsqs_content_seek(&file, 6 * 131072);
+	assert(rv == 0);
+	rv = hsqs_content_read(&file, 100);
+	assert(rv >= 0);
+	assert(file.prefetch_window == 0);
+
+	rv = hsqs_content_cleanup(&file);
+	assert(rv == 0);
+	rv = hsqs_inode_cleanup(&inode);
+	assert(rv == 0);
+	rv = hsqs_cleanup(&hsqs);
+	assert(rv == 0);
+}
+
+static void
+hsqs_cat_parallel() {
+	int rv;
+	const uint8_t *data;
+	struct HsqsInodeContext inode = {0};
+	struct HsqsFileContext file = {0};
+	struct Hsqs hsqs = {0};
+	struct HsqsOptions options = {
+			.worker_count = 3, .parallel_read_min_blocks = 2};
+	rv = hsqs_init_ex(&hsqs, squash_image, sizeof(squash_image), &options);
+	assert(rv == 0);
+
+	rv = hsqs_inode_load_by_path(&inode, &hsqs, "b");
+	assert(rv == 0);
+	rv = hsqs_content_init(&file, &inode);
+	assert(rv == 0);
+
+	// a single block stays on the calling thread and fills the cache.
+	rv = hsqs_content_seek(&file, 2 * 131072);
+	assert(rv == 0);
+	rv = hsqs_content_read(&file, 131072);
+	assert(rv >= 0);
+
+	// the whole file mixes cached, extracted and fragment data.
+	rv = hsqs_content_seek(&file, 0);
+	assert(rv == 0);
+	rv = hsqs_content_read(&file, 1050000);
+	assert(rv >= 0);
+	assert(hsqs_content_size(&file) == 1050000);
+	data = hsqs_content_data(&file);
+	for (hsqs_index_t i = 0; i < 1050000; i++) {
+		assert(data[i] == 'b');
+	}
+
+	rv = hsqs_content_seek(&file, 131072 + 5);
+	assert(rv == 0);
+	rv = hsqs_content_read(&file, 3 * 131072);
+	assert(rv >= 0);
+	// the window ends 5 bytes into the fourth block.
+	assert(hsqs_content_size(&file) == 4 * 131072 - 5);
+
+	rv = hsqs_content_cleanup(&file);
+	assert(rv == 0);
+	rv = hsqs_inode_cleanup(&inode);
+	assert(rv == 0);
+	rv = hsqs_cleanup(&hsqs);
+	assert(rv == 0);
+}
+#endif
+
+static void
+read_sparse_file(const struct HsqsOptions *options) {
+	int rv;
+	const uint8_t *data;
+	struct HsqsInodeContext inode = {0};
+	struct HsqsFileContext file = {0};
+	struct Hsqs hsqs = {0};
+	rv = hsqs_init_ex(&hsqs, squash_image, sizeof(squash_image), options);
+	assert(rv == 0);
+
+	rv = hsqs_inode_load_by_path(&inode, &hsqs, "c");
+	assert(rv == 0);
+	assert(hsqs_inode_file_size(&inode) == 4 * 131072 + 100);
+	assert(hsqs_inode_file_block_size(&inode, 1) == 0);
+	assert(hsqs_inode_file_block_size(&inode, 2) == 0);
+	rv = hsqs_content_init(&file, &inode);
+	assert(rv == 0);
+
+	// the second pass finds the data block after the holes in the cache.
+	for (int pass = 0; pass < 2; pass++) {
+		rv = hsqs_content_seek(&file, 0);
+		assert(rv == 0);
+		rv = hsqs_content_read(&file, hsqs_inode_file_size(&inode));
+		assert(rv >= 0);
+		assert(hsqs_content_size(&file) == 4 * 131072 + 100);
+		data = hsqs_content_data(&file);
+		for (hsqs_index_t i = 0; i < 4 * 131072 + 100; i++) {
+			assert(data[i] == (i < 131072 || i >= 3 * 131072 ? 'c' : 0));
+		}
+	}
+
+	// start in the middle of the first hole.
+	rv = hsqs_content_seek(&file, 131072 + 5);
+	assert(rv == 0);
+	rv = hsqs_content_read(&file, 2 * 131072);
+	assert(rv >= 0);
+	assert(hsqs_content_size(&file) == 3 * 131072 - 5);
+	data = hsqs_content_data(&file);
+	for (hsqs_index_t i = 0; i < 3 * 131072 - 5; i++) {
+		assert(data[i] == (i < 2 * 131072 - 5 ? 0 : 'c'));
+	}
+
+	rv = hsqs_content_cleanup(&file);
+	assert(rv == 0);
+	rv = hsqs_inode_cleanup(&inode);
+	assert(rv == 0);
+	rv = hsqs_cleanup(&hsqs);
+	assert(rv == 0);
+}
+
+static void
+hsqs_cat_sparse() {
+	struct HsqsOptions serial = {0};
+	struct HsqsOptions parallel = {
+			.worker_count = 3, .parallel_read_min_blocks = 2};
+
+	read_sparse_file(&serial);
+	read_sparse_file(&parallel);
+}
+
+static void
+hsqs_cat_fragment_cache() {
+	int rv;
+	struct HsqsInodeContext inode_a = {0};
+	struct HsqsInodeContext inode_b = {0};
+	struct HsqsFileContext file_a = {0};
+	struct HsqsFileContext file_b = {0};
+	struct HsqsFragmentTable *table;
+	struct Hsqs hsqs = {0};
+	rv = hsqs_init(&hsqs, squash_image, sizeof(squash_image));
+	assert(rv == 0);
+
+	rv = hsqs_fragment_table(&hsqs, &table);
+	assert(rv == 0);
+
+	rv = hsqs_inode_load_by_path(&inode_a, &hsqs, "a");
+	assert(rv == 0);
+	rv = hsqs_inode_load_by_path(&inode_b, &hsqs, "b");
+	assert(rv == 0);
+	assert(hsqs_inode_file_fragment_block_index(&inode_a) ==
+		   hsqs_inode_file_fragment_block_index(&inode_b));
+
+	rv = hsqs_content_init(&file_a, &inode_a);
+	assert(rv == 0);
+	rv = hsqs_content_read(&file_a, hsqs_inode_file_size(&inode_a));
+	assert(rv == 0);
+	assert(hsqs_content_size(&file_a) == 2);
+	assert(memcmp(hsqs_content_data(&file_a), "a\n", 2) == 0);
+	assert(table->cache.misses == 1);
+	assert(table->cache.hits == 0);
+
+	rv = hsqs_content_init(&file_b, &inode_b);
+	assert(rv == 0);
+	rv = hsqs_content_seek(&file_b, 1050000 - 10);
+	assert(rv == 0);
+	rv = hsqs_content_read(&file_b, 10);
+	assert(rv == 0);
+	assert(hsqs_content_size(&file_b) == 10);
+	assert(memcmp(hsqs_content_data(&file_b), "bbbbbbbbbb", 10) == 0);
+	assert(table->cache.misses == 1);
+	assert(table->cache.hits == 1);
+
+	rv = hsqs_content_cleanup(&file_a);
+	assert(rv == 0);
+	rv = hsqs_content_cleanup(&file_b);
+	assert(rv == 0);
+
+	rv = hsqs_inode_cleanup(&inode_a);
+	assert(rv == 0);
+	rv = hsqs_inode_cleanup(&inode_b);
+	assert(rv == 0);
+
+	rv = hsqs_cleanup(&hsqs);
+	assert(rv == 0);
+}
+
+static void *
+cat_worker(void *arg) {
+	int rv;
+	const uint8_t *data;
+	struct Hsqs *hsqs = arg;
+	struct HsqsInodeContext inode = {0};
+	struct HsqsFileContext file = {0};
+
+	rv = hsqs_inode_load_by_path(&inode, hsqs, "b");
+	assert(rv == 0);
+	assert(hsqs_inode_uid(&inode) == 2020);
+	rv = hsqs_content_init(&file, &inode);
+	assert(rv == 0);
+	rv = hsqs_content_read(&file, hsqs_inode_file_size(&inode));
+	assert(rv == 0);
+	assert(hsqs_content_size(&file) == 1050000);
+
+	data = hsqs_content_data(&file);
+	for (hsqs_index_t i = 0; i < 1050000; i++) {
+		assert(data[i] == 'b');
+	}
+
+	rv = hsqs_content_cleanup(&file);
+	assert(rv == 0);
+	rv = hsqs_inode_cleanup(&inode);
+	assert(rv == 0);
+	return NULL;
+}
+
+static void
+hsqs_cat_multithreaded() {
+	int rv;
+	pthread_t threads[4];
+	struct Hsqs hsqs = {0};
+	rv = hsqs_init(&hsqs, squash_image, sizeof(squash_image));
+	assert(rv == 0);
+
+	// the workers race for the lazily initialized tables
+	for (hsqs_index_t i = 0; i < sizeof(threads) / sizeof(*threads); i++) {
+		rv = pthread_create(&threads[i], NULL, cat_worker, &hsqs);
+		assert(rv == 0);
+	}
+	for (hsqs_index_t i = 0; i < sizeof(threads) / sizeof(*threads); i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	rv = hsqs_cleanup(&hsqs);
+	assert(rv == 0);
+}
+
+static void
+hsqs_file_block_offset() {
+	int rv;
+	uint64_t offset, next_offset;
+	uint32_t block_count;
+	struct HsqsInodeContext inode = {0};
+	struct Hsqs hsqs = {0};
+	rv = hsqs_init(&hsqs, squash_image, sizeof(squash_image));
+	assert(rv == 0);
+
+	rv = hsqs_inode_load_by_path(&inode, &hsqs, "b");
+	assert(rv == 0);
+
+	block_count = hsqs_inode_file_block_count(&inode);
+	assert(block_count == 1050000 / 131072);
+
+	rv = hsqs_inode_file_block_offset(&inode, 0, &offset);
+	assert(rv == 0);
+	assert(offset == 0);
+	for (uint32_t i = 0; i < block_count; i++) {
+		rv = hsqs_inode_file_block_offset(&inode, i + 1, &next_offset);
+		assert(rv == 0);
+		assert(next_offset - offset == hsqs_inode_file_block_size(&inode, i));
+		offset = next_offset;
+	}
+
+	rv = hsqs_inode_file_block_offset(&inode, block_count + 1, &offset);
+	assert(rv == -HSQS_ERROR_SEEK_OUT_OF_RANGE);
+
+	rv = hsqs_inode_cleanup(&inode);
+	assert(rv == 0);
+
+	rv = hsqs_cleanup(&hsqs);
+	assert(rv == 0);
+}
+
+static void
+hsqs_file_block_offset_checkpoints() {
+	int rv;
+	const uint8_t *data;
+	uint64_t offset, expected = 0;
+	uint32_t block_count;
+	struct HsqsInodeContext inode = {0};
+	struct HsqsInodeContext other = {0};
+	struct HsqsFileContext file = {0};
+	struct Hsqs hsqs = {0};
+	rv = hsqs_init(&hsqs, squash_image, sizeof(squash_image));
+	assert(rv == 0);
+
+	rv = hsqs_inode_load_by_path(&inode, &hsqs, "d");
+	assert(rv == 0);
+	block_count = hsqs_inode_file_block_count(&inode);
+	assert(block_count == 70);
+	assert(block_count > HSQS_INODE_BLOCK_INDEX_STRIDE);
+
+	for (uint32_t i = 0; i <= block_count; i++) {
+		rv = hsqs_inode_file_block_offset(&inode, i, &offset);
+		assert(rv == 0);
+		assert(offset == expected);
+		if (i < block_count) {
+			expected += hsqs_inode_file_block_size(&inode, i);
+		}
+	}
+
+	// contexts of the same inode share the index of the cached record.
+	rv = hsqs_inode_load_by_path(&other, &hsqs, "d");
+	assert(rv == 0);
+	assert(other.record == inode.record);
+	assert(inode.record->block_index.offsets != NULL);
+	rv = hsqs_inode_file_block_offset(&other, block_count, &offset);
+	assert(rv == 0);
+	assert(offset == expected);
+
+	// a block past the first checkpoint
+	rv = hsqs_content_init(&file, &other);
+	assert(rv == 0);
+	rv = hsqs_content_seek(&file, 66 * 131072);
+	assert(rv == 0);
+	rv = hsqs_content_read(&file, 131072);
+	assert(rv >= 0);
+	assert(hsqs_content_size(&file) == 131072);
+	data = hsqs_content_data(&file);
+	for (hsqs_index_t i = 0; i < 131072; i++) {
+		assert(data[i] == 'd');
+	}
+
+	rv = hsqs_content_cleanup(&file);
+	assert(rv == 0);
+	rv = hsqs_inode_cleanup(&other);
+	assert(rv == 0);
+	rv = hsqs_inode_cleanup(&inode);
+	assert(rv == 0);
+	rv = hsqs_cleanup(&hsqs);
+	assert(rv == 0);
+}
+
+static void
+hsqs_inode_cache_records() {
+	int rv;
+	struct HsqsInodeContext inode = {0};
+	struct HsqsInodeContext other = {0};
+	struct Hsqs hsqs = {0};
+	struct HsqsShardedLruHashmap *cache;
+
+	rv = hsqs_init(&hsqs, squash_image, sizeof(squash_image));
+	assert(rv == 0);
+	cache = hsqs_inode_cache(&hsqs);
+
+	rv = hsqs_inode_load_by_path(&inode, &hsqs, "/b");
+	assert(rv == 0);
+	assert(hsqs_sharded_lru_hashmap_hits(cache) == 0);
+	assert(hsqs_inode_type(&inode) == HSQS_INODE_TYPE_FILE);
+	assert(hsqs_inode_file_size(&inode) == 1050000);
+
+	// loading the same inode again shares the parsed record
+	rv = hsqs_inode_load_by_path(&other, &hsqs, "/b");
+	assert(rv == 0);
+	assert(hsqs_sharded_lru_hashmap_hits(cache) == 1);
+	assert(other.record == inode.record);
+	assert(hsqs_inode_file_block_count(&other) == 8);
+	assert(hsqs_inode_uid(&other) == 2020);
+	assert(hsqs_inode_gid(&other) == 202020);
+
+	// the record outlives the context it was loaded with
+	rv = hsqs_inode_cleanup(&inode);
+	assert(rv == 0);
+	assert(hsqs_inode_file_size(&other) == 1050000);
+	rv = hsqs_inode_cleanup(&other);
+	assert(rv == 0);
+
+	rv = hsqs_cleanup(&hsqs);
+	assert(rv == 0);
+}
+
+static void
+hsqs_metablock_stream_zero_copy() {
+	int rv;
+	uint64_t root_ref;
+	struct HsqsMetablockStreamContext stream = {0};
+	struct Hsqs hsqs = {0};
+	struct HsqsSuperblockContext *superblock;
+
+	rv = hsqs_init(&hsqs, squash_image, sizeof(squash_image));
+	assert(rv == 0);
+	superblock = hsqs_superblock(&hsqs);
+	root_ref = hsqs_superblock_inode_root_ref(superblock);
+
+	rv = hsqs_metablock_stream_init(
+			&stream, &hsqs, hsqs_superblock_inode_table_start(superblock), ~0);
+	assert(rv == 0);
+	rv = hsqs_metablock_stream_seek_ref(&stream, root_ref);
+	assert(rv == 0);
+	rv = hsqs_metablock_stream_more(&stream, 16);
+	assert(rv == 0);
+
+	// a window inside of one metablock points into the metablock cache
+	assert(hsqs_buffer_size(&stream.buffer) == 0);
+	assert(hsqs_metablock_stream_data(&stream) ==
+		   &hsqs_buffer_data(stream.block)[root_ref & 0xFFFF]);
+
+	rv = hsqs_metablock_stream_skip(&stream, 4);
+	assert(rv == 0);
+	rv = hsqs_metablock_stream_more(&stream, 12);
+	assert(rv == 0);
+	assert(hsqs_metablock_stream_data(&stream) ==
+		   &hsqs_buffer_data(stream.block)[(root_ref & 0xFFFF) + 4]);
+
+	rv = hsqs_metablock_stream_cleanup(&stream);
+	assert(rv == 0);
+	rv = hsqs_cleanup(&hsqs);
+	assert(rv == 0);
+}
+
+static void
+hsqs_metablock_stream_skip_in_block() {
+	int rv;
+	const size_t block_size = HSQS_SIZEOF_METABLOCK + HSQS_METABLOCK_BLOCK_SIZE;
+	const size_t image_size = sizeof(squash_image) + 3 * block_size;
+	const uint8_t *data;
+	uint8_t *image, *block;
+	struct HsqsMetablockStreamContext stream = {0};
+	struct Hsqs hsqs = {0};
+
+	// three uncompressed metablocks after the image. The stream offset i
+	// holds i % 251, so every block has different contents.
+	image = malloc(image_size);
+	assert(image != NULL);
+	memcpy(image, squash_image, sizeof(squash_image));
+	for (size_t i = 0; i < 3; i++) {
+		block = &image[sizeof(squash_image) + i * block_size];
+		block[0] = HSQS_METABLOCK_BLOCK_SIZE & 0xFF;
+		block[1] = (HSQS_METABLOCK_BLOCK_SIZE >> 8) | 0x80;
+		for (size_t j = 0; j < HSQS_METABLOCK_BLOCK_SIZE; j++) {
+			block[HSQS_SIZEOF_METABLOCK + j] =
+					(i * HSQS_METABLOCK_BLOCK_SIZE + j) % 251;
+		}
+	}
+	rv = hsqs_init(&hsqs, image, image_size);
+	assert(rv == 0);
+
+	rv = hsqs_metablock_stream_init(
+			&stream, &hsqs, sizeof(squash_image), image_size);
+	assert(rv == 0);
+	rv = hsqs_metablock_stream_skip(&stream, 8190);
+	assert(rv == 0);
+	rv = hsqs_metablock_stream_more(&stream, 10);
+	assert(rv == 0);
+
+	// the skip stays in the first block, the window must continue with
+	// the second one again.
+	rv = hsqs_metablock_stream_skip(&stream, 1);
+	assert(rv == 0);
+	rv = hsqs_metablock_stream_more(&stream, 4000);
+	assert(rv == 0);
+	data = hsqs_metablock_stream_data(&stream);
+	for (size_t i = 0; i < 4000; i++) {
+		assert(data[i] == (8191 + i) % 251);
+	}
+
+	rv = hsqs_metablock_stream_cleanup(&stream);
+	assert(rv == 0);
+	rv = hsqs_cleanup(&hsqs);
+	assert(rv == 0);
+	free(image);
+}
+
 static void
 hsqs_test_uid_and_gid() {
 	int rv;
@@ -572,10 +1389,29 @@ DEFINE
 TEST(hsqs_empty);
 TEST(hsqs_ls);
 TEST(hsqs_get_nonexistant);
+TEST(hsqs_lookup_root_path);
+TEST(hsqs_lookup_dentry_cache);
+TEST(hsqs_lookup_name_index);
+TEST(hsqs_lookup_name_index_counted);
 TEST(hsqs_cat_fragment);
 TEST(hsqs_cat_datablock_and_fragment);
 TEST(hsqs_cat_size_overflow);
+TEST(hsqs_cat_window);
+TEST(hsqs_cat_reuse_context);
+TEST(hsqs_cat_datablock_cache);
+TEST(hsqs_cat_sparse);
+TEST(hsqs_cat_fragment_cache);
+#ifndef CONFIG_SINGLE_THREADED
+TEST(hsqs_cat_prefetch);
+TEST(hsqs_cat_parallel);
+#endif
+TEST(hsqs_cat_multithreaded);
+TEST(hsqs_file_block_offset);
+TEST(hsqs_file_block_offset_checkpoints);
 TEST(hsqs_test_uid_and_gid);
+TEST(hsqs_inode_cache_records);
+TEST(hsqs_metablock_stream_zero_copy);
+TEST(hsqs_metablock_stream_skip_in_block);
 TEST(hsqs_test_xattr);
 TEST_OFF(fuzz_crash_1); // Fails since the library sets up tables
 TEST_OFF(fuzz_crash_2); // Fails since the library sets up tables
@@ -0,0 +1,128 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2018, Enno Boland
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @author       Enno Boland (mail@eboland.de)
+ * @file         buffer.c
+ */
+
+#include "../common.h"
+#include "../test.h"
+
+#include "../../src/primitive/buffer.h"
+
+static const int compression_id = HSQS_COMPRESSION_GZIP;
+
+static void
+buffer_append_grows_geometrically() {
+	int rv = 0;
+	struct HsqsBuffer buffer = {0};
+	static const uint8_t data[] = "0123456789";
+
+	rv = hsqs_buffer_init(&buffer, compression_id, 1024);
+	assert(rv == 0);
+
+	rv = hsqs_buffer_append(&buffer, data, 10);
+	assert(rv == 0);
+	assert(hsqs_buffer_size(&buffer) == 10);
+	assert(hsqs_buffer_capacity(&buffer) == 10);
+
+	rv = hsqs_buffer_append(&buffer, data, 1);
+	assert(rv == 0);
+	assert(hsqs_buffer_size(&buffer) == 11);
+	assert(hsqs_buffer_capacity(&buffer) == 20);
+	assert(memcmp(hsqs_buffer_data(&buffer), "01234567890", 11) == 0);
+
+	rv = hsqs_buffer_cleanup(&buffer);
+	assert(rv == 0);
+}
+
+static void
+buffer_reserve() {
+	int rv = 0;
+	struct HsqsBuffer buffer = {0};
+	const uint8_t *data;
+	static const uint8_t source[] = "0123456789";
+
+	rv = hsqs_buffer_init(&buffer, compression_id, 1024);
+	assert(rv == 0);
+
+	rv = hsqs_buffer_reserve(&buffer, 100);
+	assert(rv == 0);
+	assert(hsqs_buffer_size(&buffer) == 0);
+	assert(hsqs_buffer_capacity(&buffer) == 100);
+	data = hsqs_buffer_data(&buffer);
+
+	for (int i = 0; i < 10; i++) {
+		rv = hsqs_buffer_append(&buffer, source, 10);
+		assert(rv == 0);
+	}
+	assert(hsqs_buffer_size(&buffer) == 100);
+	assert(hsqs_buffer_data(&buffer) == data);
+
+	rv = hsqs_buffer_reserve(&buffer, 50);
+	assert(rv == 0);
+	assert(hsqs_buffer_capacity(&buffer) == 100);
+
+	rv = hsqs_buffer_cleanup(&buffer);
+	assert(rv == 0);
+}
+
+static void
+buffer_reset_keeps_allocation() {
+	int rv = 0;
+	struct HsqsBuffer buffer = {0};
+	const uint8_t *data;
+	static const uint8_t source[] = "0123456789";
+
+	rv = hsqs_buffer_init(&buffer, compression_id, 1024);
+	assert(rv == 0);
+
+	rv = hsqs_buffer_append(&buffer, source, 10);
+	assert(rv == 0);
+	data = hsqs_buffer_data(&buffer);
+
+	hsqs_buffer_reset(&buffer);
+	assert(hsqs_buffer_size(&buffer) == 0);
+	assert(hsqs_buffer_capacity(&buffer) == 10);
+
+	rv = hsqs_buffer_append(&buffer, &source[5], 5);
+	assert(rv == 0);
+	assert(hsqs_buffer_data(&buffer) == data);
+	assert(memcmp(hsqs_buffer_data(&buffer), "56789", 5) == 0);
+
+	rv = hsqs_buffer_cleanup(&buffer);
+	assert(rv == 0);
+}
+
+DEFINE
+TEST(buffer_append_grows_geometrically);
+TEST(buffer_reserve);
+TEST(buffer_reset_keeps_allocation);
+DEFINE_END
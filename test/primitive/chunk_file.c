@@ -0,0 +1,144 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright (c) 2022, Enno Boland <g@s01.de>                                 *
+ *                                                                            *
+ * Redistribution and use in source and binary forms, with or without         *
+ * modification, are permitted provided that the following conditions are     *
+ * met:                                                                       *
+ *                                                                            *
+ * * Redistributions of source code must retain the above copyright notice,   *
+ *   this list of conditions and the following disclaimer.                    *
+ * * Redistributions in binary form must reproduce the above copyright        *
+ *   notice, this list of conditions and the following disclaimer in the      *
+ *   documentation and/or other materials provided with the distribution.     *
+ *                                                                            *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS    *
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,  *
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR     *
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR          *
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,      *
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,        *
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR         *
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF     *
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING       *
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS         *
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.               *
+ *                                                                            *
+ ******************************************************************************/
+
+/**
+ * @author       Enno Boland (mail@eboland.de)
+ * @file         chunk_file.c
+ */
+
+#include "../common.h"
+#include "../test.h"
+
+#include "../../src/primitive/chunk_file.h"
+
+static char *
+temp_path() {
+	static char path[] = "/tmp/hsqs_chunk_file_XXXXXX";
+	int fd;
+
+	strcpy(path, "/tmp/hsqs_chunk_file_XXXXXX");
+	fd = mkstemp(path);
+	assert(fd >= 0);
+	close(fd);
+	return path;
+}
+
+static void
+write_and_read() {
+	int rv = 0;
+	ssize_t size;
+	uint8_t data[100] = {0};
+	uint8_t target[100] = {0};
+	struct HsqsChunkFile file = {0};
+	char *path = temp_path();
+
+	rv = hsqs_chunk_file_open(&file, path, 250, 1, 100);
+	assert(rv == 0);
+	assert(hsqs_chunk_file_chunk_size(&file, 1) == 100);
+	assert(hsqs_chunk_file_chunk_size(&file, 2) == 50);
+	assert(hsqs_chunk_file_chunk_size(&file, 3) == 0);
+
+	size = hsqs_chunk_file_read(&file, 1, target);
+	assert(size == 0);
+
+	memset(data, 'a', sizeof(data));
+	rv = hsqs_chunk_file_write(&file, 1, data, 100);
+	assert(rv == 0);
+	memset(data, 'b', sizeof(data));
+	rv = hsqs_chunk_file_write(&file, 2, data, 50);
+	assert(rv == 0);
+	rv = hsqs_chunk_file_write(&file, 2, data, 100);
+	assert(rv < 0);
+
+	size = hsqs_chunk_file_read(&file, 0, target);
+	assert(size == 0);
+	size = hsqs_chunk_file_read(&file, 2, target);
+	assert(size == 50);
+	assert(target[0] == 'b' && target[49] == 'b');
+	hsqs_chunk_file_cleanup(&file);
+
+	// the chunks survive reopening the file.
+	rv = hsqs_chunk_file_open(&file, path, 250, 1, 100);
+	assert(rv == 0);
+	size = hsqs_chunk_file_read(&file, 1, target);
+	assert(size == 100);
+	assert(target[0] == 'a' && target[99] == 'a');
+	hsqs_chunk_file_cleanup(&file);
+
+	unlink(path);
+}
+
+static void
+reset_on_change() {
+	int rv = 0;
+	ssize_t size;
+	uint8_t data[100] = {0};
+	uint8_t target[100] = {0};
+	struct HsqsChunkFile file = {0};
+	char *path = temp_path();
+
+	rv = hsqs_chunk_file_open(&file, path, 250, 1, 100);
+	assert(rv == 0);
+	rv = hsqs_chunk_file_write(&file, 0, data, 100);
+	assert(rv == 0);
+	hsqs_chunk_file_cleanup(&file);
+
+	rv = hsqs_chunk_file_open(&file, path, 250, 2, 100);
+	assert(rv == 0);
+	size = hsqs_chunk_file_read(&file, 0, target);
+	assert(size == 0);
+	hsqs_chunk_file_cleanup(&file);
+
+	unlink(path);
+}
+
+static void
+no_reset_while_in_use() {
+	int rv = 0;
+	struct HsqsChunkFile file = {0};
+	struct HsqsChunkFile other = {0};
+	char *path = temp_path();
+
+	rv = hsqs_chunk_file_open(&file, path, 250, 1, 100);
+	assert(rv == 0);
+	rv = hsqs_chunk_file_open(&other, path, 250, 1, 100);
+	assert(rv == 0);
+	hsqs_chunk_file_cleanup(&other);
+
+	rv = hsqs_chunk_file_open(&other, path, 250, 2, 100);
+	assert(rv < 0);
+	hsqs_chunk_file_cleanup(&file);
+
+	unlink(path);
+}
+
+DEFINE
+TEST(write_and_read);
+TEST(reset_on_change);
+TEST(no_reset_while_in_use);
+DEFINE_END
@@ -271,6 +271,154 @@ hashmap_size_1() {
 	assert(rv == 0);
 }
 
+static void
+hashmap_evict_by_bytes() {
+	int rv = 0;
+	struct HsqsLruHashmap hashmap = {0};
+	struct HsqsRefCount *rc1;
+	struct HsqsRefCount *rc2;
+	struct HsqsRefCount *rc3;
+
+	rv = hsqs_ref_count_new(&rc1, sizeof(int), dummy_dtor);
+	assert(rv == 0);
+	rv = hsqs_ref_count_new(&rc2, sizeof(int), dummy_dtor);
+	assert(rv == 0);
+	rv = hsqs_ref_count_new(&rc3, sizeof(int), dummy_dtor);
+	assert(rv == 0);
+
+	rv = hsqs_lru_hashmap_init_limits(&hashmap, 0, 100);
+	assert(rv == 0);
+
+	rv = hsqs_lru_hashmap_put_sized(&hashmap, 1, rc1, 40);
+	assert(rv == 0);
+	rv = hsqs_lru_hashmap_put_sized(&hashmap, 2, rc2, 40);
+	assert(rv == 0);
+	assert(hashmap.bytes == 80);
+
+	// touch 1 so 2 becomes the eviction candidate
+	assert(hsqs_lru_hashmap_get(&hashmap, 1) == rc1);
+
+	rv = hsqs_lru_hashmap_put_sized(&hashmap, 3, rc3, 40);
+	assert(rv == 0);
+	assert(hashmap.bytes == 80);
+	assert(hashmap.count == 2);
+	assert(hsqs_lru_hashmap_get(&hashmap, 2) == NULL);
+	assert(hsqs_lru_hashmap_get(&hashmap, 1) == rc1);
+	assert(hsqs_lru_hashmap_get(&hashmap, 3) == rc3);
+
+	rv = hsqs_lru_hashmap_cleanup(&hashmap);
+	assert(rv == 0);
+}
+
+static void
+hashmap_grow() {
+	const int NBR = 4096;
+	int rv = 0;
+	int *value;
+	struct HsqsLruHashmap hashmap = {0};
+	struct HsqsRefCount *rc;
+
+	rv = hsqs_lru_hashmap_init_limits(&hashmap, 0, 0);
+	assert(rv == 0);
+
+	for (int i = 0; i < NBR; i++) {
+		rv = hsqs_ref_count_new(&rc, sizeof(int), dummy_dtor);
+		assert(rv == 0);
+		value = hsqs_ref_count_retain(rc);
+		*value = i;
+		rv = hsqs_lru_hashmap_put(&hashmap, i * 8192, rc);
+		assert(rv == 0);
+		hsqs_ref_count_release(rc);
+	}
+	assert(hashmap.count == (size_t)NBR);
+	assert(hashmap.size >= (size_t)NBR);
+
+	for (int i = 0; i < NBR; i++) {
+		rc = hsqs_lru_hashmap_get(&hashmap, i * 8192);
+		assert(rc != NULL);
+		value = hsqs_ref_count_retain(rc);
+		assert(*value == i);
+		hsqs_ref_count_release(rc);
+	}
+	// the lookups above moved every entry, so the order is unchanged
+	assert(hashmap.oldest->hash == 0);
+	assert(hashmap.newest->hash == (uint64_t)(NBR - 1) * 8192);
+
+	rv = hsqs_lru_hashmap_cleanup(&hashmap);
+	assert(rv == 0);
+}
+
+static void
+hashmap_remove() {
+	const int NBR = 256;
+	int rv = 0;
+	struct HsqsLruHashmap hashmap = {0};
+	struct HsqsRefCount *values[NBR];
+	struct HsqsRefCount *rc;
+
+	rv = hsqs_lru_hashmap_init(&hashmap, NBR);
+	assert(rv == 0);
+
+	for (int i = 0; i < NBR; i++) {
+		rv = hsqs_ref_count_new(&values[i], sizeof(int), dummy_dtor);
+		assert(rv == 0);
+		rv = hsqs_lru_hashmap_put(&hashmap, i, values[i]);
+		assert(rv == 0);
+	}
+
+	for (int i = 0; i < NBR; i += 2) {
+		rc = hsqs_lru_hashmap_remove(&hashmap, i);
+		assert(rc == values[i]);
+		hsqs_ref_count_release(rc);
+	}
+	assert(hashmap.count == NBR / 2);
+
+	for (int i = 0; i < NBR; i++) {
+		rc = hsqs_lru_hashmap_get(&hashmap, i);
+		if (i % 2 == 0) {
+			assert(rc == NULL);
+		} else {
+			assert(rc == values[i]);
+		}
+	}
+
+	rv = hsqs_lru_hashmap_cleanup(&hashmap);
+	assert(rv == 0);
+}
+
+static void
+hashmap_acquire() {
+	int rv = 0;
+	struct HsqsLruHashmap hashmap = {0};
+	struct HsqsRefCount *rc1;
+	struct HsqsRefCount *p;
+
+	rv = hsqs_ref_count_new(&rc1, sizeof(int), dtor);
+	assert(rv == 0);
+
+	rv = hsqs_lru_hashmap_init(&hashmap, 1);
+	assert(rv == 0);
+
+	rv = hsqs_lru_hashmap_put(&hashmap, 1, rc1);
+	assert(rv == 0);
+
+	p = hsqs_lru_hashmap_acquire(&hashmap, 1);
+	assert(p == rc1);
+	assert(hsqs_lru_hashmap_acquire(&hashmap, 2) == NULL);
+
+	// the acquired reference outlives the entry
+	last_free = NULL;
+	p = hsqs_lru_hashmap_remove(&hashmap, 1);
+	assert(p == rc1);
+	hsqs_ref_count_release(p);
+	assert(last_free == NULL);
+	hsqs_ref_count_release(rc1);
+	assert(last_free == rc1);
+
+	rv = hsqs_lru_hashmap_cleanup(&hashmap);
+	assert(rv == 0);
+}
+
 DEFINE
 TEST(init_hashmap);
 TEST(add_to_hashmap);
@@ -278,4 +426,8 @@ TEST(read_from_hashmap);
 TEST(hashmap_overflow);
 TEST(hashmap_add_many);
 TEST(hashmap_size_1);
+TEST(hashmap_evict_by_bytes);
+TEST(hashmap_grow);
+TEST(hashmap_remove);
+TEST(hashmap_acquire);
 DEFINE_END
@@ -0,0 +1,118 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2018, Enno Boland
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @author       Enno Boland (mail@eboland.de)
+ * @file         ref_count.c
+ */
+
+#include "../common.h"
+#include "../test.h"
+
+#include "../../src/primitive/ref_count.h"
+#include <pthread.h>
+
+#define THREADS 8
+#define ITERATIONS 100000
+
+static int dtor_calls = 0;
+
+static int
+counting_dtor(void *pointer) {
+	assert(pointer != NULL);
+	dtor_calls++;
+	return 0;
+}
+
+static void
+retain_release() {
+	int rv = 0;
+	int *value;
+	struct HsqsRefCount *rc;
+
+	dtor_calls = 0;
+	rv = hsqs_ref_count_new(&rc, sizeof(int), counting_dtor);
+	assert(rv == 0);
+
+	value = hsqs_ref_count_retain(rc);
+	assert(value == hsqs_ref_count_data(rc));
+	hsqs_ref_count_retain(rc);
+
+	rv = hsqs_ref_count_release(rc);
+	assert(rv == 1);
+	assert(dtor_calls == 0);
+	rv = hsqs_ref_count_release(rc);
+	assert(rv == 0);
+	assert(dtor_calls == 1);
+}
+
+#ifndef CONFIG_SINGLE_THREADED
+static void *
+retain_release_worker(void *arg) {
+	struct HsqsRefCount *rc = arg;
+
+	for (int i = 0; i < ITERATIONS; i++) {
+		hsqs_ref_count_retain(rc);
+		hsqs_ref_count_release(rc);
+	}
+	hsqs_ref_count_release(rc);
+	return NULL;
+}
+
+static void
+concurrent_retain_release() {
+	int rv = 0;
+	pthread_t threads[THREADS];
+	struct HsqsRefCount *rc;
+
+	dtor_calls = 0;
+	rv = hsqs_ref_count_new(&rc, sizeof(int), counting_dtor);
+	assert(rv == 0);
+
+	// one reference per thread, each thread drops its own at the end.
+	for (int i = 0; i < THREADS; i++) {
+		hsqs_ref_count_retain(rc);
+	}
+	for (int i = 0; i < THREADS; i++) {
+		rv = pthread_create(&threads[i], NULL, retain_release_worker, rc);
+		assert(rv == 0);
+	}
+	for (int i = 0; i < THREADS; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	assert(dtor_calls == 1);
+}
+#endif
+
+DEFINE
+TEST(retain_release);
+#ifndef CONFIG_SINGLE_THREADED
+TEST(concurrent_retain_release);
+#endif
+DEFINE_END
@@ -0,0 +1,137 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2018, Enno Boland
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @author       Enno Boland (mail@eboland.de)
+ * @file         sharded_lru_hashmap.c
+ */
+
+#include "../common.h"
+#include "../test.h"
+
+#include "../../src/primitive/sharded_lru_hashmap.h"
+
+static int
+dummy_dtor(void *pointer) {
+	assert(pointer != NULL);
+	return 0;
+}
+
+static void
+sharded_init() {
+	int rv = 0;
+	struct HsqsShardedLruHashmap hashmap = {0};
+
+	rv = hsqs_sharded_lru_hashmap_init(&hashmap, 4, 0, 0);
+	assert(rv == 0);
+	assert(hashmap.shard_count == 4);
+	for (hsqs_index_t i = 0; i < hashmap.shard_count; i++) {
+		assert((uintptr_t)&hashmap.shards[i] % HSQS_CACHE_LINE_SIZE == 0);
+	}
+
+	rv = hsqs_sharded_lru_hashmap_cleanup(&hashmap);
+	assert(rv == 0);
+}
+
+static void
+sharded_put_get() {
+	const int NBR = 1024;
+	int rv = 0;
+	int *value;
+	struct HsqsShardedLruHashmap hashmap = {0};
+	struct HsqsRefCount *rc;
+
+	rv = hsqs_sharded_lru_hashmap_init(&hashmap, 7, 0, 0);
+	assert(rv == 0);
+
+	for (int i = 0; i < NBR; i++) {
+		rv = hsqs_ref_count_new(&rc, sizeof(int), dummy_dtor);
+		assert(rv == 0);
+		value = hsqs_ref_count_retain(rc);
+		*value = i;
+		rv = hsqs_sharded_lru_hashmap_put(&hashmap, i, rc);
+		assert(rv == 0);
+		hsqs_ref_count_release(rc);
+	}
+
+	for (int i = 0; i < NBR; i++) {
+		rc = hsqs_sharded_lru_hashmap_get(&hashmap, i);
+		assert(rc != NULL);
+		value = hsqs_ref_count_retain(rc);
+		assert(*value == i);
+		hsqs_ref_count_release(rc);
+	}
+	assert(hsqs_sharded_lru_hashmap_get(&hashmap, NBR) == NULL);
+	assert(hsqs_sharded_lru_hashmap_hits(&hashmap) == (size_t)NBR);
+	assert(hsqs_sharded_lru_hashmap_misses(&hashmap) == 1);
+
+	// every shard should have received some of the keys
+	for (hsqs_index_t i = 0; i < hashmap.shard_count; i++) {
+		assert(hashmap.shards[i].hashmap.count > 0);
+	}
+
+	rv = hsqs_sharded_lru_hashmap_cleanup(&hashmap);
+	assert(rv == 0);
+}
+
+static void
+sharded_limits() {
+	const int NBR = 1024;
+	int rv = 0;
+	size_t count = 0;
+	struct HsqsShardedLruHashmap hashmap = {0};
+	struct HsqsRefCount *rc;
+
+	rv = hsqs_sharded_lru_hashmap_init(&hashmap, 4, 0, 4 * 100);
+	assert(rv == 0);
+
+	for (int i = 0; i < NBR; i++) {
+		rv = hsqs_ref_count_new(&rc, sizeof(int), dummy_dtor);
+		assert(rv == 0);
+		rv = hsqs_sharded_lru_hashmap_put_sized(&hashmap, i, rc, 10);
+		assert(rv == 0);
+	}
+
+	for (hsqs_index_t i = 0; i < hashmap.shard_count; i++) {
+		assert(hashmap.shards[i].hashmap.bytes <= 100);
+		count += hashmap.shards[i].hashmap.count;
+	}
+	assert(count <= 40);
+	// the newest entry always survives
+	assert(hsqs_sharded_lru_hashmap_get(&hashmap, NBR - 1) != NULL);
+
+	rv = hsqs_sharded_lru_hashmap_cleanup(&hashmap);
+	assert(rv == 0);
+}
+
+DEFINE
+TEST(sharded_init);
+TEST(sharded_put_get);
+TEST(sharded_limits);
+DEFINE_END
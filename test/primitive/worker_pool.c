@@ -0,0 +1,163 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright (c) 2022, Enno Boland <g@s01.de>                                 *
+ *                                                                            *
+ * Redistribution and use in source and binary forms, with or without         *
+ * modification, are permitted provided that the following conditions are     *
+ * met:                                                                       *
+ *                                                                            *
+ * * Redistributions of source code must retain the above copyright notice,   *
+ *   this list of conditions and the following disclaimer.                    *
+ * * Redistributions in binary form must reproduce the above copyright        *
+ *   notice, this list of conditions and the following disclaimer in the      *
+ *   documentation and/or other materials provided with the distribution.     *
+ *                                                                            *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS    *
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,  *
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR     *
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR          *
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,      *
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,        *
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR         *
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF     *
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING       *
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS         *
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.               *
+ *                                                                            *
+ ******************************************************************************/
+
+/**
+ * @author       Enno Boland (mail@eboland.de)
+ * @file         worker_pool.c
+ */
+
+#include "../common.h"
+#include "../test.h"
+
+#include "../../src/error.h"
+#include "../../src/primitive/worker_pool.h"
+#include <stdatomic.h>
+
+#define JOBS 1000
+
+static void
+count_job(void *argument) {
+	atomic_int *counter = argument;
+	atomic_fetch_add(counter, 1);
+}
+
+static void
+run_jobs() {
+	int rv = 0;
+	atomic_int counter = 0;
+	struct HsqsWorkerPool pool = {0};
+
+	rv = hsqs_worker_pool_init(&pool, 4, 16);
+	assert(rv == 0);
+	assert(hsqs_worker_pool_thread_count(&pool) == 4);
+
+	for (int i = 0; i < JOBS; i++) {
+		// the queue is bounded, retry until a worker picked up a job.
+		while ((rv = hsqs_worker_pool_try_submit(&pool, count_job, &counter)) ==
+			   -HSQS_ERROR_WORKER_POOL_FULL) {
+			sched_yield();
+		}
+		assert(rv == 0);
+	}
+	hsqs_worker_pool_wait(&pool);
+	assert(atomic_load(&counter) == JOBS);
+
+	rv = hsqs_worker_pool_cleanup(&pool);
+	assert(rv == 0);
+}
+
+static void
+cleanup_drains_queue() {
+	int rv = 0;
+	atomic_int counter = 0;
+	struct HsqsWorkerPool pool = {0};
+
+	rv = hsqs_worker_pool_init(&pool, 1, 8);
+	assert(rv == 0);
+	// the queue holds all jobs, even if the worker did not start yet.
+	for (int i = 0; i < 8; i++) {
+		rv = hsqs_worker_pool_try_submit(&pool, count_job, &counter);
+		assert(rv == 0);
+	}
+	rv = hsqs_worker_pool_cleanup(&pool);
+	assert(rv == 0);
+	assert(atomic_load(&counter) == 8);
+}
+
+static void
+group_wait() {
+	int rv = 0;
+	atomic_int counter = 0;
+	struct HsqsWorkerPool pool = {0};
+	struct HsqsWorkerGroup group;
+
+	rv = hsqs_worker_pool_init(&pool, 2, 64);
+	assert(rv == 0);
+	hsqs_worker_group_init(&group, &pool);
+
+	for (int i = 0; i < 32; i++) {
+		rv = hsqs_worker_group_try_submit(&group, count_job, &counter);
+		assert(rv == 0);
+	}
+	hsqs_worker_group_wait(&group);
+	assert(atomic_load(&counter) == 32);
+	assert(group.pending == 0);
+
+	rv = hsqs_worker_pool_cleanup(&pool);
+	assert(rv == 0);
+}
+
+static void
+threads_start_on_submit() {
+	int rv = 0;
+	atomic_int counter = 0;
+	struct HsqsWorkerPool pool = {0};
+
+	rv = hsqs_worker_pool_init(&pool, 2, 8);
+	assert(rv == 0);
+	assert(hsqs_worker_pool_thread_count(&pool) == 2);
+	assert(pool.started_count == 0);
+
+	rv = hsqs_worker_pool_try_submit(&pool, count_job, &counter);
+	assert(rv == 0);
+	assert(pool.started_count == 2);
+	hsqs_worker_pool_wait(&pool);
+	assert(atomic_load(&counter) == 1);
+
+	rv = hsqs_worker_pool_cleanup(&pool);
+	assert(rv == 0);
+}
+
+static void
+no_threads_rejects_jobs() {
+	int rv = 0;
+	atomic_int counter = 0;
+	struct HsqsWorkerPool pool = {0};
+
+	rv = hsqs_worker_pool_init(&pool, 0, 8);
+	assert(rv == 0);
+	assert(hsqs_worker_pool_thread_count(&pool) == 0);
+
+	rv = hsqs_worker_pool_try_submit(&pool, count_job, &counter);
+	assert(rv == -HSQS_ERROR_WORKER_POOL_FULL);
+	hsqs_worker_pool_wait(&pool);
+
+	rv = hsqs_worker_pool_cleanup(&pool);
+	assert(rv == 0);
+	assert(atomic_load(&counter) == 0);
+}
+
+DEFINE
+#ifndef CONFIG_SINGLE_THREADED
+TEST(run_jobs);
+TEST(cleanup_drains_queue);
+TEST(group_wait);
+TEST(threads_start_on_submit);
+#endif
+TEST(no_threads_rejects_jobs);
+DEFINE_END
@@ -0,0 +1,362 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright (c) 2022, Enno Boland <g@s01.de>                                 *
+ *                                                                            *
+ * Redistribution and use in source and binary forms, with or without         *
+ * modification, are permitted provided that the following conditions are     *
+ * met:                                                                       *
+ *                                                                            *
+ * * Redistributions of source code must retain the above copyright notice,   *
+ *   this list of conditions and the following disclaimer.                    *
+ * * Redistributions in binary form must reproduce the above copyright        *
+ *   notice, this list of conditions and the following disclaimer in the      *
+ *   documentation and/or other materials provided with the distribution.     *
+ *                                                                            *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS    *
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,  *
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR     *
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR          *
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,      *
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,        *
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR         *
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF     *
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING       *
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS         *
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.               *
+ *                                                                            *
+ ******************************************************************************/
+
+/**
+ * @author       Enno Boland (mail@eboland.de)
+ * @file         remote.c
+ */
+
+#include "../src/context/content_context.h"
+#include "../src/context/inode_context.h"
+#include "../src/hsqs.h"
+#include "../src/iterator/directory_iterator.h"
+#include "common.h"
+#include "test.h"
+#include <squashfs_image.h>
+
+#ifdef CONFIG_CURL
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+
+// Minimal HTTP server answering range requests for squash_image. Every
+// connection serves a single request.
+struct HttpServer {
+	int fd;
+	pthread_t thread;
+	char url[64];
+	atomic_size_t requests;
+};
+
+static void
+http_respond(int fd) {
+	char request[4096] = {0};
+	char header[512];
+	size_t size = 0;
+	ssize_t rv;
+	uint64_t start = 0, end = 0;
+	const char *range;
+	int header_size;
+
+	while (strstr(request, "\r\n\r\n") == NULL) {
+		rv = read(fd, &request[size], sizeof(request) - size - 1);
+		if (rv <= 0) {
+			return;
+		}
+		size += rv;
+	}
+	range = strstr(request, "Range: bytes=");
+	assert(range != NULL);
+	rv = sscanf(range, "Range: bytes=%" SCNu64 "-%" SCNu64, &start, &end);
+	assert(rv == 2);
+	end = MIN(end, sizeof(squash_image) - 1);
+	assert(start <= end);
+
+	header_size = snprintf(
+			header, sizeof(header),
+			"HTTP/1.1 206 Partial Content\r\n"
+			"Content-Range: bytes %" PRIu64 "-%" PRIu64 "/%zu\r\n"
+			"Content-Length: %" PRIu64 "\r\n"
+			"Last-Modified: Wed, 21 Oct 2015 07:28:00 GMT\r\n"
+			"Connection: close\r\n\r\n",
+			start, end, sizeof(squash_image), end - start + 1);
+	rv = write(fd, header, header_size);
+	assert(rv == header_size);
+	rv = write(fd, &squash_image[start], end - start + 1);
+	assert(rv == (ssize_t)(end - start + 1));
+}
+
+static void *
+http_serve(void *data) {
+	struct HttpServer *server = data;
+	int fd;
+
+	while ((fd = accept(server->fd, NULL, NULL)) >= 0) {
+		atomic_fetch_add(&server->requests, 1);
+		http_respond(fd);
+		close(fd);
+	}
+	return NULL;
+}
+
+static void
+http_server_start(struct HttpServer *server) {
+	int rv;
+	struct sockaddr_in address = {
+			.sin_family = AF_INET,
+			.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t address_size = sizeof(address);
+
+	server->fd = socket(AF_INET, SOCK_STREAM, 0);
+	assert(server->fd >= 0);
+	rv = bind(server->fd, (struct sockaddr *)&address, sizeof(address));
+	assert(rv == 0);
+	rv = listen(server->fd, 16);
+	assert(rv == 0);
+	rv = getsockname(server->fd, (struct sockaddr *)&address, &address_size);
+	assert(rv == 0);
+	snprintf(
+			server->url, sizeof(server->url), "http://127.0.0.1:%u/image",
+			ntohs(address.sin_port));
+	atomic_init(&server->requests, 0);
+
+	rv = pthread_create(&server->thread, NULL, http_serve, server);
+	assert(rv == 0);
+}
+
+static void
+http_server_stop(struct HttpServer *server) {
+	// wakes up the accept() of the server thread.
+	shutdown(server->fd, SHUT_RDWR);
+	pthread_join(server->thread, NULL);
+	close(server->fd);
+}
+
+static void
+cat_b(struct Hsqs *hsqs) {
+	int rv;
+	const uint8_t *data;
+	size_t size;
+	struct HsqsInodeContext inode = {0};
+	struct HsqsFileContext file = {0};
+
+	rv = hsqs_inode_load_by_path(&inode, hsqs, "b");
+	assert(rv == 0);
+	rv = hsqs_content_init(&file, &inode);
+	assert(rv == 0);
+
+	size = hsqs_inode_file_size(&inode);
+	assert(size == 1050000);
+	rv = hsqs_content_read(&file, size);
+	assert(rv == 0);
+	assert(size == hsqs_content_size(&file));
+	data = hsqs_content_data(&file);
+	for (hsqs_index_t i = 0; i < size; i++) {
+		assert(data[i] == 'b');
+	}
+
+	rv = hsqs_content_cleanup(&file);
+	assert(rv == 0);
+	rv = hsqs_inode_cleanup(&inode);
+	assert(rv == 0);
+}
+
+static void
+remote_ls() {
+	int rv;
+	char *name;
+	struct HttpServer server;
+	struct HsqsInodeContext inode = {0};
+	struct HsqsDirectoryIterator iter = {0};
+	struct Hsqs hsqs = {0};
+
+	http_server_start(&server);
+	rv = hsqs_open_any(&hsqs, server.url);
+	assert(rv == 0);
+
+	rv = hsqs_inode_load_root(&inode, &hsqs);
+	assert(rv == 0);
+	rv = hsqs_directory_iterator_init(&iter, &inode);
+	assert(rv == 0);
+
+	rv = hsqs_directory_iterator_next(&iter);
+	assert(rv > 0);
+	rv = hsqs_directory_iterator_name_dup(&iter, &name);
+	assert(rv == 1);
+	assert(strcmp("a", name) == 0);
+	free(name);
+
+	rv = hsqs_directory_iterator_next(&iter);
+	assert(rv > 0);
+	rv = hsqs_directory_iterator_name_dup(&iter, &name);
+	assert(rv == 1);
+	assert(strcmp("b", name) == 0);
+	free(name);
+
+	rv = hsqs_directory_iterator_next(&iter);
+	assert(rv > 0);
+	rv = hsqs_directory_iterator_name_dup(&iter, &name);
+	assert(rv == 1);
+	assert(strcmp("c", name) == 0);
+	free(name);
+
+	rv = hsqs_directory_iterator_next(&iter);
+	assert(rv > 0);
+	rv = hsqs_directory_iterator_name_dup(&iter, &name);
+	assert(rv == 1);
+	assert(strcmp("d", name) == 0);
+	free(name);
+
+	rv = hsqs_directory_iterator_next(&iter);
+	assert(rv == 0);
+
+	rv = hsqs_directory_iterator_cleanup(&iter);
+	assert(rv == 0);
+	rv = hsqs_inode_cleanup(&inode);
+	assert(rv == 0);
+	rv = hsqs_cleanup(&hsqs);
+	assert(rv == 0);
+	http_server_stop(&server);
+}
+
+static void
+remote_cat() {
+	int rv;
+	struct HttpServer server;
+	struct Hsqs hsqs = {0};
+	// small chunks and caches force many overlapping range requests.
+	struct HsqsOptions options = {
+			.curl_handles = 2,
+			.curl_chunk_size = 512,
+			.curl_cache_size = 4096,
+			.worker_count = 2,
+	};
+
+	http_server_start(&server);
+	rv = hsqs_open_url_ex(&hsqs, server.url, &options);
+	assert(rv == 0);
+
+	cat_b(&hsqs);
+
+	rv = hsqs_cleanup(&hsqs);
+	assert(rv == 0);
+	http_server_stop(&server);
+}
+
+static void
+remote_metadata_single_request() {
+	int rv;
+	struct HttpServer server;
+	struct HsqsInodeContext inode = {0};
+	struct HsqsDirectoryIterator iter = {0};
+	struct Hsqs hsqs = {0};
+	struct HsqsOptions options = {.curl_chunk_size = 512};
+
+	http_server_start(&server);
+	rv = hsqs_open_url_ex(&hsqs, server.url, &options);
+	assert(rv == 0);
+	// the superblock
+	assert(atomic_load(&server.requests) == 1);
+
+	rv = hsqs_inode_load_root(&inode, &hsqs);
+	assert(rv == 0);
+	rv = hsqs_directory_iterator_init(&iter, &inode);
+	assert(rv == 0);
+	while ((rv = hsqs_directory_iterator_next(&iter)) > 0) {
+	}
+	assert(rv == 0);
+	// all tables are fetched with one request for the metadata region.
+	assert(atomic_load(&server.requests) == 2);
+
+	rv = hsqs_directory_iterator_cleanup(&iter);
+	assert(rv == 0);
+	rv = hsqs_inode_cleanup(&inode);
+	assert(rv == 0);
+	rv = hsqs_cleanup(&hsqs);
+	assert(rv == 0);
+	http_server_stop(&server);
+}
+
+static void
+remote_unreachable() {
+	int rv;
+	struct HttpServer server;
+	struct Hsqs hsqs = {0};
+
+	// nothing listens on the port of a stopped server.
+	http_server_start(&server);
+	http_server_stop(&server);
+	rv = hsqs_open_url(&hsqs, server.url);
+	assert(rv < 0);
+}
+
+static void
+remove_directory(const char *path) {
+	DIR *dir = opendir(path);
+	struct dirent *entry;
+	char file[PATH_MAX];
+
+	assert(dir != NULL);
+	while ((entry = readdir(dir)) != NULL) {
+		if (entry->d_name[0] == '.') {
+			continue;
+		}
+		snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+		unlink(file);
+	}
+	closedir(dir);
+	rmdir(path);
+}
+
+static void
+remote_disk_cache() {
+	int rv;
+	struct HttpServer server;
+	struct Hsqs hsqs = {0};
+	char cache_dir[] = "/tmp/hsqs_remote_XXXXXX";
+	struct HsqsOptions options = {0};
+
+	assert(mkdtemp(cache_dir) != NULL);
+	options.curl_cache_dir = cache_dir;
+	http_server_start(&server);
+
+	rv = hsqs_open_url_ex(&hsqs, server.url, &options);
+	assert(rv == 0);
+	cat_b(&hsqs);
+	rv = hsqs_cleanup(&hsqs);
+	assert(rv == 0);
+
+	// a second open only validates the image with the server.
+	atomic_store(&server.requests, 0);
+	memset(&hsqs, 0, sizeof(hsqs));
+	rv = hsqs_open_url_ex(&hsqs, server.url, &options);
+	assert(rv == 0);
+	cat_b(&hsqs);
+	rv = hsqs_cleanup(&hsqs);
+	assert(rv == 0);
+	assert(atomic_load(&server.requests) == 1);
+
+	http_server_stop(&server);
+	remove_directory(cache_dir);
+}
+#endif
+
+DEFINE
+#ifdef CONFIG_CURL
+TEST(remote_ls);
+TEST(remote_cat);
+TEST(remote_metadata_single_request);
+TEST(remote_unreachable);
+TEST(remote_disk_cache);
+#endif
+DEFINE_END
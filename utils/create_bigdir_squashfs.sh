@@ -0,0 +1,13 @@
+#!/bin/sh -e
+
+out=$1
+tmp=$2
+count=${3:-100000}
+
+rm -rf "$tmp/dir"
+mkdir -p "$tmp/dir"
+(cd "$tmp/dir" && seq -f "%06g" 1 "$count" | xargs touch)
+[ -e "$out" ] && rm "$out"
+$MKSQUASHFS "$tmp/dir" "$out" \
+	-noappend \
+	-quiet
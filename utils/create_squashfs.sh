@@ -7,6 +7,14 @@ tmp=$3
 mkdir -p "$tmp"
 echo a > "$tmp/a"
 seq 1 1050000 | tr -cd "\n" | tr '\n' b > "$tmp/b"
+# two sparse blocks between data blocks and a fragment tail.
+{
+	head -c 131072 /dev/zero | tr '\0' c
+	head -c 262144 /dev/zero
+	head -c 131172 /dev/zero | tr '\0' c
+} > "$tmp/c"
+# more blocks than HSQS_INODE_BLOCK_INDEX_STRIDE.
+head -c 9175050 /dev/zero | tr '\0' d > "$tmp/d"
 $SETFATTR -n user.foo -v 1234567891234567891234567890001234567890 "$tmp/a"
 $SETFATTR -n user.bar -v 1234567891234567891234567890001234567890 "$tmp/b"
 [ -e "$out" ] && rm "$out"